@@ -0,0 +1,133 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Benchmark for the cpu core: runs the same synthetic workload
+ * through gbcpu_step() (table interpreter) and gbcpu_run()
+ * (threaded dispatch) and checks that both end in the same state.
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gbcpu_priv.h"
+
+#define BENCH_CYCLES (100L * 1000 * 1000)
+#define BENCH_ROUNDS 5
+
+/* loads, alu, cb-prefixed ops, push/pop and call/ret in a loop */
+static const uint8_t bench_code[] = {
+	0x31, 0xfe, 0xdf,	/* 0100: LD SP, dffe */
+	0x21, 0x00, 0xc0,	/* 0103: LD HL, c000 */
+	0x01, 0x00, 0x00,	/* 0106: LD BC, 0000 */
+	0x7e,			/* 0109: LD A, (HL) */
+	0x81,			/* 010a: ADD A, C */
+	0xa8,			/* 010b: XOR B */
+	0x07,			/* 010c: RLCA */
+	0x22,			/* 010d: LD (HL+), A */
+	0x0c,			/* 010e: INC C */
+	0xcb, 0x37,		/* 010f: SWAP A */
+	0xcb, 0x5f,		/* 0111: BIT 3, A */
+	0xcb, 0xc2,		/* 0113: SET 0, D */
+	0xc5,			/* 0115: PUSH BC */
+	0xd1,			/* 0116: POP DE */
+	0xcd, 0x24, 0x01,	/* 0117: CALL 0124 */
+	0x7c,			/* 011a: LD A, H */
+	0xfe, 0xd0,		/* 011b: CP d0 */
+	0x20, 0x02,		/* 011d: JR NZ, 0121 */
+	0x26, 0xc0,		/* 011f: LD H, c0 */
+	0x04,			/* 0121: INC B */
+	0x18, 0xe5,		/* 0122: JR 0109 */
+	0x1c,			/* 0124: INC E */
+	0xe6, 0x0f,		/* 0125: AND 0f */
+	0xb3,			/* 0127: OR E */
+	0xc9,			/* 0128: RET */
+};
+
+struct bench {
+	struct gbcpu gbcpu;
+	uint8_t mem[0x10000];
+	long insns;
+	double secs;
+};
+
+static regparm void bench_init(struct bench *b)
+{
+	memset(b->mem, 0, sizeof(b->mem));
+	memcpy(&b->mem[0x100], bench_code, sizeof(bench_code));
+	gbcpu_init(&b->gbcpu);
+	gbcpu_mapmem(&b->gbcpu, 0x00, 0x7f, &b->mem[0x0000], NULL);
+	gbcpu_mapmem(&b->gbcpu, 0x80, 0xff, &b->mem[0x8000], &b->mem[0x8000]);
+	gbcpu_addcode(&b->gbcpu, 0x00, 0x7f, GBCPU_CODE_ROM);
+	REGS16_W(b->gbcpu.regs, PC, 0x100);
+	b->insns = 0;
+}
+
+static regparm void bench_step(struct bench *b)
+{
+	clock_t start = clock();
+	long total = 0;
+
+	while (total < BENCH_CYCLES) {
+		total += gbcpu_step(&b->gbcpu);
+		b->insns++;
+	}
+	b->secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static regparm void bench_run(struct bench *b)
+{
+	clock_t start = clock();
+	long total = 0;
+
+	while (total < BENCH_CYCLES) {
+		total += gbcpu_run(&b->gbcpu, BENCH_CYCLES - total);
+		b->insns += b->gbcpu.run_insns;
+	}
+	b->secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static regparm void bench_report(const char *name, const struct bench *b)
+{
+	printf("%-10s %9ld insns  %6.3fs  %7.2f MIPS\n", name, b->insns,
+	       b->secs, b->secs > 0 ? b->insns / b->secs / 1e6 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	static struct bench table, threaded;
+	double table_best = 0, threaded_best = 0;
+	long i;
+
+	/* interleave the rounds and keep the fastest of each */
+	for (i=0; i<BENCH_ROUNDS; i++) {
+		bench_init(&table);
+		bench_step(&table);
+		if (i == 0 || table.secs < table_best)
+			table_best = table.secs;
+		bench_init(&threaded);
+		bench_run(&threaded);
+		if (i == 0 || threaded.secs < threaded_best)
+			threaded_best = threaded.secs;
+	}
+	table.secs = table_best;
+	threaded.secs = threaded_best;
+
+	bench_report("table", &table);
+	bench_report("threaded", &threaded);
+	if (table.secs > 0 && threaded.secs > 0)
+		printf("speedup    %.2fx\n", table.secs / threaded.secs);
+
+	if (table.insns != threaded.insns ||
+	    memcmp(&table.gbcpu.regs, &threaded.gbcpu.regs, sizeof(table.gbcpu.regs)) != 0 ||
+	    memcmp(table.mem, threaded.mem, sizeof(table.mem)) != 0) {
+		fprintf(stderr, "%s: table and threaded cpu state differ\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef _CONFIG_H_
+#define GBS_VERSION ""
+#define LOCALE_PREFIX "/usr/local/share/locale"
+#define SYSCONF_PREFIX "/etc"
+/* #undef PLUGOUT_ALSA */
+#define PLUGOUT_DEVDSP 1
+/* #undef PLUGOUT_DSOUND */
+#define PLUGOUT_IODUMPER 1
+#define PLUGOUT_MIDI 1
+#define PLUGOUT_ALTMIDI 1
+/* #undef PLUGOUT_NAS */
+/* #undef PLUGOUT_PULSE */
+#define PLUGOUT_STDOUT 1
+#define USE_I18N 1
+#define USE_REGPARM 1
+#define USE_ZLIB 1
+/* #undef HAVE_ESTRPIPE */
+#define HAVE_COMPUTED_GOTO 1
+#define HAVE_MMAP 1
+#define HAVE_PTHREAD 1
+#define HAVE_SSE2 1
+#define HAVE_AVX2 1
+/* #undef HAVE_NEON */
+#endif
@@ -0,0 +1,39 @@
+EXTRA_ALL := 
+EXTRA_CFLAGS := -Wdeclaration-after-statement -Wvla -Wimplicit-fallthrough -Wswitch-unreachable -fstack-protector-strong -fstack-clash-protection -D_FORTIFY_SOURCE=2 -Wall -fsigned-char -Os -pipe -fomit-frame-pointer
+EXTRA_INSTALL := 
+EXTRA_LDFLAGS := -lz -Wl,-z,relro -Wl,-z,now -Wl,-pie -fstack-protector-strong -fstack-clash-protection
+EXTRA_SRCS := 
+EXTRA_UNINSTALL := 
+PTHREAD := -lpthread
+XMMS_INPUT_PLUGIN_DIR := 
+VERSION := 
+prefix := /usr/local
+exec_prefix := /usr/local
+bindir := /usr/local/bin
+libdir := /usr/local/lib
+mandir := /usr/local/man
+docdir := /usr/local/share/doc/gbsplay
+localedir := /usr/local/share/locale
+mimedir := /usr/local/share/mime
+appdir := /usr/local/share/applications
+sysconfdir := /etc
+CC := gcc
+BUILDCC := gcc
+HOSTCC := gcc
+build_contrib := yes
+build_test := yes
+build_xmmsplugin := no
+have_xgettext := no
+use_i18n := yes
+use_sharedlibgbs := no
+cygwin_build := no
+libaudio_flags := 
+plugout_alsa := no
+plugout_devdsp := yes
+plugout_dsound := no
+plugout_iodumper := yes
+plugout_midi := yes
+plugout_altmidi := yes
+plugout_nas := no
+plugout_pulse := no
+plugout_stdout := yes
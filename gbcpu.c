@@ -12,7 +12,15 @@
 #include <unistd.h>
 #include <string.h>
 
-#include "gbcpu.h"
+#include "gbcpu_priv.h"
+
+#ifdef __GNUC__
+#define RUN_FLATTEN __attribute__((flatten))
+#define NOINLINE __attribute__((noinline))
+#else
+#define RUN_FLATTEN
+#define NOINLINE
+#endif
 
 #if DEBUG == 1
 static const char regnames[12] = "BCDEHLFASPPC";
@@ -26,7 +34,7 @@ static const char *conds[4] = {
 
 struct opinfo;
 
-typedef void regparm (*ex_fn)(uint32_t op, const struct opinfo *oi);
+typedef void regparm (*ex_fn)(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi);
 
 struct opinfo {
 #if DEBUG == 1 || defined(S_SPLINT_S)
@@ -39,600 +47,108 @@ struct opinfo {
 #endif
 };
 
-gbcpu_regs_u gbcpu_regs;
-long gbcpu_halted;
-long gbcpu_stopped;
-long gbcpu_if;
-long gbcpu_halt_at_pc;
-long gbcpu_cycles;
-
-static regparm uint32_t none_get(/*@unused@*/ uint32_t addr)
+static regparm uint32_t none_get(/*@unused@*/ void *priv, /*@unused@*/ uint32_t addr)
 {
 	return 0xff;
 }
 
-static regparm void none_put(/*@unused@*/ uint32_t addr, /*@unused@*/ uint8_t val)
-{
-}
-
-static gbcpu_get_fn getlookup[256] = {
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get,
-	&none_get
-};
+static regparm void none_put(/*@unused@*/ void *priv, /*@unused@*/ uint32_t addr, /*@unused@*/ uint8_t val)
+{
+}
 
-static gbcpu_put_fn putlookup[256] = {
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put,
-	&none_put
-};
+static regparm void sync_access(struct gbcpu *gbcpu, uint32_t addr)
+{
+	if (gbcpu->sync(gbcpu->sync_priv, addr, gbcpu->run_pending)) {
+		gbcpu->run_pending = 0;
+		gbcpu->run_stop = 1;
+	}
+}
 
-static inline regparm uint32_t mem_get(uint32_t addr)
+static inline regparm uint32_t mem_get(struct gbcpu *gbcpu, uint32_t addr)
 {
-	gbcpu_get_fn fn = getlookup[(addr >> 8) & 0xff];
-	gbcpu_cycles += 4;
-	return fn(addr);
+	uint32_t page = (addr >> 8) & 0xff;
+	const struct get_entry *e = &gbcpu->getlookup[page];
+	gbcpu->cycles += 4;
+	if (gbcpu->running && gbcpu->syncpage[page])
+		sync_access(gbcpu, addr);
+	if (e->mem != NULL)
+		return e->mem[addr & 0xff];
+	return e->get(e->priv, addr);
 }
 
-static inline regparm void mem_put(uint32_t addr, uint32_t val)
+static inline regparm void mem_put(struct gbcpu *gbcpu, uint32_t addr, uint32_t val)
 {
-	gbcpu_put_fn fn = putlookup[(addr >> 8) & 0xff];
-	gbcpu_cycles += 4;
-	fn(addr, val);
+	uint32_t page = (addr >> 8) & 0xff;
+	const struct put_entry *e = &gbcpu->putlookup[page];
+	gbcpu->cycles += 4;
+	if (gbcpu->running && gbcpu->syncpage[page])
+		sync_access(gbcpu, addr);
+	if (gbcpu->codepage[page] == GBCPU_CODE_RAM) {
+		gbcpu->codegen[page]++;
+		if ((gbcpu->cur_pc >> 8) == page)
+			gbcpu->cur_pc = GBCPU_NO_BLOCK;
+	}
+	if (e->mem != NULL)
+		e->mem[addr & 0xff] = val;
+	else
+		e->put(e->priv, addr, val);
 }
 
-regparm uint8_t gbcpu_mem_get(uint16_t addr)
+regparm uint8_t gbcpu_mem_get(struct gbcpu *gbcpu, uint16_t addr)
 {
-	return mem_get(addr);
+	return mem_get(gbcpu, addr);
 }
 
-regparm void gbcpu_mem_put(uint16_t addr, uint8_t val)
+regparm void gbcpu_mem_put(struct gbcpu *gbcpu, uint16_t addr, uint8_t val)
 {
-	mem_put(addr, val);
+	mem_put(gbcpu, addr, val);
 }
 
-static regparm void push(uint32_t val)
+static regparm void push(struct gbcpu *gbcpu, uint32_t val)
 {
-	uint32_t sp = REGS16_R(gbcpu_regs, SP) - 2;
-	REGS16_W(gbcpu_regs, SP, sp);
-	mem_put(sp, val & 0xff);
-	mem_put(sp+1, val >> 8);
+	uint32_t sp = REGS16_R(gbcpu->regs, SP) - 2;
+	REGS16_W(gbcpu->regs, SP, sp);
+	mem_put(gbcpu, sp, val & 0xff);
+	mem_put(gbcpu, sp+1, val >> 8);
 }
 
-static regparm uint32_t pop(void)
+static regparm uint32_t pop(struct gbcpu *gbcpu)
 {
 	uint32_t res;
-	uint32_t sp = REGS16_R(gbcpu_regs, SP);
+	uint32_t sp = REGS16_R(gbcpu->regs, SP);
 
-	res  = mem_get(sp);
-	res += mem_get(sp+1) << 8;
-	REGS16_W(gbcpu_regs, SP, sp + 2);
+	res  = mem_get(gbcpu, sp);
+	res += mem_get(gbcpu, sp+1) << 8;
+	REGS16_W(gbcpu->regs, SP, sp + 2);
 
 	return res;
 }
 
-static regparm uint32_t get_imm8(void)
+/*
+ * Fetch the next instruction byte.  For predecoded instructions the
+ * operand comes from the block cache and its cycles were already
+ * accounted for by gbcpu_step().
+ */
+static inline regparm uint32_t fetch8(struct gbcpu *gbcpu)
 {
-	uint32_t pc = REGS16_R(gbcpu_regs, PC);
-	uint32_t res;
-	REGS16_W(gbcpu_regs, PC, pc + 1);
-	res = mem_get(pc);
+	uint32_t pc = REGS16_R(gbcpu->regs, PC);
+	REGS16_W(gbcpu->regs, PC, pc + 1);
+	if (gbcpu->imm != NULL)
+		return *gbcpu->imm++;
+	return mem_get(gbcpu, pc);
+}
+
+static regparm uint32_t get_imm8(struct gbcpu *gbcpu)
+{
+	uint32_t res = fetch8(gbcpu);
 	DPRINTF("%02x", res);
 	return res;
 }
 
-static regparm uint32_t get_imm16(void)
+static regparm uint32_t get_imm16(struct gbcpu *gbcpu)
 {
-	uint32_t pc = REGS16_R(gbcpu_regs, PC);
-	uint32_t res;
-	REGS16_W(gbcpu_regs, PC, pc + 2);
-	res = mem_get(pc) + (mem_get(pc+1) << 8);
+	uint32_t res = fetch8(gbcpu);
+	res += fetch8(gbcpu) << 8;
 	DPRINTF("%04x", res);
 	return res;
 }
@@ -643,59 +159,59 @@ static inline void print_reg(long i)
 	else DPRINTF("%c", regnames[i]);
 }
 
-static regparm uint32_t get_reg(long i)
+static regparm uint32_t get_reg(struct gbcpu *gbcpu, long i)
 {
 	if (i == 6) /* indirect memory access by [HL] */
-		return mem_get(REGS16_R(gbcpu_regs, HL));
-	return REGS8_R(gbcpu_regs, i);
+		return mem_get(gbcpu, REGS16_R(gbcpu->regs, HL));
+	return REGS8_R(gbcpu->regs, i);
 }
 
-static regparm void put_reg(long i, uint32_t val)
+static regparm void put_reg(struct gbcpu *gbcpu, long i, uint32_t val)
 {
 	if (i == 6) /* indirect memory access by [HL] */
-		mem_put(REGS16_R(gbcpu_regs, HL), val);
-	else REGS8_W(gbcpu_regs, i, val);
+		mem_put(gbcpu, REGS16_R(gbcpu->regs, HL), val);
+	else REGS8_W(gbcpu->regs, i, val);
 }
 
-static regparm void op_unknown(uint32_t op, /*@unused@*/ const struct opinfo *oi)
+static regparm void op_unknown(struct gbcpu *gbcpu, uint32_t op, /*@unused@*/ const struct opinfo *oi)
 {
 	fprintf(stderr, "\n\nUnknown opcode %02x.\n", (unsigned char)op);
-	gbcpu_stopped = 1;
+	gbcpu->stopped = 1;
 }
 
-static regparm void op_set(uint32_t op)
+static regparm void op_set(struct gbcpu *gbcpu, uint32_t op)
 {
 	long reg = op & 7;
 	unsigned long bit = (op >> 3) & 7;
 
 	DPRINTF("\tSET %ld, ", bit);
 	print_reg(reg);
-	put_reg(reg, get_reg(reg) | (1 << bit));
+	put_reg(gbcpu, reg, get_reg(gbcpu, reg) | (1 << bit));
 }
 
-static regparm void op_res(uint32_t op)
+static regparm void op_res(struct gbcpu *gbcpu, uint32_t op)
 {
 	long reg = op & 7;
 	unsigned long bit = (op >> 3) & 7;
 
 	DPRINTF("\tRES %ld, ", bit);
 	print_reg(reg);
-	put_reg(reg, get_reg(reg) & ~(1 << bit));
+	put_reg(gbcpu, reg, get_reg(gbcpu, reg) & ~(1 << bit));
 }
 
-static regparm void op_bit(uint32_t op)
+static regparm void op_bit(struct gbcpu *gbcpu, uint32_t op)
 {
 	long reg = op & 7;
 	unsigned long bit = (op >> 3) & 7;
 
 	DPRINTF("\tBIT %ld, ", bit);
 	print_reg(reg);
-	gbcpu_regs.rn.f &= ~NF;
-	gbcpu_regs.rn.f |= HF | ZF;
-	gbcpu_regs.rn.f ^= ((get_reg(reg) << 8) >> (bit+1)) & ZF;
+	gbcpu->regs.rn.f &= ~NF;
+	gbcpu->regs.rn.f |= HF | ZF;
+	gbcpu->regs.rn.f ^= ((get_reg(gbcpu, reg) << 8) >> (bit+1)) & ZF;
 }
 
-static regparm void op_rl(uint32_t op, const struct opinfo *oi)
+static regparm void op_rl(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	/* C <- rrrrrrrr <-
 	 * |              |
@@ -706,15 +222,15 @@ static regparm void op_rl(uint32_t op, const struct opinfo *oi)
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res << 1;
-	res |= (gbcpu_regs.rn.f & CF) >> 4;
-	gbcpu_regs.rn.f = (val >> 7) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	res |= (gbcpu->regs.rn.f & CF) >> 4;
+	gbcpu->regs.rn.f = (val >> 7) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_rla(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_rla(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	/* C <- aaaaaaaa <-
 	 * |              |
@@ -723,14 +239,14 @@ static regparm void op_rla(/*@unused@*/ uint32_t op, const struct opinfo *oi)
 	uint8_t res;
 
 	DPRINTF(" \t%s", oi->name);
-	res  = gbcpu_regs.rn.a;
+	res  = gbcpu->regs.rn.a;
 	res  = res << 1;
-	res |= (gbcpu_regs.rn.f & CF) >> 4;
-	gbcpu_regs.rn.f = (gbcpu_regs.rn.a >> 7) << 4;
-	gbcpu_regs.rn.a = res;
+	res |= (gbcpu->regs.rn.f & CF) >> 4;
+	gbcpu->regs.rn.f = (gbcpu->regs.rn.a >> 7) << 4;
+	gbcpu->regs.rn.a = res;
 }
 
-static regparm void op_rlc(uint32_t op, const struct opinfo *oi)
+static regparm void op_rlc(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	/* C <- rrrrrrrr <-
 	 *    |           |
@@ -741,15 +257,15 @@ static regparm void op_rlc(uint32_t op, const struct opinfo *oi)
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res << 1;
 	res |= val >> 7;
-	gbcpu_regs.rn.f = (val >> 7) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = (val >> 7) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_rlca(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_rlca(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	/* C <- aaaaaaaa <-
 	 *    |           |
@@ -758,111 +274,111 @@ static regparm void op_rlca(/*@unused@*/ uint32_t op, const struct opinfo *oi)
 	uint8_t res;
 
 	DPRINTF(" \t%s", oi->name);
-	res  = gbcpu_regs.rn.a;
+	res  = gbcpu->regs.rn.a;
 	res  = res << 1;
-	res |= gbcpu_regs.rn.a >> 7;
-	gbcpu_regs.rn.f = (gbcpu_regs.rn.a >> 7) << 4;
-	gbcpu_regs.rn.a = res;
+	res |= gbcpu->regs.rn.a >> 7;
+	gbcpu->regs.rn.f = (gbcpu->regs.rn.a >> 7) << 4;
+	gbcpu->regs.rn.a = res;
 }
 
-static regparm void op_sla(uint32_t op, const struct opinfo *oi)
+static regparm void op_sla(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint8_t res, val;
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res << 1;
-	gbcpu_regs.rn.f = (val >> 7) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = (val >> 7) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_rr(uint32_t op, const struct opinfo *oi)
+static regparm void op_rr(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint8_t res, val;
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res >> 1;
-	res |= (gbcpu_regs.rn.f & CF) << 3;
-	gbcpu_regs.rn.f = (val & 1) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	res |= (gbcpu->regs.rn.f & CF) << 3;
+	gbcpu->regs.rn.f = (val & 1) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_rra(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_rra(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	uint8_t res;
 
 	DPRINTF(" \t%s", oi->name);
-	res  = gbcpu_regs.rn.a;
+	res  = gbcpu->regs.rn.a;
 	res  = res >> 1;
-	res |= (gbcpu_regs.rn.f & CF) << 3;
-	gbcpu_regs.rn.f = (gbcpu_regs.rn.a & 1) << 4;
-	gbcpu_regs.rn.a = res;
+	res |= (gbcpu->regs.rn.f & CF) << 3;
+	gbcpu->regs.rn.f = (gbcpu->regs.rn.a & 1) << 4;
+	gbcpu->regs.rn.a = res;
 }
 
-static regparm void op_rrc(uint32_t op, const struct opinfo *oi)
+static regparm void op_rrc(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint8_t res, val;
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res >> 1;
 	res |= val << 7;
-	gbcpu_regs.rn.f = (val & 1) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = (val & 1) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_rrca(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_rrca(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	uint8_t res;
 
 	DPRINTF(" \t%s", oi->name);
-	res  = gbcpu_regs.rn.a;
+	res  = gbcpu->regs.rn.a;
 	res  = res >> 1;
-	res |= gbcpu_regs.rn.a << 7;
-	gbcpu_regs.rn.f = (gbcpu_regs.rn.a & 1) << 4;
-	gbcpu_regs.rn.a = res;
+	res |= gbcpu->regs.rn.a << 7;
+	gbcpu->regs.rn.f = (gbcpu->regs.rn.a & 1) << 4;
+	gbcpu->regs.rn.a = res;
 }
 
-static regparm void op_sra(uint32_t op, const struct opinfo *oi)
+static regparm void op_sra(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint8_t res, val;
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res >> 1;
 	res |= val & 0x80;
-	gbcpu_regs.rn.f = (val & 1) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = (val & 1) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_srl(uint32_t op, const struct opinfo *oi)
+static regparm void op_srl(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint8_t res, val;
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	res  = val = get_reg(reg);
+	res  = val = get_reg(gbcpu, reg);
 	res  = res >> 1;
-	gbcpu_regs.rn.f = (val & 1) << 4;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = (val & 1) << 4;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
-static regparm void op_swap(uint32_t op, const struct opinfo *oi)
+static regparm void op_swap(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op & 7;
 	uint32_t res;
@@ -870,12 +386,12 @@ static regparm void op_swap(uint32_t op, const struct opinfo *oi)
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	val = get_reg(reg);
+	val = get_reg(gbcpu, reg);
 	res = (val >> 4) |
 	      (val << 4);
-	gbcpu_regs.rn.f = 0;
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	put_reg(reg, res);
+	gbcpu->regs.rn.f = 0;
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	put_reg(gbcpu, reg, res);
 }
 
 static const struct opinfo cbops[8] = {
@@ -889,24 +405,31 @@ static const struct opinfo cbops[8] = {
 	OPINFO("SRL",  &op_srl,  0, 0),		/* opcode cb38-cb3f */
 };
 
-static regparm void op_cbprefix(uint32_t op, /*@unused@*/ const struct opinfo *oi)
+static regparm void op_cbprefix(struct gbcpu *gbcpu, uint32_t op, /*@unused@*/ const struct opinfo *oi)
 {
-	uint16_t pc = REGS16_R(gbcpu_regs, PC);
-
-	REGS16_W(gbcpu_regs, PC, pc + 1);
-	op = mem_get(pc);
+	op = fetch8(gbcpu);
 	switch (op >> 6) {
-		case 0: cbops[(op >> 3) & 7].fn(op, &cbops[(op >> 3) & 7]);
-			return;
-		case 1: op_bit(op); return;
-		case 2: op_res(op); return;
-		case 3: op_set(op); return;
+		case 0: break;
+		case 1: op_bit(gbcpu, op); return;
+		case 2: op_res(gbcpu, op); return;
+		case 3: op_set(gbcpu, op); return;
+	}
+	/* direct calls so the threaded core can inline the handlers */
+	switch ((op >> 3) & 7) {
+		case 0: op_rlc(gbcpu, op, &cbops[0]); return;
+		case 1: op_rrc(gbcpu, op, &cbops[1]); return;
+		case 2: op_rl(gbcpu, op, &cbops[2]); return;
+		case 3: op_rr(gbcpu, op, &cbops[3]); return;
+		case 4: op_sla(gbcpu, op, &cbops[4]); return;
+		case 5: op_sra(gbcpu, op, &cbops[5]); return;
+		case 6: op_swap(gbcpu, op, &cbops[6]); return;
+		case 7: op_srl(gbcpu, op, &cbops[7]); return;
 	}
 	fprintf(stderr, "\n\nUnknown CB subopcode %02x.\n", (unsigned char)op);
-	gbcpu_stopped = 1;
+	gbcpu->stopped = 1;
 }
 
-static regparm void op_ld(uint32_t op, const struct opinfo *oi)
+static regparm void op_ld(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long src = op & 7;
 	long dst = (op >> 3) & 7;
@@ -915,71 +438,71 @@ static regparm void op_ld(uint32_t op, const struct opinfo *oi)
 	print_reg(dst);
 	DPRINTF(", ");
 	print_reg(src);
-	put_reg(dst, get_reg(src));
+	put_reg(gbcpu, dst, get_reg(gbcpu, src));
 }
 
-static regparm void op_ld_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	long ofs = get_imm16();
+	long ofs = get_imm16(gbcpu);
 
 	DPRINTF(" \t%s  A, [0x%04lx]", oi->name, ofs);
-	gbcpu_regs.rn.a = mem_get(ofs);
+	gbcpu->regs.rn.a = mem_get(gbcpu, ofs);
 }
 
-static regparm void op_ld_ind16_a(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_ind16_a(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	long ofs = get_imm16();
+	long ofs = get_imm16(gbcpu);
 
 	DPRINTF(" \t%s  [0x%04lx], A", oi->name, ofs);
-	mem_put(ofs, gbcpu_regs.rn.a);
+	mem_put(gbcpu, ofs, gbcpu->regs.rn.a);
 }
 
-static regparm void op_ld_ind16_sp(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_ind16_sp(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	long ofs = get_imm16();
-	long sp = REGS16_R(gbcpu_regs, SP);
+	long ofs = get_imm16(gbcpu);
+	long sp = REGS16_R(gbcpu->regs, SP);
 
 	DPRINTF(" \t%s  [0x%04lx], SP", oi->name, ofs);
-	mem_put(ofs, sp & 0xff);
-	mem_put(ofs+1, sp >> 8);
+	mem_put(gbcpu, ofs, sp & 0xff);
+	mem_put(gbcpu, ofs+1, sp >> 8);
 }
 
-static regparm void op_ld_hlsp(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_hlsp(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	int8_t ofs = get_imm8();
-	uint16_t old = REGS16_R(gbcpu_regs, SP);
+	int8_t ofs = get_imm8(gbcpu);
+	uint16_t old = REGS16_R(gbcpu->regs, SP);
 	uint16_t new = old + ofs;
 
 	if (ofs>0) DPRINTF(" \t%s  HL, SP+0x%02x", oi->name, ofs);
 	else DPRINTF(" \t%s  HL, SP-0x%02x", oi->name, -ofs);
-	REGS16_W(gbcpu_regs, HL, new);
-	gbcpu_regs.rn.f = 0;
+	REGS16_W(gbcpu->regs, HL, new);
+	gbcpu->regs.rn.f = 0;
 	/* flags are based on LOW-BYTE */
-	if ((old & 0xff) > (new & 0xff)) gbcpu_regs.rn.f |= CF;
-	if ((old & 0xf) > (new & 0xf)) gbcpu_regs.rn.f |= HF;
+	if ((old & 0xff) > (new & 0xff)) gbcpu->regs.rn.f |= CF;
+	if ((old & 0xf) > (new & 0xf)) gbcpu->regs.rn.f |= HF;
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_ld_sphl(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_sphl(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s  SP, HL", oi->name);
-	REGS16_W(gbcpu_regs, SP, REGS16_R(gbcpu_regs, HL));
+	REGS16_W(gbcpu->regs, SP, REGS16_R(gbcpu->regs, HL));
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_ld_reg16_imm(uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_reg16_imm(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	long val = get_imm16();
+	long val = get_imm16(gbcpu);
 	long reg = (op >> 4) & 3;
 
 	reg += reg > 2; /* skip over AF */
 	DPRINTF(" \t%s  %s, 0x%04lx", oi->name, regnamech16[reg], val);
-	REGS16_W(gbcpu_regs, reg, val);
+	REGS16_W(gbcpu->regs, reg, val);
 }
 
-static regparm void op_ld_reg16_a(uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_reg16_a(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 4) & 3;
 	uint16_t r;
@@ -987,54 +510,54 @@ static regparm void op_ld_reg16_a(uint32_t op, const struct opinfo *oi)
 	reg -= reg > 2; /* for HL LDD LDI opcodes */
 	if (op & 8) {
 		DPRINTF(" \t%s  A, [%s]", oi->name, regnamech16[reg]);
-		gbcpu_regs.rn.a = mem_get(r = REGS16_R(gbcpu_regs, reg));
+		gbcpu->regs.rn.a = mem_get(gbcpu, r = REGS16_R(gbcpu->regs, reg));
 	} else {
 		DPRINTF(" \t%s  [%s], A", oi->name, regnamech16[reg]);
-		mem_put(r = REGS16_R(gbcpu_regs, reg), gbcpu_regs.rn.a);
+		mem_put(gbcpu, r = REGS16_R(gbcpu->regs, reg), gbcpu->regs.rn.a);
 	}
 
 	if (reg == 2) {
 		r += (((op & 0x10) == 0) << 1)-1;
-		REGS16_W(gbcpu_regs, reg, r);
+		REGS16_W(gbcpu->regs, reg, r);
 	}
 }
 
-static regparm void op_ld_reg8_imm(uint32_t op, const struct opinfo *oi)
+static regparm void op_ld_reg8_imm(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	long val = get_imm8();
+	long val = get_imm8(gbcpu);
 	long reg = (op >> 3) & 7;
 
 	DPRINTF(" \t%s  ", oi->name);
 	print_reg(reg);
-	put_reg(reg, val);
+	put_reg(gbcpu, reg, val);
 	DPRINTF(", 0x%02lx", val);
 }
 
-static regparm void op_ldh(uint32_t op, const struct opinfo *oi)
+static regparm void op_ldh(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	long ofs = op & 2 ? 0 : get_imm8();
+	long ofs = op & 2 ? 0 : get_imm8(gbcpu);
 
 	if (op & 0x10) {
 		DPRINTF(" \t%s  A, ", oi->name);
 		if ((op & 2) == 0) {
 			DPRINTF("[%02lx]", ofs);
 		} else {
-			ofs = gbcpu_regs.rn.c;
+			ofs = gbcpu->regs.rn.c;
 			DPRINTF("[C]");
 		}
-		gbcpu_regs.rn.a = mem_get(0xff00 + ofs);
+		gbcpu->regs.rn.a = mem_get(gbcpu, 0xff00 + ofs);
 	} else {
 		if ((op & 2) == 0) {
 			DPRINTF(" \t%s  [%02lx], A", oi->name, ofs);
 		} else {
-			ofs = gbcpu_regs.rn.c;
+			ofs = gbcpu->regs.rn.c;
 			DPRINTF(" \t%s  [C], A", oi->name);
 		}
-		mem_put(0xff00 + ofs, gbcpu_regs.rn.a);
+		mem_put(gbcpu, 0xff00 + ofs, gbcpu->regs.rn.a);
 	}
 }
 
-static regparm void op_inc(uint32_t op, const struct opinfo *oi)
+static regparm void op_inc(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 3) & 7;
 	uint8_t res;
@@ -1042,29 +565,29 @@ static regparm void op_inc(uint32_t op, const struct opinfo *oi)
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	old = res = get_reg(reg);
+	old = res = get_reg(gbcpu, reg);
 	res++;
-	put_reg(reg, res);
-	gbcpu_regs.rn.f &= ~(NF | ZF | HF);
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	if ((old & 15) > (res & 15)) gbcpu_regs.rn.f |= HF;
+	put_reg(gbcpu, reg, res);
+	gbcpu->regs.rn.f &= ~(NF | ZF | HF);
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	if ((old & 15) > (res & 15)) gbcpu->regs.rn.f |= HF;
 }
 
-static regparm void op_inc16(uint32_t op, const struct opinfo *oi)
+static regparm void op_inc16(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 4) & 3;
 	uint16_t res;
 	reg += reg > 2; /* skip over AF */
-	res = REGS16_R(gbcpu_regs, reg);
+	res = REGS16_R(gbcpu->regs, reg);
 
 	DPRINTF(" \t%s %s\t", oi->name, regnamech16[reg]);
 	res++;
-	REGS16_W(gbcpu_regs, reg, res);
+	REGS16_W(gbcpu->regs, reg, res);
 	// 16bit ALU op takes 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_dec(uint32_t op, const struct opinfo *oi)
+static regparm void op_dec(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 3) & 7;
 	uint8_t res;
@@ -1072,513 +595,513 @@ static regparm void op_dec(uint32_t op, const struct opinfo *oi)
 
 	DPRINTF(" \t%s ", oi->name);
 	print_reg(reg);
-	old = res = get_reg(reg);
+	old = res = get_reg(gbcpu, reg);
 	res--;
-	put_reg(reg, res);
-	gbcpu_regs.rn.f |= NF;
-	gbcpu_regs.rn.f &= ~(ZF | HF);
-	if (res == 0) gbcpu_regs.rn.f |= ZF;
-	if ((old & 15) < (res & 15)) gbcpu_regs.rn.f |= HF;
+	put_reg(gbcpu, reg, res);
+	gbcpu->regs.rn.f |= NF;
+	gbcpu->regs.rn.f &= ~(ZF | HF);
+	if (res == 0) gbcpu->regs.rn.f |= ZF;
+	if ((old & 15) < (res & 15)) gbcpu->regs.rn.f |= HF;
 }
 
-static regparm void op_dec16(uint32_t op, const struct opinfo *oi)
+static regparm void op_dec16(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 4) & 3;
 	uint16_t res;
 	reg += reg > 2; /* skip over AF */
-	res = REGS16_R(gbcpu_regs, reg);
+	res = REGS16_R(gbcpu->regs, reg);
 
 	DPRINTF(" \t%s %s", oi->name, regnamech16[reg]);
 	res--;
-	REGS16_W(gbcpu_regs, reg, res);
+	REGS16_W(gbcpu->regs, reg, res);
 	// 16bit ALU op takes 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_add_sp_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_add_sp_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	int8_t imm = get_imm8();
-	uint16_t old = REGS16_R(gbcpu_regs, SP);
+	int8_t imm = get_imm8(gbcpu);
+	uint16_t old = REGS16_R(gbcpu->regs, SP);
 	uint16_t new = old;
 
 	DPRINTF(" \t%s SP, %02x", oi->name, imm);
 	new += imm;
-	REGS16_W(gbcpu_regs, SP, new);
-	gbcpu_regs.rn.f = 0;
+	REGS16_W(gbcpu->regs, SP, new);
+	gbcpu->regs.rn.f = 0;
 	/* flags are based on LOW-BYTE */
-	if ((old & 0xff) > (new & 0xff)) gbcpu_regs.rn.f |= CF;
-	if ((old & 0xf) > (new & 0xf)) gbcpu_regs.rn.f |= HF;
+	if ((old & 0xff) > (new & 0xff)) gbcpu->regs.rn.f |= CF;
+	if ((old & 0xf) > (new & 0xf)) gbcpu->regs.rn.f |= HF;
 	// 8 extra cycles.
-	gbcpu_cycles += 8;
+	gbcpu->cycles += 8;
 }
 
-static regparm void op_add(uint32_t op, const struct opinfo *oi)
+static regparm void op_add(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new;
 
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	gbcpu_regs.rn.a += get_reg(op & 7);
-	new = gbcpu_regs.rn.a;
-	gbcpu_regs.rn.f = 0;
-	if (old > new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) > (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a += get_reg(gbcpu, op & 7);
+	new = gbcpu->regs.rn.a;
+	gbcpu->regs.rn.f = 0;
+	if (old > new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) > (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_add_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_add_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t imm = get_imm8(gbcpu);
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new = old;
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
 	new += imm;
-	gbcpu_regs.rn.a = new;
-	gbcpu_regs.rn.f = 0;
-	if (old > new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) > (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a = new;
+	gbcpu->regs.rn.f = 0;
+	if (old > new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) > (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_add_hl(uint32_t op, const struct opinfo *oi)
+static regparm void op_add_hl(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = (op >> 4) & 3;
-	uint16_t old = REGS16_R(gbcpu_regs, HL);
+	uint16_t old = REGS16_R(gbcpu->regs, HL);
 	uint16_t new = old;
 
 	reg += reg > 2; /* skip over AF */
 	DPRINTF(" \t%s HL, %s", oi->name, regnamech16[reg]);
 
-	new += REGS16_R(gbcpu_regs, reg);
-	REGS16_W(gbcpu_regs, HL, new);
+	new += REGS16_R(gbcpu->regs, reg);
+	REGS16_W(gbcpu->regs, HL, new);
 
-	gbcpu_regs.rn.f &= ~(NF | CF | HF);
-	if (old > new) gbcpu_regs.rn.f |= CF;
-	if ((old & 0xfff) > (new & 0xfff)) gbcpu_regs.rn.f |= HF;
+	gbcpu->regs.rn.f &= ~(NF | CF | HF);
+	if (old > new) gbcpu->regs.rn.f |= CF;
+	if ((old & 0xfff) > (new & 0xfff)) gbcpu->regs.rn.f |= HF;
 
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_adc(uint32_t op, const struct opinfo *oi)
+static regparm void op_adc(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint8_t reg = get_reg(op & 7);
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t reg = get_reg(gbcpu, op & 7);
+	uint8_t old = gbcpu->regs.rn.a;
 	long new = old;
-	long c = (gbcpu_regs.rn.f & CF) > 0;
+	long c = (gbcpu->regs.rn.f & CF) > 0;
 
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
 	new += reg;
 	new += c;
-	gbcpu_regs.rn.f = 0;
-	gbcpu_regs.rn.a = new;
-	if (new > 0xff) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) + (reg & 15) + c > 15) gbcpu_regs.rn.f |= HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.f = 0;
+	gbcpu->regs.rn.a = new;
+	if (new > 0xff) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) + (reg & 15) + c > 15) gbcpu->regs.rn.f |= HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_adc_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_adc_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t imm = get_imm8(gbcpu);
+	uint8_t old = gbcpu->regs.rn.a;
 	long new = old;
-	long c = (gbcpu_regs.rn.f & CF) > 0;
+	long c = (gbcpu->regs.rn.f & CF) > 0;
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
 	new += imm;
 	new += c;
-	gbcpu_regs.rn.f = 0;
-	gbcpu_regs.rn.a = new;
-	if (new > 0xff) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) + (imm & 15) + c > 15) gbcpu_regs.rn.f |= HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.f = 0;
+	gbcpu->regs.rn.a = new;
+	if (new > 0xff) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) + (imm & 15) + c > 15) gbcpu->regs.rn.f |= HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_cp(uint32_t op, const struct opinfo *oi)
+static regparm void op_cp(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new = old;
 
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	new -= get_reg(op & 7);
-	gbcpu_regs.rn.f = NF;
-	if (old < new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) < (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	new -= get_reg(gbcpu, op & 7);
+	gbcpu->regs.rn.f = NF;
+	if (old < new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) < (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_cp_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_cp_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t imm = get_imm8(gbcpu);
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new = old;
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
 	new -= imm;
-	gbcpu_regs.rn.f = NF;
-	if (old < new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) < (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.f = NF;
+	if (old < new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) < (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_sub(uint32_t op, const struct opinfo *oi)
+static regparm void op_sub(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new;
 
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	gbcpu_regs.rn.a -= get_reg(op & 7);
-	new = gbcpu_regs.rn.a;
-	gbcpu_regs.rn.f = NF;
-	if (old < new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) < (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a -= get_reg(gbcpu, op & 7);
+	new = gbcpu->regs.rn.a;
+	gbcpu->regs.rn.f = NF;
+	if (old < new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) < (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_sub_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_sub_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t imm = get_imm8(gbcpu);
+	uint8_t old = gbcpu->regs.rn.a;
 	uint8_t new = old;
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
 	new -= imm;
-	gbcpu_regs.rn.a = new;
-	gbcpu_regs.rn.f = NF;
-	if (old < new) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) < (new & 15)) gbcpu_regs.rn.f |= HF;
-	if (new == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a = new;
+	gbcpu->regs.rn.f = NF;
+	if (old < new) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) < (new & 15)) gbcpu->regs.rn.f |= HF;
+	if (new == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_sbc(uint32_t op, const struct opinfo *oi)
+static regparm void op_sbc(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint8_t reg = get_reg(op & 7);
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t reg = get_reg(gbcpu, op & 7);
+	uint8_t old = gbcpu->regs.rn.a;
 	long new = old + 0x100;
-	long c = (gbcpu_regs.rn.f & CF) > 0;
+	long c = (gbcpu->regs.rn.f & CF) > 0;
 
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
 	new -= reg;
 	new -= c;
-	gbcpu_regs.rn.a = new;
-	gbcpu_regs.rn.f = NF;
-	if (new < 0x100) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) - (reg & 15) - c < 0) gbcpu_regs.rn.f |= HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a = new;
+	gbcpu->regs.rn.f = NF;
+	if (new < 0x100) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) - (reg & 15) - c < 0) gbcpu->regs.rn.f |= HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_sbc_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_sbc_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
-	uint8_t old = gbcpu_regs.rn.a;
+	uint8_t imm = get_imm8(gbcpu);
+	uint8_t old = gbcpu->regs.rn.a;
 	long new = old + 0x100;
-	long c = (gbcpu_regs.rn.f & CF) > 0;
+	long c = (gbcpu->regs.rn.f & CF) > 0;
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
 	new -= imm;
 	new -= c;
-	gbcpu_regs.rn.a = new;
-	gbcpu_regs.rn.f = NF;
-	if (new < 0x100) gbcpu_regs.rn.f |= CF;
-	if ((old & 15) - (imm & 15) - c < 0) gbcpu_regs.rn.f |= HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a = new;
+	gbcpu->regs.rn.f = NF;
+	if (new < 0x100) gbcpu->regs.rn.f |= CF;
+	if ((old & 15) - (imm & 15) - c < 0) gbcpu->regs.rn.f |= HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_and(uint32_t op, const struct opinfo *oi)
+static regparm void op_and(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	gbcpu_regs.rn.a &= get_reg(op & 7);
-	gbcpu_regs.rn.f = HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a &= get_reg(gbcpu, op & 7);
+	gbcpu->regs.rn.f = HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_and_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_and_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
+	uint8_t imm = get_imm8(gbcpu);
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
-	gbcpu_regs.rn.a &= imm;
-	gbcpu_regs.rn.f = HF;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a &= imm;
+	gbcpu->regs.rn.f = HF;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_or(uint32_t op, const struct opinfo *oi)
+static regparm void op_or(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	gbcpu_regs.rn.a |= get_reg(op & 7);
-	gbcpu_regs.rn.f = 0;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a |= get_reg(gbcpu, op & 7);
+	gbcpu->regs.rn.f = 0;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_or_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_or_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
+	uint8_t imm = get_imm8(gbcpu);
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
-	gbcpu_regs.rn.a |= imm;
-	gbcpu_regs.rn.f = 0;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a |= imm;
+	gbcpu->regs.rn.f = 0;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_xor(uint32_t op, const struct opinfo *oi)
+static regparm void op_xor(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s A, ", oi->name);
 	print_reg(op & 7);
-	gbcpu_regs.rn.a ^= get_reg(op & 7);
-	gbcpu_regs.rn.f = 0;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a ^= get_reg(gbcpu, op & 7);
+	gbcpu->regs.rn.f = 0;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_xor_imm(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_xor_imm(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint8_t imm = get_imm8();
+	uint8_t imm = get_imm8(gbcpu);
 
 	DPRINTF(" \t%s A, $0x%02x", oi->name, imm);
-	gbcpu_regs.rn.a ^= imm;
-	gbcpu_regs.rn.f = 0;
-	if (gbcpu_regs.rn.a == 0) gbcpu_regs.rn.f |= ZF;
+	gbcpu->regs.rn.a ^= imm;
+	gbcpu->regs.rn.f = 0;
+	if (gbcpu->regs.rn.a == 0) gbcpu->regs.rn.f |= ZF;
 }
 
-static regparm void op_push(uint32_t op, const struct opinfo *oi)
+static regparm void op_push(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op >> 4 & 3;
 
-	push(REGS16_R(gbcpu_regs, reg));
+	push(gbcpu, REGS16_R(gbcpu->regs, reg));
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 	DPRINTF(" \t%s %s\t", oi->name, regnamech16[reg]);
 }
 
-static regparm void op_push_af(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_push_af(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint16_t tmp = gbcpu_regs.rn.a << 8;
+	uint16_t tmp = gbcpu->regs.rn.a << 8;
 
-	tmp |= gbcpu_regs.rn.f;
-	push(tmp);
+	tmp |= gbcpu->regs.rn.f;
+	push(gbcpu, tmp);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 	DPRINTF(" \t%s %s\t", oi->name, regnamech16[op >> 4 & 3]);
 }
 
-static regparm void op_pop(uint32_t op, const struct opinfo *oi)
+static regparm void op_pop(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long reg = op >> 4 & 3;
 
-	REGS16_W(gbcpu_regs, reg, pop());
+	REGS16_W(gbcpu->regs, reg, pop(gbcpu));
 	DPRINTF(" \t%s %s\t", oi->name, regnamech16[reg]);
 }
 
-static regparm void op_pop_af(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_pop_af(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint16_t tmp = pop();
+	uint16_t tmp = pop(gbcpu);
 
-	gbcpu_regs.rn.f = tmp & 0xf0;
-	gbcpu_regs.rn.a = tmp >> 8;
+	gbcpu->regs.rn.f = tmp & 0xf0;
+	gbcpu->regs.rn.a = tmp >> 8;
 	DPRINTF(" \t%s %s\t", oi->name, regnamech16[op >> 4 & 3]);
 }
 
-static regparm void op_cpl(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_cpl(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s", oi->name);
-	gbcpu_regs.rn.a = ~gbcpu_regs.rn.a;
-	gbcpu_regs.rn.f |= NF | HF;
+	gbcpu->regs.rn.a = ~gbcpu->regs.rn.a;
+	gbcpu->regs.rn.f |= NF | HF;
 }
 
-static regparm void op_ccf(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ccf(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s", oi->name);
-	gbcpu_regs.rn.f ^= CF;
-	gbcpu_regs.rn.f &= ~(NF | HF);
+	gbcpu->regs.rn.f ^= CF;
+	gbcpu->regs.rn.f &= ~(NF | HF);
 }
 
-static regparm void op_scf(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_scf(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s", oi->name);
-	gbcpu_regs.rn.f |= CF;
-	gbcpu_regs.rn.f &= ~(NF | HF);
+	gbcpu->regs.rn.f |= CF;
+	gbcpu->regs.rn.f &= ~(NF | HF);
 }
 
-static regparm void op_call(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_call(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint16_t ofs = get_imm16();
+	uint16_t ofs = get_imm16(gbcpu);
 
 	DPRINTF(" \t%s 0x%04x", oi->name, ofs);
-	push(REGS16_R(gbcpu_regs, PC));
-	REGS16_W(gbcpu_regs, PC, ofs);
+	push(gbcpu, REGS16_R(gbcpu->regs, PC));
+	REGS16_W(gbcpu->regs, PC, ofs);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_call_cond(uint32_t op, const struct opinfo *oi)
+static regparm void op_call_cond(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint16_t ofs = get_imm16();
+	uint16_t ofs = get_imm16(gbcpu);
 	long cond = (op >> 3) & 3;
 
 	DPRINTF(" \t%s %s 0x%04x", oi->name, conds[cond], ofs);
 	switch (cond) {
-		case 0: if ((gbcpu_regs.rn.f & ZF) != 0) return; break;
-		case 1: if ((gbcpu_regs.rn.f & ZF) == 0) return; break;
-		case 2: if ((gbcpu_regs.rn.f & CF) != 0) return; break;
-		case 3: if ((gbcpu_regs.rn.f & CF) == 0) return; break;
+		case 0: if ((gbcpu->regs.rn.f & ZF) != 0) return; break;
+		case 1: if ((gbcpu->regs.rn.f & ZF) == 0) return; break;
+		case 2: if ((gbcpu->regs.rn.f & CF) != 0) return; break;
+		case 3: if ((gbcpu->regs.rn.f & CF) == 0) return; break;
 	}
 	// A taken call is 4 extra cycles.
-	gbcpu_cycles += 4;
-	push(REGS16_R(gbcpu_regs, PC));
-	REGS16_W(gbcpu_regs, PC, ofs);
+	gbcpu->cycles += 4;
+	push(gbcpu, REGS16_R(gbcpu->regs, PC));
+	REGS16_W(gbcpu->regs, PC, ofs);
 }
 
-static regparm void op_ret(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ret(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	REGS16_W(gbcpu_regs, PC, pop());
+	REGS16_W(gbcpu->regs, PC, pop(gbcpu));
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_reti(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_reti(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	gbcpu_if = 1;
-	REGS16_W(gbcpu_regs, PC, pop());
+	gbcpu->if_flag = 1;
+	REGS16_W(gbcpu->regs, PC, pop(gbcpu));
 	DPRINTF(" \t%s", oi->name);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_ret_cond(uint32_t op, const struct opinfo *oi)
+static regparm void op_ret_cond(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	long cond = (op >> 3) & 3;
 
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 	DPRINTF(" \t%s %s", oi->name, conds[cond]);
 	switch (cond) {
-		case 0: if ((gbcpu_regs.rn.f & ZF) != 0) return; break;
-		case 1: if ((gbcpu_regs.rn.f & ZF) == 0) return; break;
-		case 2: if ((gbcpu_regs.rn.f & CF) != 0) return; break;
-		case 3: if ((gbcpu_regs.rn.f & CF) == 0) return; break;
+		case 0: if ((gbcpu->regs.rn.f & ZF) != 0) return; break;
+		case 1: if ((gbcpu->regs.rn.f & ZF) == 0) return; break;
+		case 2: if ((gbcpu->regs.rn.f & CF) != 0) return; break;
+		case 3: if ((gbcpu->regs.rn.f & CF) == 0) return; break;
 	}
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
-	REGS16_W(gbcpu_regs, PC, pop());
+	gbcpu->cycles += 4;
+	REGS16_W(gbcpu->regs, PC, pop(gbcpu));
 }
 
-static regparm void op_halt(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_halt(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	gbcpu_halted = 1;
+	gbcpu->halted = 1;
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_stop(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_stop(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_di(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_di(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	gbcpu_if = 0;
+	gbcpu->if_flag = 0;
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_ei(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_ei(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	gbcpu_if = 1;
+	gbcpu->if_flag = 1;
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_jr(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_jr(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	int16_t ofs = (int8_t) get_imm8();
+	int16_t ofs = (int8_t) get_imm8(gbcpu);
 
-	if (ofs == -2 && gbcpu_if == 0) {
-		gbcpu_halted = 1;
+	if (ofs == -2 && gbcpu->if_flag == 0) {
+		gbcpu->halted = 1;
 	}
 
 	if (ofs < 0) DPRINTF(" \t%s $-0x%02x", oi->name, -ofs);
 	else DPRINTF(" \t%s $+0x%02x", oi->name, ofs);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
-	REGS16_W(gbcpu_regs, PC, REGS16_R(gbcpu_regs, PC) + ofs);
+	gbcpu->cycles += 4;
+	REGS16_W(gbcpu->regs, PC, REGS16_R(gbcpu->regs, PC) + ofs);
 }
 
-static regparm void op_jr_cond(uint32_t op, const struct opinfo *oi)
+static regparm void op_jr_cond(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	int16_t ofs = (int8_t) get_imm8();
+	int16_t ofs = (int8_t) get_imm8(gbcpu);
 	long cond = (op >> 3) & 3;
 
 	if (ofs < 0) DPRINTF(" \t%s %s $-0x%02x", oi->name, conds[cond], -ofs);
 	else DPRINTF(" \t%s %s $+0x%02x", oi->name, conds[cond], ofs);
 	switch (cond) {
-		case 0: if ((gbcpu_regs.rn.f & ZF) != 0) return; break;
-		case 1: if ((gbcpu_regs.rn.f & ZF) == 0) return; break;
-		case 2: if ((gbcpu_regs.rn.f & CF) != 0) return; break;
-		case 3: if ((gbcpu_regs.rn.f & CF) == 0) return; break;
+		case 0: if ((gbcpu->regs.rn.f & ZF) != 0) return; break;
+		case 1: if ((gbcpu->regs.rn.f & ZF) == 0) return; break;
+		case 2: if ((gbcpu->regs.rn.f & CF) != 0) return; break;
+		case 3: if ((gbcpu->regs.rn.f & CF) == 0) return; break;
 	}
 	// A taken jump is 4 extra cycles.
-	gbcpu_cycles += 4;
-	REGS16_W(gbcpu_regs, PC, REGS16_R(gbcpu_regs, PC) + ofs);
+	gbcpu->cycles += 4;
+	REGS16_W(gbcpu->regs, PC, REGS16_R(gbcpu->regs, PC) + ofs);
 }
 
-static regparm void op_jp(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_jp(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	uint16_t ofs = get_imm16();
+	uint16_t ofs = get_imm16(gbcpu);
 
 	DPRINTF(" \t%s 0x%04x", oi->name, ofs);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
-	REGS16_W(gbcpu_regs, PC, ofs);
+	gbcpu->cycles += 4;
+	REGS16_W(gbcpu->regs, PC, ofs);
 }
 
-static regparm void op_jp_hl(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_jp_hl(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s HL", oi->name);
-	REGS16_W(gbcpu_regs, PC, REGS16_R(gbcpu_regs, HL));
+	REGS16_W(gbcpu->regs, PC, REGS16_R(gbcpu->regs, HL));
 }
 
-static regparm void op_jp_cond(uint32_t op, const struct opinfo *oi)
+static regparm void op_jp_cond(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
-	uint16_t ofs = get_imm16();
+	uint16_t ofs = get_imm16(gbcpu);
 	long cond = (op >> 3) & 3;
 
 	DPRINTF(" \t%s %s 0x%04x", oi->name, conds[cond], ofs);
 	switch (cond) {
-		case 0: if ((gbcpu_regs.rn.f & ZF) != 0) return; break;
-		case 1: if ((gbcpu_regs.rn.f & ZF) == 0) return; break;
-		case 2: if ((gbcpu_regs.rn.f & CF) != 0) return; break;
-		case 3: if ((gbcpu_regs.rn.f & CF) == 0) return; break;
+		case 0: if ((gbcpu->regs.rn.f & ZF) != 0) return; break;
+		case 1: if ((gbcpu->regs.rn.f & ZF) == 0) return; break;
+		case 2: if ((gbcpu->regs.rn.f & CF) != 0) return; break;
+		case 3: if ((gbcpu->regs.rn.f & CF) == 0) return; break;
 	}
 	// A taken jump is 4 extra cycles.
-	gbcpu_cycles += 4;
-	REGS16_W(gbcpu_regs, PC, ofs);
+	gbcpu->cycles += 4;
+	REGS16_W(gbcpu->regs, PC, ofs);
 }
 
-static regparm void op_rst(uint32_t op, const struct opinfo *oi)
+static regparm void op_rst(struct gbcpu *gbcpu, uint32_t op, const struct opinfo *oi)
 {
 	int16_t ofs = op & 0x38;
 
 	DPRINTF(" \t%s 0x%02x", oi->name, ofs);
-	push(REGS16_R(gbcpu_regs, PC));
-	REGS16_W(gbcpu_regs, PC, ofs);
+	push(gbcpu, REGS16_R(gbcpu->regs, PC));
+	REGS16_W(gbcpu->regs, PC, ofs);
 	// 4 extra cycles.
-	gbcpu_cycles += 4;
+	gbcpu->cycles += 4;
 }
 
-static regparm void op_nop(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_nop(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
 	DPRINTF(" \t%s", oi->name);
 }
 
-static regparm void op_daa(/*@unused@*/ uint32_t op, const struct opinfo *oi)
+static regparm void op_daa(struct gbcpu *gbcpu, /*@unused@*/ uint32_t op, const struct opinfo *oi)
 {
-	long a = gbcpu_regs.rn.a;
-	long f = gbcpu_regs.rn.f;
+	long a = gbcpu->regs.rn.a;
+	long f = gbcpu->regs.rn.f;
 
 	if (f & NF) {
 		if (f & HF) {
@@ -1601,380 +1124,695 @@ static regparm void op_daa(/*@unused@*/ uint32_t op, const struct opinfo *oi)
 	if (a == 0)
 		f |= ZF;
 
-	gbcpu_regs.rn.a = (uint8_t)a;
-	gbcpu_regs.rn.f = (uint8_t)f;
+	gbcpu->regs.rn.a = (uint8_t)a;
+	gbcpu->regs.rn.f = (uint8_t)f;
 	DPRINTF(" \t%s", oi->name);
 }
 
+#define GBCPU_OPS(OP) \
+	OP(0x00, "NOP",  op_nop         , 1, 1)		/* opcode 00 */ \
+	OP(0x01, "LD",   op_ld_reg16_imm, 3, 3)		/* opcode 01 */ \
+	OP(0x02, "LD",   op_ld_reg16_a  , 2, 2)		/* opcode 02 */ \
+	OP(0x03, "INC",  op_inc16       , 2, 2)		/* opcode 03 */ \
+	OP(0x04, "INC",  op_inc         , 1, 1)		/* opcode 04 */ \
+	OP(0x05, "DEC",  op_dec         , 1, 1)		/* opcode 05 */ \
+	OP(0x06, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 06 */ \
+	OP(0x07, "RLCA", op_rlca        , 1, 1)		/* opcode 07 */ \
+	OP(0x08, "LD",   op_ld_ind16_sp , 5, 5)		/* opcode 08 */ \
+	OP(0x09, "ADD",  op_add_hl      , 2, 2)		/* opcode 09 */ \
+	OP(0x0a, "LD",   op_ld_reg16_a  , 2, 2)		/* opcode 0a */ \
+	OP(0x0b, "DEC",  op_dec16       , 2, 2)		/* opcode 0b */ \
+	OP(0x0c, "INC",  op_inc         , 1, 1)		/* opcode 0c */ \
+	OP(0x0d, "DEC",  op_dec         , 1, 1)		/* opcode 0d */ \
+	OP(0x0e, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 0e */ \
+	OP(0x0f, "RRCA", op_rrca        , 1, 1)		/* opcode 0f */ \
+	OP(0x10, "STOP", op_stop        , 0, 0)		/* opcode 10 */ \
+	OP(0x11, "LD",   op_ld_reg16_imm, 3, 3)		/* opcode 11 */ \
+	OP(0x12, "LD",   op_ld_reg16_a  , 2, 2)		/* opcode 12 */ \
+	OP(0x13, "INC",  op_inc16       , 2, 2)		/* opcode 13 */ \
+	OP(0x14, "INC",  op_inc         , 1, 1)		/* opcode 14 */ \
+	OP(0x15, "DEC",  op_dec         , 1, 1)		/* opcode 15 */ \
+	OP(0x16, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 16 */ \
+	OP(0x17, "RLA",  op_rla         , 1, 1)		/* opcode 17 */ \
+	OP(0x18, "JR",   op_jr          , 3, 3)		/* opcode 18 */ \
+	OP(0x19, "ADD",  op_add_hl      , 2, 2)		/* opcode 19 */ \
+	OP(0x1a, "LD",   op_ld_reg16_a  , 2, 2)		/* opcode 1a */ \
+	OP(0x1b, "DEC",  op_dec16       , 2, 2)		/* opcode 1b */ \
+	OP(0x1c, "INC",  op_inc         , 1, 1)		/* opcode 1c */ \
+	OP(0x1d, "DEC",  op_dec         , 1, 1)		/* opcode 1d */ \
+	OP(0x1e, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 1e */ \
+	OP(0x1f, "RRA",  op_rra         , 1, 1)		/* opcode 1f */ \
+	OP(0x20, "JR",   op_jr_cond     , 2, 3)		/* opcode 20 */ \
+	OP(0x21, "LD",   op_ld_reg16_imm, 3, 3)		/* opcode 21 */ \
+	OP(0x22, "LDI",  op_ld_reg16_a  , 2, 2)		/* opcode 22 */ \
+	OP(0x23, "INC",  op_inc16       , 2, 2)		/* opcode 23 */ \
+	OP(0x24, "INC",  op_inc         , 1, 1)		/* opcode 24 */ \
+	OP(0x25, "DEC",  op_dec         , 1, 1)		/* opcode 25 */ \
+	OP(0x26, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 26 */ \
+	OP(0x27, "DAA",  op_daa         , 1, 1)		/* opcode 27 */ \
+	OP(0x28, "JR",   op_jr_cond     , 2, 3)		/* opcode 28 */ \
+	OP(0x29, "ADD",  op_add_hl      , 2, 2)		/* opcode 29 */ \
+	OP(0x2a, "LDI",  op_ld_reg16_a  , 2, 2)		/* opcode 2a */ \
+	OP(0x2b, "DEC",  op_dec16       , 2, 2)		/* opcode 2b */ \
+	OP(0x2c, "INC",  op_inc         , 1, 1)		/* opcode 2c */ \
+	OP(0x2d, "DEC",  op_dec         , 1, 1)		/* opcode 2d */ \
+	OP(0x2e, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 2e */ \
+	OP(0x2f, "CPL",  op_cpl         , 1, 1)		/* opcode 2f */ \
+	OP(0x30, "JR",   op_jr_cond     , 2, 3)		/* opcode 30 */ \
+	OP(0x31, "LD",   op_ld_reg16_imm, 3, 3)		/* opcode 31 */ \
+	OP(0x32, "LDD",  op_ld_reg16_a  , 2, 2)		/* opcode 32 */ \
+	OP(0x33, "INC",  op_inc16       , 2, 2)		/* opcode 33 */ \
+	OP(0x34, "INC",  op_inc         , 3, 3)		/* opcode 34 */ \
+	OP(0x35, "DEC",  op_dec         , 3, 3)		/* opcode 35 */ \
+	OP(0x36, "LD",   op_ld_reg8_imm , 3, 3)		/* opcode 36 */ \
+	OP(0x37, "SCF",  op_scf         , 1, 1)		/* opcode 37 */ \
+	OP(0x38, "JR",   op_jr_cond     , 2, 3)		/* opcode 38 */ \
+	OP(0x39, "ADD",  op_add_hl      , 2, 2)		/* opcode 39 */ \
+	OP(0x3a, "LDD",  op_ld_reg16_a  , 2, 2)		/* opcode 3a */ \
+	OP(0x3b, "DEC",  op_dec16       , 2, 2)		/* opcode 3b */ \
+	OP(0x3c, "INC",  op_inc         , 1, 1)		/* opcode 3c */ \
+	OP(0x3d, "DEC",  op_dec         , 1, 1)		/* opcode 3d */ \
+	OP(0x3e, "LD",   op_ld_reg8_imm , 2, 2)		/* opcode 3e */ \
+	OP(0x3f, "CCF",  op_ccf         , 1, 1)		/* opcode 3f */ \
+	OP(0x40, "LD",   op_ld          , 1, 1)		/* opcode 40 */ \
+	OP(0x41, "LD",   op_ld          , 1, 1)		/* opcode 41 */ \
+	OP(0x42, "LD",   op_ld          , 1, 1)		/* opcode 42 */ \
+	OP(0x43, "LD",   op_ld          , 1, 1)		/* opcode 43 */ \
+	OP(0x44, "LD",   op_ld          , 1, 1)		/* opcode 44 */ \
+	OP(0x45, "LD",   op_ld          , 1, 1)		/* opcode 45 */ \
+	OP(0x46, "LD",   op_ld          , 2, 2)		/* opcode 46 */ \
+	OP(0x47, "LD",   op_ld          , 1, 1)		/* opcode 47 */ \
+	OP(0x48, "LD",   op_ld          , 1, 1)		/* opcode 48 */ \
+	OP(0x49, "LD",   op_ld          , 1, 1)		/* opcode 49 */ \
+	OP(0x4a, "LD",   op_ld          , 1, 1)		/* opcode 4a */ \
+	OP(0x4b, "LD",   op_ld          , 1, 1)		/* opcode 4b */ \
+	OP(0x4c, "LD",   op_ld          , 1, 1)		/* opcode 4c */ \
+	OP(0x4d, "LD",   op_ld          , 1, 1)		/* opcode 4d */ \
+	OP(0x4e, "LD",   op_ld          , 2, 2)		/* opcode 4e */ \
+	OP(0x4f, "LD",   op_ld          , 1, 1)		/* opcode 4f */ \
+	OP(0x50, "LD",   op_ld          , 1, 1)		/* opcode 50 */ \
+	OP(0x51, "LD",   op_ld          , 1, 1)		/* opcode 51 */ \
+	OP(0x52, "LD",   op_ld          , 1, 1)		/* opcode 52 */ \
+	OP(0x53, "LD",   op_ld          , 1, 1)		/* opcode 53 */ \
+	OP(0x54, "LD",   op_ld          , 1, 1)		/* opcode 54 */ \
+	OP(0x55, "LD",   op_ld          , 1, 1)		/* opcode 55 */ \
+	OP(0x56, "LD",   op_ld          , 2, 2)		/* opcode 56 */ \
+	OP(0x57, "LD",   op_ld          , 1, 1)		/* opcode 57 */ \
+	OP(0x58, "LD",   op_ld          , 1, 1)		/* opcode 58 */ \
+	OP(0x59, "LD",   op_ld          , 1, 1)		/* opcode 59 */ \
+	OP(0x5a, "LD",   op_ld          , 1, 1)		/* opcode 5a */ \
+	OP(0x5b, "LD",   op_ld          , 1, 1)		/* opcode 5b */ \
+	OP(0x5c, "LD",   op_ld          , 1, 1)		/* opcode 5c */ \
+	OP(0x5d, "LD",   op_ld          , 1, 1)		/* opcode 5d */ \
+	OP(0x5e, "LD",   op_ld          , 2, 2)		/* opcode 5e */ \
+	OP(0x5f, "LD",   op_ld          , 1, 1)		/* opcode 5f */ \
+	OP(0x60, "LD",   op_ld          , 1, 1)		/* opcode 60 */ \
+	OP(0x61, "LD",   op_ld          , 1, 1)		/* opcode 61 */ \
+	OP(0x62, "LD",   op_ld          , 1, 1)		/* opcode 62 */ \
+	OP(0x63, "LD",   op_ld          , 1, 1)		/* opcode 63 */ \
+	OP(0x64, "LD",   op_ld          , 1, 1)		/* opcode 64 */ \
+	OP(0x65, "LD",   op_ld          , 1, 1)		/* opcode 65 */ \
+	OP(0x66, "LD",   op_ld          , 2, 2)		/* opcode 66 */ \
+	OP(0x67, "LD",   op_ld          , 1, 1)		/* opcode 67 */ \
+	OP(0x68, "LD",   op_ld          , 1, 1)		/* opcode 68 */ \
+	OP(0x69, "LD",   op_ld          , 1, 1)		/* opcode 69 */ \
+	OP(0x6a, "LD",   op_ld          , 1, 1)		/* opcode 6a */ \
+	OP(0x6b, "LD",   op_ld          , 1, 1)		/* opcode 6b */ \
+	OP(0x6c, "LD",   op_ld          , 1, 1)		/* opcode 6c */ \
+	OP(0x6d, "LD",   op_ld          , 1, 1)		/* opcode 6d */ \
+	OP(0x6e, "LD",   op_ld          , 2, 2)		/* opcode 6e */ \
+	OP(0x6f, "LD",   op_ld          , 1, 1)		/* opcode 6f */ \
+	OP(0x70, "LD",   op_ld          , 2, 2)		/* opcode 70 */ \
+	OP(0x71, "LD",   op_ld          , 2, 2)		/* opcode 71 */ \
+	OP(0x72, "LD",   op_ld          , 2, 2)		/* opcode 72 */ \
+	OP(0x73, "LD",   op_ld          , 2, 2)		/* opcode 73 */ \
+	OP(0x74, "LD",   op_ld          , 2, 2)		/* opcode 74 */ \
+	OP(0x75, "LD",   op_ld          , 2, 2)		/* opcode 75 */ \
+	OP(0x76, "HALT", op_halt        , 0, 0)		/* opcode 76 */ \
+	OP(0x77, "LD",   op_ld          , 2, 2)		/* opcode 77 */ \
+	OP(0x78, "LD",   op_ld          , 1, 1)		/* opcode 78 */ \
+	OP(0x79, "LD",   op_ld          , 1, 1)		/* opcode 79 */ \
+	OP(0x7a, "LD",   op_ld          , 1, 1)		/* opcode 7a */ \
+	OP(0x7b, "LD",   op_ld          , 1, 1)		/* opcode 7b */ \
+	OP(0x7c, "LD",   op_ld          , 1, 1)		/* opcode 7c */ \
+	OP(0x7d, "LD",   op_ld          , 1, 1)		/* opcode 7d */ \
+	OP(0x7e, "LD",   op_ld          , 2, 2)		/* opcode 7e */ \
+	OP(0x7f, "LD",   op_ld          , 1, 1)		/* opcode 7f */ \
+	OP(0x80, "ADD",  op_add         , 1, 1)		/* opcode 80 */ \
+	OP(0x81, "ADD",  op_add         , 1, 1)		/* opcode 81 */ \
+	OP(0x82, "ADD",  op_add         , 1, 1)		/* opcode 82 */ \
+	OP(0x83, "ADD",  op_add         , 1, 1)		/* opcode 83 */ \
+	OP(0x84, "ADD",  op_add         , 1, 1)		/* opcode 84 */ \
+	OP(0x85, "ADD",  op_add         , 1, 1)		/* opcode 85 */ \
+	OP(0x86, "ADD",  op_add         , 2, 2)		/* opcode 86 */ \
+	OP(0x87, "ADD",  op_add         , 1, 1)		/* opcode 87 */ \
+	OP(0x88, "ADC",  op_adc         , 1, 1)		/* opcode 88 */ \
+	OP(0x89, "ADC",  op_adc         , 1, 1)		/* opcode 89 */ \
+	OP(0x8a, "ADC",  op_adc         , 1, 1)		/* opcode 8a */ \
+	OP(0x8b, "ADC",  op_adc         , 1, 1)		/* opcode 8b */ \
+	OP(0x8c, "ADC",  op_adc         , 1, 1)		/* opcode 8c */ \
+	OP(0x8d, "ADC",  op_adc         , 1, 1)		/* opcode 8d */ \
+	OP(0x8e, "ADC",  op_adc         , 2, 2)		/* opcode 8e */ \
+	OP(0x8f, "ADC",  op_adc         , 1, 1)		/* opcode 8f */ \
+	OP(0x90, "SUB",  op_sub         , 1, 1)		/* opcode 90 */ \
+	OP(0x91, "SUB",  op_sub         , 1, 1)		/* opcode 91 */ \
+	OP(0x92, "SUB",  op_sub         , 1, 1)		/* opcode 92 */ \
+	OP(0x93, "SUB",  op_sub         , 1, 1)		/* opcode 93 */ \
+	OP(0x94, "SUB",  op_sub         , 1, 1)		/* opcode 94 */ \
+	OP(0x95, "SUB",  op_sub         , 1, 1)		/* opcode 95 */ \
+	OP(0x96, "SUB",  op_sub         , 2, 2)		/* opcode 96 */ \
+	OP(0x97, "SUB",  op_sub         , 1, 1)		/* opcode 97 */ \
+	OP(0x98, "SBC",  op_sbc         , 1, 1)		/* opcode 98 */ \
+	OP(0x99, "SBC",  op_sbc         , 1, 1)		/* opcode 99 */ \
+	OP(0x9a, "SBC",  op_sbc         , 1, 1)		/* opcode 9a */ \
+	OP(0x9b, "SBC",  op_sbc         , 1, 1)		/* opcode 9b */ \
+	OP(0x9c, "SBC",  op_sbc         , 1, 1)		/* opcode 9c */ \
+	OP(0x9d, "SBC",  op_sbc         , 1, 1)		/* opcode 9d */ \
+	OP(0x9e, "SBC",  op_sbc         , 2, 2)		/* opcode 9e */ \
+	OP(0x9f, "SBC",  op_sbc         , 1, 1)		/* opcode 9f */ \
+	OP(0xa0, "AND",  op_and         , 1, 1)		/* opcode a0 */ \
+	OP(0xa1, "AND",  op_and         , 1, 1)		/* opcode a1 */ \
+	OP(0xa2, "AND",  op_and         , 1, 1)		/* opcode a2 */ \
+	OP(0xa3, "AND",  op_and         , 1, 1)		/* opcode a3 */ \
+	OP(0xa4, "AND",  op_and         , 1, 1)		/* opcode a4 */ \
+	OP(0xa5, "AND",  op_and         , 1, 1)		/* opcode a5 */ \
+	OP(0xa6, "AND",  op_and         , 2, 2)		/* opcode a6 */ \
+	OP(0xa7, "AND",  op_and         , 1, 1)		/* opcode a7 */ \
+	OP(0xa8, "XOR",  op_xor         , 1, 1)		/* opcode a8 */ \
+	OP(0xa9, "XOR",  op_xor         , 1, 1)		/* opcode a9 */ \
+	OP(0xaa, "XOR",  op_xor         , 1, 1)		/* opcode aa */ \
+	OP(0xab, "XOR",  op_xor         , 1, 1)		/* opcode ab */ \
+	OP(0xac, "XOR",  op_xor         , 1, 1)		/* opcode ac */ \
+	OP(0xad, "XOR",  op_xor         , 1, 1)		/* opcode ad */ \
+	OP(0xae, "XOR",  op_xor         , 2, 2)		/* opcode ae */ \
+	OP(0xaf, "XOR",  op_xor         , 1, 1)		/* opcode af */ \
+	OP(0xb0, "OR",   op_or          , 1, 1)		/* opcode b0 */ \
+	OP(0xb1, "OR",   op_or          , 1, 1)		/* opcode b1 */ \
+	OP(0xb2, "OR",   op_or          , 1, 1)		/* opcode b2 */ \
+	OP(0xb3, "OR",   op_or          , 1, 1)		/* opcode b3 */ \
+	OP(0xb4, "OR",   op_or          , 1, 1)		/* opcode b4 */ \
+	OP(0xb5, "OR",   op_or          , 1, 1)		/* opcode b5 */ \
+	OP(0xb6, "OR",   op_or          , 2, 2)		/* opcode b6 */ \
+	OP(0xb7, "OR",   op_or          , 1, 1)		/* opcode b7 */ \
+	OP(0xb8, "CP",   op_cp          , 1, 1)		/* opcode b8 */ \
+	OP(0xb9, "CP",   op_cp          , 1, 1)		/* opcode b9 */ \
+	OP(0xba, "CP",   op_cp          , 1, 1)		/* opcode ba */ \
+	OP(0xbb, "CP",   op_cp          , 1, 1)		/* opcode bb */ \
+	OP(0xbc, "CP",   op_cp          , 1, 1)		/* opcode bc */ \
+	OP(0xbd, "CP",   op_cp          , 1, 1)		/* opcode bd */ \
+	OP(0xbe, "CP",   op_cp          , 2, 2)		/* opcode be */ \
+	OP(0xbf, "CP",   op_cp          , 1, 1)		/* opcode bf */ \
+	OP(0xc0, "RET",  op_ret_cond    , 2, 5)		/* opcode c0 */ \
+	OP(0xc1, "POP",  op_pop         , 3, 3)		/* opcode c1 */ \
+	OP(0xc2, "JP",   op_jp_cond     , 3, 4)		/* opcode c2 */ \
+	OP(0xc3, "JP",   op_jp          , 4, 4)		/* opcode c3 */ \
+	OP(0xc4, "CALL", op_call_cond   , 3, 6)		/* opcode c4 */ \
+	OP(0xc5, "PUSH", op_push        , 4, 4)		/* opcode c5 */ \
+	OP(0xc6, "ADD",  op_add_imm     , 2, 2)		/* opcode c6 */ \
+	OP(0xc7, "RST",  op_rst         , 4, 4)		/* opcode c7 */ \
+	OP(0xc8, "RET",  op_ret_cond    , 2, 5)		/* opcode c8 */ \
+	OP(0xc9, "RET",  op_ret         , 4, 4)		/* opcode c9 */ \
+	OP(0xca, "JP",   op_jp_cond     , 3, 4)		/* opcode ca */ \
+	OP(0xcb, "CBPREFIX", op_cbprefix, 0, 0)		/* opcode cb */ \
+	OP(0xcc, "CALL", op_call_cond   , 3, 6)		/* opcode cc */ \
+	OP(0xcd, "CALL", op_call        , 6, 6)		/* opcode cd */ \
+	OP(0xce, "ADC",  op_adc_imm     , 2, 2)		/* opcode ce */ \
+	OP(0xcf, "RST",  op_rst         , 4, 4)		/* opcode cf */ \
+	OP(0xd0, "RET",  op_ret_cond    , 2, 5)		/* opcode d0 */ \
+	OP(0xd1, "POP",  op_pop         , 3, 3)		/* opcode d1 */ \
+	OP(0xd2, "JP",   op_jp_cond     , 3, 4)		/* opcode d2 */ \
+	OP(0xd3, "UNKN", op_unknown     , 0, 0)		/* opcode d3 */ \
+	OP(0xd4, "CALL", op_call_cond   , 3, 6)		/* opcode d4 */ \
+	OP(0xd5, "PUSH", op_push        , 4, 4)		/* opcode d5 */ \
+	OP(0xd6, "SUB",  op_sub_imm     , 2, 2)		/* opcode d6 */ \
+	OP(0xd7, "RST",  op_rst         , 4, 4)		/* opcode d7 */ \
+	OP(0xd8, "RET",  op_ret_cond    , 2, 5)		/* opcode d8 */ \
+	OP(0xd9, "RETI", op_reti        , 4, 4)		/* opcode d9 */ \
+	OP(0xda, "JP",   op_jp_cond     , 3, 4)		/* opcode da */ \
+	OP(0xdb, "UNKN", op_unknown     , 0, 0)		/* opcode db */ \
+	OP(0xdc, "CALL", op_call_cond   , 3, 6)		/* opcode dc */ \
+	OP(0xdd, "UNKN", op_unknown     , 0, 0)		/* opcode dd */ \
+	OP(0xde, "SBC",  op_sbc_imm     , 2, 2)		/* opcode de */ \
+	OP(0xdf, "RST",  op_rst         , 4, 4)		/* opcode df */ \
+	OP(0xe0, "LDH",  op_ldh         , 3, 3)		/* opcode e0 */ \
+	OP(0xe1, "POP",  op_pop         , 3, 3)		/* opcode e1 */ \
+	OP(0xe2, "LDH",  op_ldh         , 2, 2)		/* opcode e2 */ \
+	OP(0xe3, "UNKN", op_unknown     , 0, 0)		/* opcode e3 */ \
+	OP(0xe4, "UNKN", op_unknown     , 0, 0)		/* opcode e4 */ \
+	OP(0xe5, "PUSH", op_push        , 4, 4)		/* opcode e5 */ \
+	OP(0xe6, "AND",  op_and_imm     , 2, 2)		/* opcode e6 */ \
+	OP(0xe7, "RST",  op_rst         , 4, 4)		/* opcode e7 */ \
+	OP(0xe8, "ADD",  op_add_sp_imm  , 4, 4)		/* opcode e8 */ \
+	OP(0xe9, "JP",   op_jp_hl       , 1, 1)		/* opcode e9 */ \
+	OP(0xea, "LD",   op_ld_ind16_a  , 4, 4)		/* opcode ea */ \
+	OP(0xeb, "UNKN", op_unknown     , 0, 0)		/* opcode eb */ \
+	OP(0xec, "UNKN", op_unknown     , 0, 0)		/* opcode ec */ \
+	OP(0xed, "UNKN", op_unknown     , 0, 0)		/* opcode ed */ \
+	OP(0xee, "XOR",  op_xor_imm     , 2, 2)		/* opcode ee */ \
+	OP(0xef, "RST",  op_rst         , 4, 4)		/* opcode ef */ \
+	OP(0xf0, "LDH",  op_ldh         , 3, 3)		/* opcode f0 */ \
+	OP(0xf1, "POP",  op_pop_af      , 3, 3)		/* opcode f1 */ \
+	OP(0xf2, "LDH",  op_ldh         , 2, 2)		/* opcode f2 */ \
+	OP(0xf3, "DI",   op_di          , 1, 1)		/* opcode f3 */ \
+	OP(0xf4, "UNKN", op_unknown     , 0, 0)		/* opcode f4 */ \
+	OP(0xf5, "PUSH", op_push_af     , 4, 4)		/* opcode f5 */ \
+	OP(0xf6, "OR",   op_or_imm      , 2, 2)		/* opcode f6 */ \
+	OP(0xf7, "RST",  op_rst         , 4, 4)		/* opcode f7 */ \
+	OP(0xf8, "LD",   op_ld_hlsp     , 3, 3)		/* opcode f8 */ \
+	OP(0xf9, "LD",   op_ld_sphl     , 2, 2)		/* opcode f9 */ \
+	OP(0xfa, "LD",   op_ld_imm      , 4, 4)		/* opcode fa */ \
+	OP(0xfb, "EI",   op_ei          , 1, 1)		/* opcode fb */ \
+	OP(0xfc, "UNKN", op_unknown     , 0, 0)		/* opcode fc */ \
+	OP(0xfd, "UNKN", op_unknown     , 0, 0)		/* opcode fd */ \
+	OP(0xfe, "CP", op_cp_imm        , 2, 2)		/* opcode fe */ \
+	OP(0xff, "RST", op_rst          , 4, 4)		/* opcode ff */
+
 static const struct opinfo ops[256] = {
-	OPINFO("NOP",  &op_nop         , 1, 1),		/* opcode 00 */
-	OPINFO("LD",   &op_ld_reg16_imm, 3, 3),		/* opcode 01 */
-	OPINFO("LD",   &op_ld_reg16_a  , 2, 2),		/* opcode 02 */
-	OPINFO("INC",  &op_inc16       , 2, 2),		/* opcode 03 */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 04 */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 05 */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 06 */
-	OPINFO("RLCA", &op_rlca        , 1, 1),		/* opcode 07 */
-	OPINFO("LD",   &op_ld_ind16_sp , 5, 5),		/* opcode 08 */
-	OPINFO("ADD",  &op_add_hl      , 2, 2),		/* opcode 09 */
-	OPINFO("LD",   &op_ld_reg16_a  , 2, 2),		/* opcode 0a */
-	OPINFO("DEC",  &op_dec16       , 2, 2),		/* opcode 0b */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 0c */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 0d */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 0e */
-	OPINFO("RRCA", &op_rrca        , 1, 1),		/* opcode 0f */
-	OPINFO("STOP", &op_stop        , 0, 0),		/* opcode 10 */
-	OPINFO("LD",   &op_ld_reg16_imm, 3, 3),		/* opcode 11 */
-	OPINFO("LD",   &op_ld_reg16_a  , 2, 2),		/* opcode 12 */
-	OPINFO("INC",  &op_inc16       , 2, 2),		/* opcode 13 */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 14 */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 15 */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 16 */
-	OPINFO("RLA",  &op_rla         , 1, 1),		/* opcode 17 */
-	OPINFO("JR",   &op_jr          , 3, 3),		/* opcode 18 */
-	OPINFO("ADD",  &op_add_hl      , 2, 2),		/* opcode 19 */
-	OPINFO("LD",   &op_ld_reg16_a  , 2, 2),		/* opcode 1a */
-	OPINFO("DEC",  &op_dec16       , 2, 2),		/* opcode 1b */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 1c */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 1d */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 1e */
-	OPINFO("RRA",  &op_rra         , 1, 1),		/* opcode 1f */
-	OPINFO("JR",   &op_jr_cond     , 2, 3),		/* opcode 20 */
-	OPINFO("LD",   &op_ld_reg16_imm, 3, 3),		/* opcode 21 */
-	OPINFO("LDI",  &op_ld_reg16_a  , 2, 2),		/* opcode 22 */
-	OPINFO("INC",  &op_inc16       , 2, 2),		/* opcode 23 */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 24 */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 25 */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 26 */
-	OPINFO("DAA",  &op_daa         , 1, 1),		/* opcode 27 */
-	OPINFO("JR",   &op_jr_cond     , 2, 3),		/* opcode 28 */
-	OPINFO("ADD",  &op_add_hl      , 2, 2),		/* opcode 29 */
-	OPINFO("LDI",  &op_ld_reg16_a  , 2, 2),		/* opcode 2a */
-	OPINFO("DEC",  &op_dec16       , 2, 2),		/* opcode 2b */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 2c */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 2d */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 2e */
-	OPINFO("CPL",  &op_cpl         , 1, 1),		/* opcode 2f */
-	OPINFO("JR",   &op_jr_cond     , 2, 3),		/* opcode 30 */
-	OPINFO("LD",   &op_ld_reg16_imm, 3, 3),		/* opcode 31 */
-	OPINFO("LDD",  &op_ld_reg16_a  , 2, 2),		/* opcode 32 */
-	OPINFO("INC",  &op_inc16       , 2, 2),		/* opcode 33 */
-	OPINFO("INC",  &op_inc         , 3, 3),		/* opcode 34 */
-	OPINFO("DEC",  &op_dec         , 3, 3),		/* opcode 35 */
-	OPINFO("LD",   &op_ld_reg8_imm , 3, 3),		/* opcode 36 */
-	OPINFO("SCF",  &op_scf         , 1, 1),		/* opcode 37 */
-	OPINFO("JR",   &op_jr_cond     , 2, 3),		/* opcode 38 */
-	OPINFO("ADD",  &op_add_hl      , 2, 2),		/* opcode 39 */
-	OPINFO("LDD",  &op_ld_reg16_a  , 2, 2),		/* opcode 3a */
-	OPINFO("DEC",  &op_dec16       , 2, 2),		/* opcode 3b */
-	OPINFO("INC",  &op_inc         , 1, 1),		/* opcode 3c */
-	OPINFO("DEC",  &op_dec         , 1, 1),		/* opcode 3d */
-	OPINFO("LD",   &op_ld_reg8_imm , 2, 2),		/* opcode 3e */
-	OPINFO("CCF",  &op_ccf         , 1, 1),		/* opcode 3f */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 40 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 41 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 42 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 43 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 44 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 45 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 46 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 47 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 48 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 49 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 4a */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 4b */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 4c */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 4d */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 4e */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 4f */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 50 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 51 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 52 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 53 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 54 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 55 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 56 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 57 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 58 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 59 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 5a */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 5b */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 5c */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 5d */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 5e */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 5f */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 60 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 61 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 62 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 63 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 64 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 65 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 66 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 67 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 68 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 69 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 6a */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 6b */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 6c */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 6d */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 6e */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 6f */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 70 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 71 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 72 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 73 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 74 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 75 */
-	OPINFO("HALT", &op_halt        , 0, 0),		/* opcode 76 */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 77 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 78 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 79 */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 7a */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 7b */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 7c */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 7d */
-	OPINFO("LD",   &op_ld          , 2, 2),		/* opcode 7e */
-	OPINFO("LD",   &op_ld          , 1, 1),		/* opcode 7f */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 80 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 81 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 82 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 83 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 84 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 85 */
-	OPINFO("ADD",  &op_add         , 2, 2),		/* opcode 86 */
-	OPINFO("ADD",  &op_add         , 1, 1),		/* opcode 87 */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 88 */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 89 */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 8a */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 8b */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 8c */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 8d */
-	OPINFO("ADC",  &op_adc         , 2, 2),		/* opcode 8e */
-	OPINFO("ADC",  &op_adc         , 1, 1),		/* opcode 8f */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 90 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 91 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 92 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 93 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 94 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 95 */
-	OPINFO("SUB",  &op_sub         , 2, 2),		/* opcode 96 */
-	OPINFO("SUB",  &op_sub         , 1, 1),		/* opcode 97 */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 98 */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 99 */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 9a */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 9b */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 9c */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 9d */
-	OPINFO("SBC",  &op_sbc         , 2, 2),		/* opcode 9e */
-	OPINFO("SBC",  &op_sbc         , 1, 1),		/* opcode 9f */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a0 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a1 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a2 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a3 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a4 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a5 */
-	OPINFO("AND",  &op_and         , 2, 2),		/* opcode a6 */
-	OPINFO("AND",  &op_and         , 1, 1),		/* opcode a7 */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode a8 */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode a9 */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode aa */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode ab */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode ac */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode ad */
-	OPINFO("XOR",  &op_xor         , 2, 2),		/* opcode ae */
-	OPINFO("XOR",  &op_xor         , 1, 1),		/* opcode af */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b0 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b1 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b2 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b3 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b4 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b5 */
-	OPINFO("OR",   &op_or          , 2, 2),		/* opcode b6 */
-	OPINFO("OR",   &op_or          , 1, 1),		/* opcode b7 */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode b8 */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode b9 */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode ba */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode bb */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode bc */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode bd */
-	OPINFO("CP",   &op_cp          , 2, 2),		/* opcode be */
-	OPINFO("CP",   &op_cp          , 1, 1),		/* opcode bf */
-	OPINFO("RET",  &op_ret_cond    , 2, 5),		/* opcode c0 */
-	OPINFO("POP",  &op_pop         , 3, 3),		/* opcode c1 */
-	OPINFO("JP",   &op_jp_cond     , 3, 4),		/* opcode c2 */
-	OPINFO("JP",   &op_jp          , 4, 4),		/* opcode c3 */
-	OPINFO("CALL", &op_call_cond   , 3, 6),		/* opcode c4 */
-	OPINFO("PUSH", &op_push        , 4, 4),		/* opcode c5 */
-	OPINFO("ADD",  &op_add_imm     , 2, 2),		/* opcode c6 */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode c7 */
-	OPINFO("RET",  &op_ret_cond    , 2, 5),		/* opcode c8 */
-	OPINFO("RET",  &op_ret         , 4, 4),		/* opcode c9 */
-	OPINFO("JP",   &op_jp_cond     , 3, 4),		/* opcode ca */
-	OPINFO("CBPREFIX", &op_cbprefix, 0, 0),		/* opcode cb */
-	OPINFO("CALL", &op_call_cond   , 3, 6),		/* opcode cc */
-	OPINFO("CALL", &op_call        , 6, 6),		/* opcode cd */
-	OPINFO("ADC",  &op_adc_imm     , 2, 2),		/* opcode ce */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode cf */
-	OPINFO("RET",  &op_ret_cond    , 2, 5),		/* opcode d0 */
-	OPINFO("POP",  &op_pop         , 3, 3),		/* opcode d1 */
-	OPINFO("JP",   &op_jp_cond     , 3, 4),		/* opcode d2 */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode d3 */
-	OPINFO("CALL", &op_call_cond   , 3, 6),		/* opcode d4 */
-	OPINFO("PUSH", &op_push        , 4, 4),		/* opcode d5 */
-	OPINFO("SUB",  &op_sub_imm     , 2, 2),		/* opcode d6 */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode d7 */
-	OPINFO("RET",  &op_ret_cond    , 2, 5),		/* opcode d8 */
-	OPINFO("RETI", &op_reti        , 4, 4),		/* opcode d9 */
-	OPINFO("JP",   &op_jp_cond     , 3, 4),		/* opcode da */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode db */
-	OPINFO("CALL", &op_call_cond   , 3, 6),		/* opcode dc */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode dd */
-	OPINFO("SBC",  &op_sbc_imm     , 2, 2),		/* opcode de */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode df */
-	OPINFO("LDH",  &op_ldh         , 3, 3),		/* opcode e0 */
-	OPINFO("POP",  &op_pop         , 3, 3),		/* opcode e1 */
-	OPINFO("LDH",  &op_ldh         , 2, 2),		/* opcode e2 */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode e3 */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode e4 */
-	OPINFO("PUSH", &op_push        , 4, 4),		/* opcode e5 */
-	OPINFO("AND",  &op_and_imm     , 2, 2),		/* opcode e6 */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode e7 */
-	OPINFO("ADD",  &op_add_sp_imm  , 4, 4),		/* opcode e8 */
-	OPINFO("JP",   &op_jp_hl       , 1, 1),		/* opcode e9 */
-	OPINFO("LD",   &op_ld_ind16_a  , 4, 4),		/* opcode ea */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode eb */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode ec */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode ed */
-	OPINFO("XOR",  &op_xor_imm     , 2, 2),		/* opcode ee */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode ef */
-	OPINFO("LDH",  &op_ldh         , 3, 3),		/* opcode f0 */
-	OPINFO("POP",  &op_pop_af      , 3, 3),		/* opcode f1 */
-	OPINFO("LDH",  &op_ldh         , 2, 2),		/* opcode f2 */
-	OPINFO("DI",   &op_di          , 1, 1),		/* opcode f3 */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode f4 */
-	OPINFO("PUSH", &op_push_af     , 4, 4),		/* opcode f5 */
-	OPINFO("OR",   &op_or_imm      , 2, 2),		/* opcode f6 */
-	OPINFO("RST",  &op_rst         , 4, 4),		/* opcode f7 */
-	OPINFO("LD",   &op_ld_hlsp     , 3, 3),		/* opcode f8 */
-	OPINFO("LD",   &op_ld_sphl     , 2, 2),		/* opcode f9 */
-	OPINFO("LD",   &op_ld_imm      , 4, 4),		/* opcode fa */
-	OPINFO("EI",   &op_ei          , 1, 1),		/* opcode fb */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode fc */
-	OPINFO("UNKN", &op_unknown     , 0, 0),		/* opcode fd */
-	OPINFO("CP", &op_cp_imm        , 2, 2),		/* opcode fe */
-	OPINFO("RST", &op_rst          , 4, 4),		/* opcode ff */
+#define OPS_ENTRY(opc, name, fn, c1, c2) OPINFO(name, &fn, c1, c2),
+	GBCPU_OPS(OPS_ENTRY)
+#undef OPS_ENTRY
 };
 
 #if DEBUG == 1
 static gbcpu_regs_u oldregs;
 
-static regparm void dump_regs(void)
+static regparm void dump_regs(struct gbcpu *gbcpu)
 {
 	long i;
 
 	DPRINTF("; ");
 	for (i=0; i<8; i++) {
-		DPRINTF("%c=%02x ", regnames[i], REGS8_R(gbcpu_regs, i));
+		DPRINTF("%c=%02x ", regnames[i], REGS8_R(gbcpu->regs, i));
 	}
 	for (i=5; i<6; i++) {
-		DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu_regs, i));
+		DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu->regs, i));
 	}
 	DPRINTF("\n");
-	oldregs = gbcpu_regs;
+	oldregs = gbcpu->regs;
 }
 
-static regparm void show_reg_diffs(const struct opinfo *oi)
+static regparm void show_reg_diffs(struct gbcpu *gbcpu, const struct opinfo *oi)
 {
 	long i;
 
 	DPRINTF("\t\t; ");
 	for (i=0; i<3; i++) {
-		if (REGS16_R(gbcpu_regs, i) != REGS16_R(oldregs, i)) {
-			DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu_regs, i));
-			REGS16_W(oldregs, i, REGS16_R(gbcpu_regs, i));
+		if (REGS16_R(gbcpu->regs, i) != REGS16_R(oldregs, i)) {
+			DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu->regs, i));
+			REGS16_W(oldregs, i, REGS16_R(gbcpu->regs, i));
 		}
 	}
 	for (i=6; i<8; i++) {
-		if (REGS8_R(gbcpu_regs, i) != REGS8_R(oldregs, i)) {
+		if (REGS8_R(gbcpu->regs, i) != REGS8_R(oldregs, i)) {
 			if (i == 6) { /* Flags */
-				if (gbcpu_regs.rn.f & ZF) DPRINTF("Z");
+				if (gbcpu->regs.rn.f & ZF) DPRINTF("Z");
 				else DPRINTF("z");
-				if (gbcpu_regs.rn.f & NF) DPRINTF("N");
+				if (gbcpu->regs.rn.f & NF) DPRINTF("N");
 				else DPRINTF("n");
-				if (gbcpu_regs.rn.f & HF) DPRINTF("H");
+				if (gbcpu->regs.rn.f & HF) DPRINTF("H");
 				else DPRINTF("h");
-				if (gbcpu_regs.rn.f & CF) DPRINTF("C");
+				if (gbcpu->regs.rn.f & CF) DPRINTF("C");
 				else DPRINTF("c");
 				DPRINTF(" ");
 			} else {
-				DPRINTF("%c=%02x ", regnames[i], REGS8_R(gbcpu_regs,i));
+				DPRINTF("%c=%02x ", regnames[i], REGS8_R(gbcpu->regs,i));
 			}
-			REGS8_W(oldregs, i, REGS8_R(gbcpu_regs, i));
+			REGS8_W(oldregs, i, REGS8_R(gbcpu->regs, i));
 		}
 	}
 	for (i=4; i<5; i++) {
-		if (REGS16_R(gbcpu_regs, i) != REGS16_R(oldregs, i)) {
-			DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu_regs, i));
-			REGS16_W(oldregs, i, REGS16_R(gbcpu_regs, i));
+		if (REGS16_R(gbcpu->regs, i) != REGS16_R(oldregs, i)) {
+			DPRINTF("%s=%04x ", regnamech16[i], REGS16_R(gbcpu->regs, i));
+			REGS16_W(oldregs, i, REGS16_R(gbcpu->regs, i));
 		}
 	}
-	DPRINTF(" %ld cycles", gbcpu_cycles);
-	if (!CYCLES_OK(oi, gbcpu_cycles/4)) {
+	DPRINTF(" %ld cycles", gbcpu->cycles);
+	if (!CYCLES_OK(oi, gbcpu->cycles/4)) {
 		DPRINTF(", but should be %d or %d!\n", 4*CYCLES1(oi), 4*CYCLES2(oi));
 	}
 	DPRINTF("\n");
 }
 #endif
 
-regparm void gbcpu_addmem(uint32_t start, uint32_t end, gbcpu_put_fn putfn, gbcpu_get_fn getfn)
+/* Instruction length in bytes, including the CB prefix. */
+static const uint8_t oplen[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,	/* 00-0f */
+	1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,	/* 10-1f */
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,	/* 20-2f */
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,	/* 30-3f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 40-4f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 50-5f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 60-6f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 70-7f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 80-8f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 90-9f */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* a0-af */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* b0-bf */
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,	/* c0-cf */
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,	/* d0-df */
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* e0-ef */
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* f0-ff */
+};
+
+/*
+ * Conditional branches do not end a block: when not taken, execution
+ * simply continues with the next predecoded instruction.
+ */
+static regparm long ends_block(uint8_t op)
+{
+	ex_fn fn = ops[op].fn;
+
+	return fn == op_jr ||
+	       fn == op_jp || fn == op_jp_hl ||
+	       fn == op_call ||
+	       fn == op_ret || fn == op_reti ||
+	       fn == op_rst || fn == op_halt || fn == op_stop ||
+	       fn == op_unknown;
+}
+
+static inline regparm uint32_t code_peek(struct gbcpu *gbcpu, uint32_t addr)
+{
+	const struct get_entry *e = &gbcpu->getlookup[(addr >> 8) & 0xff];
+	if (e->mem != NULL)
+		return e->mem[addr & 0xff];
+	return e->get(e->priv, addr);
+}
+
+regparm uint8_t gbcpu_peek(struct gbcpu *gbcpu, uint16_t addr)
+{
+	return code_peek(gbcpu, addr);
+}
+
+static regparm void decode_block(struct gbcpu *gbcpu, struct gbcpu_block *b, uint32_t key, uint32_t pc)
+{
+	uint32_t end = (pc | 0xff) + 1;
+
+	b->key = key;
+	b->gen = gbcpu->codegen[pc >> 8];
+	b->n = 0;
+	while (b->n < GBCPU_BLOCK_INSNS) {
+		struct gbcpu_insn *insn = &b->insn[b->n];
+		uint8_t op = code_peek(gbcpu, pc);
+		long len = oplen[op];
+
+		if (pc + len > end)
+			break;
+		insn->op = op;
+		insn->len = len;
+		insn->imm[0] = len > 1 ? code_peek(gbcpu, pc + 1) : 0;
+		insn->imm[1] = len > 2 ? code_peek(gbcpu, pc + 2) : 0;
+		b->n++;
+		pc += len;
+		if (ends_block(op))
+			break;
+	}
+}
+
+/*
+ * Return the predecoded instruction at pc, or NULL if the page
+ * is not cacheable.
+ */
+static NOINLINE regparm const struct gbcpu_insn *find_insn(struct gbcpu *gbcpu, uint32_t pc)
+{
+	uint32_t page = pc >> 8;
+	long type = gbcpu->codepage[page];
+	struct gbcpu_block *b;
+	uint32_t key = pc;
+	long i;
+
+	if (type == GBCPU_CODE_NONE)
+		return NULL;
+	if (type == GBCPU_CODE_BANKED)
+		key |= gbcpu->codebank << 16;
+
+	i = (pc ^ (pc >> 9) ^ (key >> 11)) & (GBCPU_BLOCKS - 1);
+	b = &gbcpu->blocks[i];
+	if (b->key != key || b->gen != gbcpu->codegen[page])
+		decode_block(gbcpu, b, key, pc);
+	if (b->n == 0) {
+		gbcpu->cur_pc = GBCPU_NO_BLOCK;
+		return NULL;
+	}
+	gbcpu->cur_block = i;
+	gbcpu->cur_insn = 0;
+	gbcpu->cur_pc = pc;
+	return &b->insn[0];
+}
+
+regparm void gbcpu_setcodebank(struct gbcpu *gbcpu, long bank)
+{
+	gbcpu->codebank = bank;
+	gbcpu->cur_pc = GBCPU_NO_BLOCK;
+}
+
+regparm void gbcpu_addcode(struct gbcpu *gbcpu, uint32_t start, uint32_t end, long type)
 {
 	uint32_t i;
 
 	for (i=start; i<=end; i++) {
-		putlookup[i] = putfn;
-		getlookup[i] = getfn;
+		gbcpu->codepage[i] = type;
 	}
+	gbcpu_flush_code(gbcpu);
 }
 
-regparm void gbcpu_init(void)
+regparm void gbcpu_flush_code(struct gbcpu *gbcpu)
 {
-	memset(&gbcpu_regs, 0, sizeof(gbcpu_regs));
-	gbcpu_halted = 0;
-	gbcpu_stopped = 0;
-	gbcpu_if = 0;
-	gbcpu_halt_at_pc = -1;
-	DEB(dump_regs());
+	long i;
+
+	for (i=0; i<GBCPU_BLOCKS; i++) {
+		gbcpu->blocks[i].key = GBCPU_NO_BLOCK;
+	}
+	gbcpu->cur_pc = GBCPU_NO_BLOCK;
 }
 
-regparm void gbcpu_intr(long vec)
+regparm void gbcpu_addsync(struct gbcpu *gbcpu, uint32_t start, uint32_t end, gbcpu_sync_fn fn, void *priv)
 {
-	DPRINTF("gbcpu_intr(%04lx)\n", vec);
-	gbcpu_halted = 0;
-	gbcpu_if = 0;
-	push(REGS16_R(gbcpu_regs, PC));
-	REGS16_W(gbcpu_regs, PC, vec);
+	uint32_t i;
+
+	for (i=start; i<=end; i++) {
+		gbcpu->syncpage[i] = 1;
+	}
+	gbcpu->sync = fn;
+	gbcpu->sync_priv = priv;
 }
 
-regparm long gbcpu_step(void)
+regparm void gbcpu_addmem(struct gbcpu *gbcpu, uint32_t start, uint32_t end, gbcpu_put_fn putfn, gbcpu_get_fn getfn, void *priv)
 {
-	uint8_t op;
+	uint32_t i;
+
+	if (putfn == NULL)
+		putfn = none_put;
+	if (getfn == NULL)
+		getfn = none_get;
+	for (i=start; i<=end; i++) {
+		gbcpu->putlookup[i].mem = NULL;
+		gbcpu->putlookup[i].put = putfn;
+		gbcpu->putlookup[i].priv = priv;
+		gbcpu->getlookup[i].mem = NULL;
+		gbcpu->getlookup[i].get = getfn;
+		gbcpu->getlookup[i].priv = priv;
+	}
+}
 
-	if (!gbcpu_halted) {
-		op = mem_get(gbcpu_regs.rn.pc++);
-		gbcpu_cycles = 4;
-		DPRINTF("%04x: %02x", gbcpu_regs.rn.pc - 1, op);
-		ops[op].fn(op, &ops[op]);
+/*
+ * Back pages start to end directly by host memory, getmem/putmem
+ * point to the first byte of page start.  NULL falls back to the
+ * callbacks set up by gbcpu_addmem().
+ */
+regparm void gbcpu_mapmem(struct gbcpu *gbcpu, uint32_t start, uint32_t end, const uint8_t *getmem, uint8_t *putmem)
+{
+	uint32_t i;
 
-		DEB(show_reg_diffs(&ops[op]));
+	for (i=start; i<=end; i++) {
+		long ofs = (i - start) << 8;
+		gbcpu->getlookup[i].mem = getmem != NULL ? getmem + ofs : NULL;
+		gbcpu->putlookup[i].mem = putmem != NULL ? putmem + ofs : NULL;
+	}
+}
+
+regparm void gbcpu_init(struct gbcpu *gbcpu)
+{
+	memset(&gbcpu->regs, 0, sizeof(gbcpu->regs));
+	gbcpu->halted = 0;
+	gbcpu->stopped = 0;
+	gbcpu->if_flag = 0;
+	gbcpu->halt_at_pc = -1;
+	gbcpu_addmem(gbcpu, 0x00, 0xff, none_put, none_get, NULL);
+	gbcpu->codebank = 0;
+	gbcpu->imm = NULL;
+	memset(gbcpu->codepage, GBCPU_CODE_NONE, sizeof(gbcpu->codepage));
+	memset(gbcpu->codegen, 0, sizeof(gbcpu->codegen));
+	gbcpu_flush_code(gbcpu);
+	memset(gbcpu->syncpage, 0, sizeof(gbcpu->syncpage));
+	gbcpu->sync = NULL;
+	gbcpu->running = 0;
+	DEB(dump_regs(gbcpu));
+}
+
+regparm void gbcpu_intr(struct gbcpu *gbcpu, long vec)
+{
+	DPRINTF("gbcpu_intr(%04lx)\n", vec);
+	gbcpu->halted = 0;
+	gbcpu->if_flag = 0;
+	push(gbcpu, REGS16_R(gbcpu->regs, PC));
+	REGS16_W(gbcpu->regs, PC, vec);
+}
+
+/*
+ * Fetch the next opcode, from the predecoded block cache if the
+ * code page allows it.  *insnp is set to the cache entry or NULL.
+ */
+static inline regparm uint32_t insn_begin(struct gbcpu *gbcpu, uint32_t *pcp, const struct gbcpu_insn **insnp)
+{
+	uint32_t pc = REGS16_R(gbcpu->regs, PC);
+	const struct gbcpu_insn *insn;
+	uint32_t op;
+
+	/* sequential execution within a block needs no lookup */
+	if (gbcpu->cur_pc == pc)
+		insn = &gbcpu->blocks[gbcpu->cur_block].insn[gbcpu->cur_insn];
+	else
+		insn = find_insn(gbcpu, pc);
+
+	if (insn != NULL) {
+		op = insn->op;
+		gbcpu->imm = insn->imm;
+		gbcpu->cycles = 4 * insn->len;
+		REGS16_W(gbcpu->regs, PC, pc + 1);
+	} else {
+		op = mem_get(gbcpu, gbcpu->regs.rn.pc++);
+		gbcpu->cycles = 4;
+	}
+	DPRINTF("%04x: %02x", gbcpu->regs.rn.pc - 1, op);
+	*pcp = pc;
+	*insnp = insn;
+	return op;
+}
 
-		if (gbcpu_halt_at_pc != -1 &&
-		    REGS16_R(gbcpu_regs, PC) == gbcpu_halt_at_pc) {
-			DPRINTF("halted at PC %04lx\n", gbcpu_halt_at_pc);
-			gbcpu_halted = 1;
-			gbcpu_if = 1;
+static inline regparm long insn_end(struct gbcpu *gbcpu, uint32_t pc, const struct gbcpu_insn *insn)
+{
+	if (insn != NULL) {
+		gbcpu->imm = NULL;
+		if (gbcpu->cur_pc == pc &&
+		    REGS16_R(gbcpu->regs, PC) == pc + insn->len &&
+		    gbcpu->cur_insn + 1 < gbcpu->blocks[gbcpu->cur_block].n) {
+			gbcpu->cur_insn++;
+			gbcpu->cur_pc = pc + insn->len;
+		} else {
+			gbcpu->cur_pc = GBCPU_NO_BLOCK;
 		}
-		return gbcpu_cycles;
 	}
-	if (gbcpu_stopped) return -1;
-	return 16;
+
+	if (gbcpu->halt_at_pc != -1 &&
+	    REGS16_R(gbcpu->regs, PC) == gbcpu->halt_at_pc) {
+		DPRINTF("halted at PC %04lx\n", gbcpu->halt_at_pc);
+		gbcpu->halted = 1;
+		gbcpu->if_flag = 1;
+	}
+	return gbcpu->cycles;
+}
+
+/*
+ * Table interpreter, used for single steps.
+ */
+regparm long gbcpu_step(struct gbcpu *gbcpu)
+{
+	const struct gbcpu_insn *insn;
+	uint32_t pc;
+	uint32_t op;
+
+	if (gbcpu->halted) {
+		if (gbcpu->stopped) return -1;
+		return 16;
+	}
+	op = insn_begin(gbcpu, &pc, &insn);
+	ops[op].fn(gbcpu, op, &ops[op]);
+	DEB(show_reg_diffs(gbcpu, &ops[op]));
+	return insn_end(gbcpu, pc, insn);
+}
+
+/*
+ * gbcpu_run() dispatches through a label table when the compiler
+ * supports computed goto and through a switch otherwise.  Both are
+ * generated from GBCPU_OPS, so every handler is called with a
+ * constant opcode and can be inlined.
+ */
+#if defined(HAVE_COMPUTED_GOTO) && DEBUG == 0
+#define THREADED_DISPATCH 1
+#endif
+
+#define RUN_CONTINUE \
+	(total < maxcycles && !gbcpu->run_stop && \
+	 !gbcpu->halted && gbcpu->if_flag == if_flag)
+
+/*
+ * Execute instructions until at least maxcycles have passed, the cpu
+ * halts, the interrupt enable flag changes or an instruction accessed
+ * a sync page.  Must not be called while halted.
+ * Returns the number of cycles executed, the last instruction's
+ * cycles are left in gbcpu->cycles and the cycles not yet passed to
+ * the sync callback in gbcpu->run_pending.
+ */
+RUN_FLATTEN regparm long gbcpu_run(struct gbcpu *gbcpu, long maxcycles)
+{
+#ifdef THREADED_DISPATCH
+	static const void *const dispatch[256] = {
+#define OPS_LABEL(opc, name, fn, c1, c2) &&op_##opc,
+		GBCPU_OPS(OPS_LABEL)
+#undef OPS_LABEL
+	};
+#endif
+	long if_flag = gbcpu->if_flag;
+	long total = 0;
+	const struct gbcpu_insn *insn;
+	uint32_t pc;
+	uint32_t op;
+
+	gbcpu->running = 1;
+	gbcpu->run_stop = 0;
+	gbcpu->run_insns = 0;
+	gbcpu->run_pending = 0;
+
+#ifdef THREADED_DISPATCH
+#define OPS_LABEL(opc, name, fn, c1, c2) \
+op_##opc: \
+	fn(gbcpu, opc, &ops[opc]); \
+	goto next;
+	goto first;
+	GBCPU_OPS(OPS_LABEL)
+#undef OPS_LABEL
+next:
+	{
+		long step = insn_end(gbcpu, pc, insn);
+		total += step;
+		gbcpu->run_pending += step;
+		gbcpu->run_insns++;
+	}
+	if (!RUN_CONTINUE)
+		goto out;
+first:
+	op = insn_begin(gbcpu, &pc, &insn);
+	goto *dispatch[op];
+out:
+#else
+	do {
+		long step;
+
+		op = insn_begin(gbcpu, &pc, &insn);
+		switch (op) {
+#define OPS_CASE(opc, name, fn, c1, c2) \
+		case opc: fn(gbcpu, opc, &ops[opc]); break;
+		GBCPU_OPS(OPS_CASE)
+#undef OPS_CASE
+		}
+		DEB(show_reg_diffs(gbcpu, &ops[op]));
+		step = insn_end(gbcpu, pc, insn);
+		total += step;
+		gbcpu->run_pending += step;
+		gbcpu->run_insns++;
+	} while (RUN_CONTINUE);
+#endif
+	gbcpu->running = 0;
+
+	return total;
 }
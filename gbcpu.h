@@ -11,57 +11,8 @@
 #include <inttypes.h>
 #include "common.h"
 
-#define ZF	0x80
-#define NF	0x40
-#define HF	0x20
-#define CF	0x10
-
-#define BC	0
-#define DE	1
-#define HL	2
-#define AF	3
-#define SP	4
-#define PC	5
-
-#define DEBUG 0
-
-#if DEBUG == 1
-
-#define DPRINTF(...) printf(__VA_ARGS__)
-#define DEB(x) x
-#define OPINFO(name, fn, cycles_1, cycles_2) {name, fn, cycles_1, cycles_2}
-#define CYCLES1(op) (op->cycles_1)
-#define CYCLES2(op) (op->cycles_2)
-#define CYCLES_OK(op, cycles) \
-	(op->cycles_1 == 0 || cycles == op->cycles_1 || cycles == op->cycles_2)
-
-#else
-
-/*
-static inline void foo(void)
-{
-}
-
-
-#define DPRINTF(...) foo()
-#define DEB(x) foo()
-*/
-#define DPRINTF(...) do { } while (0)
-#define DEB(x)
-#define OPINFO(name, fn, cycles_1, cycles_2) {fn}
-#define CYCLES1(op) 0
-#define CYCLES2(op) 0
-#define CYCLES_OK(op, cycles) 1
-
-#endif
-
 #if BYTE_ORDER == LITTLE_ENDIAN
 
-#define REGS16_R(r, i) (r.rw[i])
-#define REGS16_W(r, i, x) (r.rw[i]) = x
-#define REGS8_R(r, i) (r.ri[i^1])
-#define REGS8_W(r, i, x) (r.ri[i^1]) = x
-
 typedef union {
 		uint8_t ri[12];
 		uint16_t rw[6];
@@ -81,11 +32,6 @@ typedef union {
 
 #else
 
-#define REGS16_R(r, i) (r.rw[i])
-#define REGS16_W(r, i, x) (r.rw[i]) = x
-#define REGS8_R(r, i) (r.ri[i])
-#define REGS8_W(r, i, x) (r.ri[i]) = x
-
 typedef union {
 		uint8_t ri[12];
 		uint16_t rw[6];
@@ -105,19 +51,102 @@ typedef union {
 
 #endif
 
-typedef regparm void (*gbcpu_put_fn)(uint32_t addr, uint8_t val);
-typedef regparm uint32_t (*gbcpu_get_fn)(uint32_t addr);
+typedef regparm void (*gbcpu_put_fn)(void *priv, uint32_t addr, uint8_t val);
+typedef regparm uint32_t (*gbcpu_get_fn)(void *priv, uint32_t addr);
 
-extern gbcpu_regs_u gbcpu_regs;
-extern long gbcpu_halt_at_pc;
-extern long gbcpu_halted;
-extern long gbcpu_if;
+/*
+ * Called by gbcpu_run() before an access to a sync page, with the
+ * cycles of the instructions completed since the last sync.  Returns
+ * nonzero if the cycles were accounted, which also ends the run after
+ * the current instruction.
+ */
+typedef regparm long (*gbcpu_sync_fn)(void *priv, uint32_t addr, long cycles);
 
-regparm void gbcpu_addmem(uint32_t start, uint32_t end, gbcpu_put_fn putfn, gbcpu_get_fn getfn);
-regparm void gbcpu_init(void);
-regparm long gbcpu_step(void);
-regparm void gbcpu_intr(long vec);
-regparm uint8_t gbcpu_mem_get(uint16_t addr);
-regparm void gbcpu_mem_put(uint16_t addr, uint8_t val);
+/*
+ * A page is either backed by host memory (mem points to its first
+ * byte) or handled by the callback when mem is NULL.
+ */
+struct get_entry {
+	/*@null@*/ /*@dependent@*/ const uint8_t *mem;
+	gbcpu_get_fn get;
+	void *priv;
+};
+
+struct put_entry {
+	/*@null@*/ /*@dependent@*/ uint8_t *mem;
+	gbcpu_put_fn put;
+	void *priv;
+};
+
+/* Page types for the predecoded block cache, see gbcpu_addcode(). */
+#define GBCPU_CODE_NONE		0	/* never cached */
+#define GBCPU_CODE_ROM		1	/* fixed content */
+#define GBCPU_CODE_BANKED	2	/* content selected by codebank */
+#define GBCPU_CODE_RAM		3	/* writable, writes invalidate */
+
+#define GBCPU_BLOCK_INSNS	16
+#define GBCPU_BLOCKS		512
+#define GBCPU_NO_BLOCK		0xffffffff
+
+struct gbcpu_insn {
+	uint8_t op;
+	uint8_t len;
+	uint8_t imm[2];
+};
+
+/*
+ * A predecoded block: instructions starting at the pc in key, ending
+ * at the first unconditional branch or at the page boundary.
+ */
+struct gbcpu_block {
+	uint32_t key;	/* codebank << 16 | pc, GBCPU_NO_BLOCK if unused */
+	uint32_t gen;	/* codegen of the page at decode time */
+	uint8_t n;
+	struct gbcpu_insn insn[GBCPU_BLOCK_INSNS];
+};
+
+struct gbcpu {
+	gbcpu_regs_u regs;
+	long halted;
+	long stopped;
+	long if_flag;
+	long halt_at_pc;
+	long cycles;
+
+	struct get_entry getlookup[256];
+	struct put_entry putlookup[256];
+
+	long codebank;	/* bank mapped into GBCPU_CODE_BANKED pages, see gbcpu_setcodebank() */
+	uint8_t codepage[256];
+	uint32_t codegen[256];
+	long cur_block;	/* block being executed */
+	long cur_insn;
+	uint32_t cur_pc;	/* pc of cur_insn, GBCPU_NO_BLOCK if none */
+	/*@null@*/ /*@dependent@*/ const uint8_t *imm;	/* predecoded operands of the running insn */
+	struct gbcpu_block blocks[GBCPU_BLOCKS];
+
+	gbcpu_sync_fn sync;
+	/*@dependent@*/ void *sync_priv;
+	uint8_t syncpage[256];
+	long running;	/* inside gbcpu_run() */
+	long run_stop;
+	long run_insns;
+	long run_pending;	/* cycles not yet passed to sync */
+};
+
+regparm void gbcpu_addmem(struct gbcpu *gbcpu, uint32_t start, uint32_t end, gbcpu_put_fn putfn, gbcpu_get_fn getfn, void *priv);
+regparm void gbcpu_mapmem(struct gbcpu *gbcpu, uint32_t start, uint32_t end, /*@null@*/ const uint8_t *getmem, /*@null@*/ uint8_t *putmem);
+regparm void gbcpu_addcode(struct gbcpu *gbcpu, uint32_t start, uint32_t end, long type);
+regparm void gbcpu_setcodebank(struct gbcpu *gbcpu, long bank);
+regparm void gbcpu_flush_code(struct gbcpu *gbcpu);
+regparm void gbcpu_addsync(struct gbcpu *gbcpu, uint32_t start, uint32_t end, gbcpu_sync_fn fn, void *priv);
+regparm void gbcpu_init(struct gbcpu *gbcpu);
+regparm long gbcpu_step(struct gbcpu *gbcpu);
+regparm long gbcpu_run(struct gbcpu *gbcpu, long maxcycles);
+regparm void gbcpu_intr(struct gbcpu *gbcpu, long vec);
+regparm uint8_t gbcpu_mem_get(struct gbcpu *gbcpu, uint16_t addr);
+regparm void gbcpu_mem_put(struct gbcpu *gbcpu, uint16_t addr, uint8_t val);
+/* Read memory like an instruction fetch, without spending cycles. */
+regparm uint8_t gbcpu_peek(struct gbcpu *gbcpu, uint16_t addr);
 
 #endif
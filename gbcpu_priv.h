@@ -0,0 +1,78 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * 2003-2005 (C) by Tobias Diedrich <ranma+gbsplay@tdiedrich.de>
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+/*
+ * Register and flag names and debug helpers of the cpu emulation,
+ * only for libgbs itself.
+ */
+
+#ifndef _GBCPU_PRIV_H_
+#define _GBCPU_PRIV_H_
+
+#include "gbcpu.h"
+
+#define ZF	0x80
+#define NF	0x40
+#define HF	0x20
+#define CF	0x10
+
+#define BC	0
+#define DE	1
+#define HL	2
+#define AF	3
+#define SP	4
+#define PC	5
+
+#define DEBUG 0
+
+#if DEBUG == 1
+
+#define DPRINTF(...) printf(__VA_ARGS__)
+#define DEB(x) x
+#define OPINFO(name, fn, cycles_1, cycles_2) {name, fn, cycles_1, cycles_2}
+#define CYCLES1(op) (op->cycles_1)
+#define CYCLES2(op) (op->cycles_2)
+#define CYCLES_OK(op, cycles) \
+	(op->cycles_1 == 0 || cycles == op->cycles_1 || cycles == op->cycles_2)
+
+#else
+
+/*
+static inline void foo(void)
+{
+}
+
+
+#define DPRINTF(...) foo()
+#define DEB(x) foo()
+*/
+#define DPRINTF(...) do { } while (0)
+#define DEB(x)
+#define OPINFO(name, fn, cycles_1, cycles_2) {fn}
+#define CYCLES1(op) 0
+#define CYCLES2(op) 0
+#define CYCLES_OK(op, cycles) 1
+
+#endif
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+
+#define REGS16_R(r, i) (r.rw[i])
+#define REGS16_W(r, i, x) (r.rw[i]) = x
+#define REGS8_R(r, i) (r.ri[i^1])
+#define REGS8_W(r, i, x) (r.ri[i^1]) = x
+
+#else
+
+#define REGS16_R(r, i) (r.rw[i])
+#define REGS16_W(r, i, x) (r.rw[i]) = x
+#define REGS8_R(r, i) (r.ri[i])
+#define REGS8_W(r, i, x) (r.ri[i]) = x
+
+#endif
+
+#endif
@@ -14,8 +14,10 @@
 #include <assert.h>
 #include <math.h>
 
-#include "gbcpu.h"
+#include "gbcpu_priv.h"
 #include "gbhw.h"
+#include "synth.h"
+#include "snapshot.h"
 #include "impulse.h"
 
 #define REG_TIMA 0x05
@@ -24,17 +26,7 @@
 #define REG_IF   0x0f
 #define REG_IE   0x7f /* Nominally 0xff, but we remap it to 0x7f internally. */
 
-static uint8_t *rom;
-static uint8_t intram[0x2000];
-static uint8_t extram[0x2000];
-static uint8_t ioregs[0x80];
-static uint8_t hiram[0x80];
-static long rombank = 1;
-static long lastbank;
-static long apu_on = 1;
-static long io_written = 0;
-
-static const uint8_t ioregs_ormask[sizeof(ioregs)] = {
+static const uint8_t ioregs_ormask[0x80] = {
 	/* 0x00 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	/* 0x10 */ 0x80, 0x3f, 0x00, 0xff, 0xbf,
 	/* 0x15 */ 0xff, 0x3f, 0x00, 0xff, 0xbf,
@@ -42,7 +34,7 @@ static const uint8_t ioregs_ormask[sizeof(ioregs)] = {
 	/* 0x1f */ 0xff, 0xff, 0x00, 0x00, 0xbf,
 	/* 0x24 */ 0x00, 0x00, 0x70, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
 };
-static const uint8_t ioregs_initdata[sizeof(ioregs)] = {
+static const uint8_t ioregs_initdata[0x80] = {
 	/* 0x00 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 /* sound registers */
 	/* 0x10 */ 0x80, 0xbf, 0x00, 0x00, 0xbf,
@@ -54,8 +46,6 @@ static const uint8_t ioregs_initdata[sizeof(ioregs)] = {
 	/* 0x30 */ 0xac, 0xdd, 0xda, 0x48, 0x36, 0x02, 0xcf, 0x16, 0x2c, 0x04, 0xe5, 0x2c, 0xac, 0xdd, 0xda, 0x48,
 };
 
-static uint8_t boot_rom[256];
-
 static const char dutylookup[4] = {
 	1, 2, 4, 6
 };
@@ -63,100 +53,84 @@ static const long len_mask[4] = {
 	0x3f, 0x3f, 0xff, 0x3f
 };
 
-struct gbhw_channel gbhw_ch[4];
-
-static long lminval, lmaxval, rminval, rmaxval;
-static double filter_constant = GBHW_FILTER_CONST_DMG;
-static int filter_enabled = 1;
-static long cap_factor = 0x10000;
-
 #define MASTER_VOL_MIN	0
 #define MASTER_VOL_MAX	(256*256)
-static long master_volume;
-static long master_fade;
-static long master_dstvol;
-static long sample_rate;
-static long update_level = 0;
-static long sequence_ctr = 0;
-static long halted_noirq_cycles = 0;
+
+/* samples integrated on the stack per synth_scale() call */
+#define FLUSH_CHUNK	256
+
+/* buffer size in frames for gbhw_render() without gbhw_setbuffer() */
+#define RENDER_CHUNK	1024
 
 static const long vblanktc = 70224; /* ~59.73 Hz (vblankctr)*/
 static const long vblankclocks = 4560;
-static long vblankctr;
-static long timertc = 16;
-static long timerctr;
 
 static const long msec_cycles = GBHW_CLOCK/1000;
 
-static long sum_cycles;
-
-static long pause_output = 0;
-static long rom_lockout = 1;
-
-static gbhw_callback_fn callback;
-static /*@null@*/ /*@dependent@*/ void *callbackpriv;
-static /*@null@*/ /*@dependent@*/ struct gbhw_buffer *soundbuf = NULL; /* externally visible output buffer */
-static /*@null@*/ /*@only@*/ struct gbhw_buffer *impbuf = NULL;   /* internal impulse output buffer */
-
-static gbhw_iocallback_fn iocallback;
-static /*@null@*/ /*@dependent@*/ void *iocallback_priv;
-
-static gbhw_stepcallback_fn stepcallback;
-static /*@null@*/ /*@dependent@*/ void *stepcallback_priv;
-
 #define TAP1_15		0x4000;
 #define TAP2_15		0x2000;
 #define TAP1_7		0x0040;
 #define TAP2_7		0x0020;
 
-static uint32_t tap1 = TAP1_15;
-static uint32_t tap2 = TAP2_15;
-static uint32_t lfsr = 0xffffffff;
-
 #define SOUND_DIV_MULT 0x10000LL
 
-static long long sound_div_tc = 0;
 static const long main_div_tc = 32;
-static long main_div;
 static const long sweep_div_tc = 256;
-static long sweep_div;
-
-static long ch3pos;
-static long last_l_value = 0, last_r_value = 0;
-static long ch3_next_nibble = 0;
 
 #define IMPULSE_WIDTH (1 << IMPULSE_W_SHIFT)
 #define IMPULSE_N (1 << IMPULSE_N_SHIFT)
 #define IMPULSE_N_MASK (IMPULSE_N - 1)
 
-static regparm uint32_t rom_get(uint32_t addr)
+
+
+/* STAT and LY only depend on the position within the frame. */
+static regparm uint32_t lcd_get(long vblankctr, uint32_t addr)
 {
-	if ((addr >> 8) == 0 && rom_lockout == 0) {
-		return boot_rom[addr & 0xff];
+	if (addr == 0xff44)
+		return ((2 * vblanktc - vblankclocks - vblankctr) / 456) % 154;
+
+	if (vblankctr > vblanktc - vblankclocks) {
+		return 0x01;  /* vblank */
+	} else {
+		/* ~108.7uS per line */
+		long t = (2 * vblanktc - vblankctr) % 456;
+		if (t < 204) {
+			/* 48.6uS in hblank (201-207 clks) */
+			return 0x00;
+		} else if (t < 284) {
+			/* 19uS in OAM scan (77-83 clks) */
+			return 0x02;
+		}
 	}
-//	DPRINTF("rom_get(%04x)\n", addr);
-	return rom[addr & 0x3fff];
+	return 0x03;  /* both OAM and display RAM busy */
 }
 
-static regparm uint32_t rombank_get(uint32_t addr)
+/* Cycles until STAT or LY can change next. */
+static regparm long lcd_next_change(long vblankctr)
 {
-//	DPRINTF("rombank_get(%04x)\n", addr);
-	return rom[(addr & 0x3fff) + 0x4000*rombank];
+	long t = (2 * vblanktc - vblankctr) % 456;
+
+	if (t < 204)
+		return 204 - t;
+	if (t < 284)
+		return 284 - t;
+	return 456 - t;
 }
 
-static regparm uint32_t io_get(uint32_t addr)
+static regparm uint32_t io_get(void *priv, uint32_t addr)
 {
+	struct gbhw *gbhw = priv;
 	if (addr >= 0xff80 && addr <= 0xfffe) {
-		return hiram[addr & 0x7f];
+		return gbhw->hiram[addr & 0x7f];
 	}
 	if (addr >= 0xff10 &&
 	           addr <= 0xff3f) {
-		uint8_t val = ioregs[addr & 0x7f];
+		uint8_t val = gbhw->ioregs[addr & 0x7f];
 		if (addr == 0xff26) {
 			long i;
 			val &= 0xf0;
 			for (i=0; i<4; i++) {
-				if (gbhw_ch[i].running) {
+				if (gbhw->ch[i].running) {
 					val |= (1 << i);
 				}
 			}
@@ -172,29 +146,15 @@ static regparm uint32_t io_get(uint32_t addr)
 	case 0xff06:  // TMA
 	case 0xff07:  // TAC
 	case 0xff0f:  // IF
-		return ioregs[addr & 0x7f];
+		return gbhw->ioregs[addr & 0x7f];
 	case 0xff41: /* LCDC Status */
-		if (vblankctr > vblanktc - vblankclocks) {
-			return 0x01;  /* vblank */
-		} else {
-			/* ~108.7uS per line */
-			long t = (2 * vblanktc - vblankctr) % 456;
-			if (t < 204) {
-				/* 48.6uS in hblank (201-207 clks) */
-				return 0x00;
-			} else if (t < 284) {
-				/* 19uS in OAM scan (77-83 clks) */
-				return 0x02;
-			}
-		}
-		return 0x03;  /* both OAM and display RAM busy */
 	case 0xff44: /* LCD Y-coordinate */
-		return ((2 * vblanktc - vblankclocks - vblankctr) / 456) % 154;
+		return lcd_get(gbhw->vblankctr, addr);
 	case 0xff70:  // CGB ram bank switch
 		WARN_ONCE("ioread from SVBK (CGB mode) ignored.\n");
 		return 0xff;
 	case 0xffff:
-		return ioregs[0x7f];
+		return gbhw->ioregs[0x7f];
 	default:
 		WARN_ONCE("ioread from 0x%04x unimplemented.\n", (unsigned int)addr);
 		DPRINTF("io_get(%04x)\n", addr);
@@ -202,164 +162,154 @@ static regparm uint32_t io_get(uint32_t addr)
 	}
 }
 
-static regparm uint32_t intram_get(uint32_t addr)
-{
-//	DPRINTF("intram_get(%04x)\n", addr);
-	return intram[addr & 0x1fff];
-}
 
-static regparm uint32_t extram_get(uint32_t addr)
+
+/* Point the cpu at the currently visible ROM pages. */
+static regparm void gbhw_map_rom(struct gbhw *gbhw)
 {
-//	DPRINTF("extram_get(%04x)\n", addr);
-	return extram[addr & 0x1fff];
+	gbcpu_mapmem(&gbhw->gbcpu, 0x00, 0x3f, gbhw->rom, NULL);
+	if (gbhw->rom_lockout == 0)
+		gbcpu_mapmem(&gbhw->gbcpu, 0x00, 0x00, gbhw->boot_rom, NULL);
+	gbcpu_mapmem(&gbhw->gbcpu, 0x40, 0x7f, &gbhw->rom[0x4000*gbhw->rombank], NULL);
+	gbcpu_setcodebank(&gbhw->gbcpu, gbhw->rombank);
 }
 
-static regparm void rom_put(uint32_t addr, uint8_t val)
+static regparm void rom_put(void *priv, uint32_t addr, uint8_t val)
 {
+	struct gbhw *gbhw = priv;
 	if (addr >= 0x2000 && addr <= 0x3fff) {
 		val &= 0x1f;
-		rombank = val + (val == 0);
-		if (rombank > lastbank) {
-			WARN_ONCE("Bank %ld out of range (0-%ld)!\n", rombank, lastbank);
-			rombank = lastbank;
+		gbhw->rombank = val + (val == 0);
+		if (gbhw->rombank > gbhw->lastbank) {
+			WARN_ONCE("Bank %ld out of range (0-%ld)!\n", gbhw->rombank, gbhw->lastbank);
+			gbhw->rombank = gbhw->lastbank;
 		}
+		gbhw_map_rom(gbhw);
 	} else {
 		WARN_ONCE("rom write of %02x to %04x ignored\n", val, addr);
 	}
 }
 
-static regparm void apu_reset(void)
+static regparm void apu_reset(struct gbhw *gbhw)
 {
 	long i;
 	int mute_tmp[4];
 
 	for (i = 0; i < 4; i++) {
-		mute_tmp[i] = gbhw_ch[i].mute;
+		mute_tmp[i] = gbhw->ch[i].mute;
 	}
-	memset(gbhw_ch, 0, sizeof(gbhw_ch));
+	memset(gbhw->ch, 0, sizeof(gbhw->ch));
 	for (i = 0xff10; i < 0xff26; i++) {
-		ioregs[i & 0x7f] = 0;
+		gbhw->ioregs[i & 0x7f] = 0;
 	}
 	for (i = 0; i < 4; i++) {
-		gbhw_ch[i].len = 0;
-		gbhw_ch[i].len_gate = 0;
-		gbhw_ch[i].volume = 0;
-		gbhw_ch[i].duty_ctr = 4;
-		gbhw_ch[i].div_tc = 1;
-		gbhw_ch[i].master = 1;
-		gbhw_ch[i].running = 0;
-		gbhw_ch[i].mute = mute_tmp[i];
+		gbhw->ch[i].len = 0;
+		gbhw->ch[i].len_gate = 0;
+		gbhw->ch[i].volume = 0;
+		gbhw->ch[i].duty_ctr = 4;
+		gbhw->ch[i].div_tc = 1;
+		gbhw->ch[i].master = 1;
+		gbhw->ch[i].running = 0;
+		gbhw->ch[i].mute = mute_tmp[i];
 	}
-	sequence_ctr = 0;
+	gbhw->sequence_ctr = 0;
 }
 
-static void linkport_atexit(void);
-
-static regparm void linkport_write(long c)
+static regparm void linkport_write(struct gbhw *gbhw, long c)
 {
-	static char buf[256];
-	static long idx = 0;
-	static long exit_handler_set = 0;
-	static long enabled = 1;
+	struct gbhw_linkport *lp = &gbhw->linkport;
 
-	if (!enabled) {
+	if (lp->disabled) {
 		return;
 	}
 	if (!(c == -1 || c == '\r' || c == '\n' || (c >= 0x20 && c <= 0x7f))) {
-		enabled = 0;
+		lp->disabled = 1;
 		fprintf(stderr, "Link port output %02lx ignored.\n", c);
 		return;
 	}
-	if (c != -1 && idx < (sizeof(buf) - 1)) {
-		buf[idx++] = c;
-		buf[idx] = 0;
+	if (c != -1 && lp->idx < (sizeof(lp->buf) - 1)) {
+		lp->buf[lp->idx++] = c;
+		lp->buf[lp->idx] = 0;
 	}
-	if (c == '\n' || (c == -1 && idx > 0)) {
-		fprintf(stderr, "Link port text: %s", buf);
-		idx = 0;
-		if (!exit_handler_set) {
-			atexit(linkport_atexit);
-		}
+	if (c == '\n' || (c == -1 && lp->idx > 0)) {
+		fprintf(stderr, "Link port text: %s", lp->buf);
+		lp->idx = 0;
 	}
 }
 
-static void linkport_atexit(void)
-{
-	linkport_write(-1);
-}
-
-static regparm void sequencer_update_len(long chn)
+static regparm void sequencer_update_len(struct gbhw *gbhw, long chn)
 {
-	if (gbhw_ch[chn].len_enable && gbhw_ch[chn].len_gate) {
-		gbhw_ch[chn].len++;
-		gbhw_ch[chn].len &= len_mask[chn];
-		if (gbhw_ch[chn].len == 0) {
-			gbhw_ch[chn].volume = 0;
-			gbhw_ch[chn].env_tc = 0;
-			gbhw_ch[chn].running = 0;
-			gbhw_ch[chn].len_gate = 0;
+	if (gbhw->ch[chn].len_enable && gbhw->ch[chn].len_gate) {
+		gbhw->ch[chn].len++;
+		gbhw->ch[chn].len &= len_mask[chn];
+		if (gbhw->ch[chn].len == 0) {
+			gbhw->ch[chn].volume = 0;
+			gbhw->ch[chn].env_tc = 0;
+			gbhw->ch[chn].running = 0;
+			gbhw->ch[chn].len_gate = 0;
 		}
 	}
 }
 
-static regparm long sweep_check_overflow(void)
+static regparm long sweep_check_overflow(struct gbhw *gbhw)
 {
-	long val = (2048 - gbhw_ch[0].div_tc_shadow) >> gbhw_ch[0].sweep_shift;
+	long val = (2048 - gbhw->ch[0].div_tc_shadow) >> gbhw->ch[0].sweep_shift;
 
-	if (gbhw_ch[0].sweep_shift == 0) {
+	if (gbhw->ch[0].sweep_shift == 0) {
 		return 1;
 	}
 
-	if (!gbhw_ch[0].sweep_dir) {
-		if (gbhw_ch[0].div_tc_shadow <= val) {
-			gbhw_ch[0].running = 0;
+	if (!gbhw->ch[0].sweep_dir) {
+		if (gbhw->ch[0].div_tc_shadow <= val) {
+			gbhw->ch[0].running = 0;
 			return 0;
 		}
 	}
 	return 1;
 }
 
-static regparm void io_put(uint32_t addr, uint8_t val)
+static regparm void io_put(void *priv, uint32_t addr, uint8_t val)
 {
+	struct gbhw *gbhw = priv;
 	long chn = (addr - 0xff10)/5;
 
 	if (addr >= 0xff80 && addr <= 0xfffe) {
-		hiram[addr & 0x7f] = val;
+		gbhw->hiram[addr & 0x7f] = val;
 		return;
 	}
 
-	io_written = 1;
+	gbhw->io_written = 1;
 
-	if (iocallback)
-		iocallback(sum_cycles, addr, val, iocallback_priv);
+	if (gbhw->iocallback)
+		gbhw->iocallback(gbhw->sum_cycles, addr, val, gbhw->iocallback_priv);
 
-	if (apu_on == 0 && addr >= 0xff10 && addr < 0xff26) {
+	if (gbhw->apu_on == 0 && addr >= 0xff10 && addr < 0xff26) {
 		return;
 	}
-	ioregs[addr & 0x7f] = val;
+	gbhw->ioregs[addr & 0x7f] = val;
 	DPRINTF(" ([0x%04x]=%02x) ", addr, val);
 	switch (addr) {
 		case 0xff02:
 			if (val & 0x80) {
-				linkport_write(ioregs[1]);
+				linkport_write(gbhw, gbhw->ioregs[1]);
 			}
 			break;
 		case 0xff05:  // TIMA
 		case 0xff06:  // TMA
 			break;
 		case 0xff07:  // TAC
-			timertc = 16 << (((val+3) & 3) << 1);
-			if ((val & 0xf0) == 0x80) timertc /= 2;
-			if (timerctr > timertc) {
-				timerctr = 0;
+			gbhw->timertc = 16 << (((val+3) & 3) << 1);
+			if ((val & 0xf0) == 0x80) gbhw->timertc /= 2;
+			if (gbhw->timerctr > gbhw->timertc) {
+				gbhw->timerctr = 0;
 			}
 			break;
 		case 0xff0f:  // IF
 			break;
 		case 0xff10:
-			gbhw_ch[0].sweep_ctr = gbhw_ch[0].sweep_tc = ((val >> 4) & 7);
-			gbhw_ch[0].sweep_dir = (val >> 3) & 1;
-			gbhw_ch[0].sweep_shift = val & 7;
+			gbhw->ch[0].sweep_ctr = gbhw->ch[0].sweep_tc = ((val >> 4) & 7);
+			gbhw->ch[0].sweep_dir = (val >> 3) & 1;
+			gbhw->ch[0].sweep_shift = val & 7;
 
 			break;
 		case 0xff11:
@@ -369,10 +319,10 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 				long duty_ctr = val >> 6;
 				long len = val & 0x3f;
 
-				gbhw_ch[chn].duty_ctr = dutylookup[duty_ctr];
-				gbhw_ch[chn].duty_tc = gbhw_ch[chn].div_tc*gbhw_ch[chn].duty_ctr/8;
-				gbhw_ch[chn].len = len;
-				gbhw_ch[chn].len_gate = 1;
+				gbhw->ch[chn].duty_ctr = dutylookup[duty_ctr];
+				gbhw->ch[chn].duty_tc = gbhw->ch[chn].div_tc*gbhw->ch[chn].duty_ctr/8;
+				gbhw->ch[chn].len = len;
+				gbhw->ch[chn].len_gate = 1;
 
 				break;
 			}
@@ -384,13 +334,13 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 				long envdir = (val >> 3) & 1;
 				long envspd = val & 7;
 
-				gbhw_ch[chn].volume = vol;
-				gbhw_ch[chn].env_dir = envdir;
-				gbhw_ch[chn].env_ctr = gbhw_ch[chn].env_tc = envspd;
+				gbhw->ch[chn].volume = vol;
+				gbhw->ch[chn].env_dir = envdir;
+				gbhw->ch[chn].env_ctr = gbhw->ch[chn].env_tc = envspd;
 
-				gbhw_ch[chn].master = (val & 0xf8) != 0;
-				if (!gbhw_ch[chn].master) {
-					gbhw_ch[chn].running = 0;
+				gbhw->ch[chn].master = (val & 0xf8) != 0;
+				if (!gbhw->ch[chn].master) {
+					gbhw->ch[chn].running = 0;
 				}
 			}
 			break;
@@ -401,65 +351,65 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 		case 0xff1d:
 		case 0xff1e:
 			{
-				long div = ioregs[0x13 + 5*chn];
-				long old_len_enable = gbhw_ch[chn].len_enable;
+				long div = gbhw->ioregs[0x13 + 5*chn];
+				long old_len_enable = gbhw->ch[chn].len_enable;
 
-				div |= ((long)ioregs[0x14 + 5*chn] & 7) << 8;
-				gbhw_ch[chn].div_tc = 2048 - div;
-				gbhw_ch[chn].duty_tc = gbhw_ch[chn].div_tc*gbhw_ch[chn].duty_ctr/8;
+				div |= ((long)gbhw->ioregs[0x14 + 5*chn] & 7) << 8;
+				gbhw->ch[chn].div_tc = 2048 - div;
+				gbhw->ch[chn].duty_tc = gbhw->ch[chn].div_tc*gbhw->ch[chn].duty_ctr/8;
 
 				if (addr == 0xff13 ||
 				    addr == 0xff18 ||
 				    addr == 0xff1d) break;
 
-				gbhw_ch[chn].len_enable = (ioregs[0x14 + 5*chn] & 0x40) > 0;
+				gbhw->ch[chn].len_enable = (gbhw->ioregs[0x14 + 5*chn] & 0x40) > 0;
 				if ((val & 0x80) == 0x80) {
-					if (!gbhw_ch[chn].len_gate) {
-						gbhw_ch[chn].len_gate = 1;
+					if (!gbhw->ch[chn].len_gate) {
+						gbhw->ch[chn].len_gate = 1;
 						if (old_len_enable == 1 &&
-						    gbhw_ch[chn].len_enable == 1 &&
-						    (sequence_ctr & 1) == 1) {
+						    gbhw->ch[chn].len_enable == 1 &&
+						    (gbhw->sequence_ctr & 1) == 1) {
 							// Trigger that un-freezes enabled length should clock it
-							sequencer_update_len(chn);
+							sequencer_update_len(gbhw, chn);
 						}
 					}
-					if (gbhw_ch[chn].master) {
-						gbhw_ch[chn].running = 1;
+					if (gbhw->ch[chn].master) {
+						gbhw->ch[chn].running = 1;
 					}
 					if (addr == 0xff1e) {
-						ch3pos = 0;
+						gbhw->ch3pos = 0;
 					}
 					if (addr == 0xff14) {
-						gbhw_ch[0].div_tc_shadow = gbhw_ch[0].div_tc;
-						sweep_check_overflow();
+						gbhw->ch[0].div_tc_shadow = gbhw->ch[0].div_tc;
+						sweep_check_overflow(gbhw);
 					}
 				}
 				if (old_len_enable == 0 &&
-				    gbhw_ch[chn].len_enable == 1 &&
-				    (sequence_ctr & 1) == 1) {
+				    gbhw->ch[chn].len_enable == 1 &&
+				    (gbhw->sequence_ctr & 1) == 1) {
 					// Enabling in first half of length period should clock length
-					sequencer_update_len(chn);
+					sequencer_update_len(gbhw, chn);
 				}
 			}
 
-//			printf(" ch%ld: vol=%02d envd=%ld envspd=%ld duty_ctr=%ld len=%03d len_en=%ld key=%04d gate=%ld%ld\n", chn, gbhw_ch[chn].volume, gbhw_ch[chn].env_dir, gbhw_ch[chn].env_tc, gbhw_ch[chn].duty_ctr, gbhw_ch[chn].len, gbhw_ch[chn].len_enable, gbhw_ch[chn].div_tc, gbhw_ch[chn].leftgate, gbhw_ch[chn].rightgate);
+//			printf(" ch%ld: vol=%02d envd=%ld envspd=%ld duty_ctr=%ld len=%03d len_en=%ld key=%04d gate=%ld%ld\n", chn, gbhw->ch[chn].volume, gbhw->ch[chn].env_dir, gbhw->ch[chn].env_tc, gbhw->ch[chn].duty_ctr, gbhw->ch[chn].len, gbhw->ch[chn].len_enable, gbhw->ch[chn].div_tc, gbhw->ch[chn].leftgate, gbhw->ch[chn].rightgate);
 			break;
 		case 0xff15:
 			break;
 		case 0xff1a:
-			gbhw_ch[2].master = (ioregs[0x1a] & 0x80) > 0;
-			if (!gbhw_ch[2].master) {
-				gbhw_ch[2].running = 0;
+			gbhw->ch[2].master = (gbhw->ioregs[0x1a] & 0x80) > 0;
+			if (!gbhw->ch[2].master) {
+				gbhw->ch[2].running = 0;
 			}
 			break;
 		case 0xff1b:
-			gbhw_ch[2].len = val;
-			gbhw_ch[2].len_gate = 1;
+			gbhw->ch[2].len = val;
+			gbhw->ch[2].len_gate = 1;
 			break;
 		case 0xff1c:
 			{
-				long vol = (ioregs[0x1c] >> 5) & 3;
-				gbhw_ch[2].volume = vol;
+				long vol = (gbhw->ioregs[0x1c] >> 5) & 3;
+				gbhw->ch[2].volume = vol;
 				break;
 			}
 		case 0xff1f:
@@ -467,66 +417,66 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 		case 0xff22:
 		case 0xff23:
 			{
-				long reg = ioregs[0x22];
+				long reg = gbhw->ioregs[0x22];
 				long shift = reg >> 4;
 				long rate = reg & 7;
-				long old_len_enable = gbhw_ch[chn].len_enable;
-				gbhw_ch[3].div_ctr = 0;
-				gbhw_ch[3].div_tc = 16 << shift;
+				long old_len_enable = gbhw->ch[chn].len_enable;
+				gbhw->ch[3].div_ctr = 0;
+				gbhw->ch[3].div_tc = 16 << shift;
 				if (reg & 8) {
-					tap1 = TAP1_7;
-					tap2 = TAP2_7;
+					gbhw->tap1 = TAP1_7;
+					gbhw->tap2 = TAP2_7;
 				} else {
-					tap1 = TAP1_15;
-					tap2 = TAP2_15;
+					gbhw->tap1 = TAP1_15;
+					gbhw->tap2 = TAP2_15;
 				}
-				if (rate) gbhw_ch[3].div_tc *= rate;
-				else gbhw_ch[3].div_tc /= 2;
-				gbhw_ch[chn].len_enable = (ioregs[0x23] & 0x40) > 0;
+				if (rate) gbhw->ch[3].div_tc *= rate;
+				else gbhw->ch[3].div_tc /= 2;
+				gbhw->ch[chn].len_enable = (gbhw->ioregs[0x23] & 0x40) > 0;
 				if (addr == 0xff22) break;
 
 				if (val & 0x80) {  /* trigger */
-					lfsr = 0xffffffff;
-					if (!gbhw_ch[chn].len_gate) {
-						gbhw_ch[chn].len_gate = 1;
+					gbhw->lfsr = 0xffffffff;
+					if (!gbhw->ch[chn].len_gate) {
+						gbhw->ch[chn].len_gate = 1;
 						if (old_len_enable == 1 &&
-						    gbhw_ch[chn].len_enable == 1 &&
-						    (sequence_ctr & 1) == 1) {
+						    gbhw->ch[chn].len_enable == 1 &&
+						    (gbhw->sequence_ctr & 1) == 1) {
 							// Trigger that un-freezes enabled length should clock it
-							sequencer_update_len(chn);
+							sequencer_update_len(gbhw, chn);
 						}
 					}
-					if (gbhw_ch[3].master) {
-						gbhw_ch[3].running = 1;
+					if (gbhw->ch[3].master) {
+						gbhw->ch[3].running = 1;
 					}
 				}
 				if (old_len_enable == 0 &&
-				    gbhw_ch[chn].len_enable == 1 &&
-				    (sequence_ctr & 1) == 1) {
+				    gbhw->ch[chn].len_enable == 1 &&
+				    (gbhw->sequence_ctr & 1) == 1) {
 					// Enabling in first half of length period should clock length
-					sequencer_update_len(chn);
+					sequencer_update_len(gbhw, chn);
 				}
-//				printf(" ch4: vol=%02d envd=%ld envspd=%ld duty_ctr=%ld len=%03d len_en=%ld key=%04d gate=%ld%ld\n", gbhw_ch[3].volume, gbhw_ch[3].env_dir, gbhw_ch[3].env_ctr, gbhw_ch[3].duty_ctr, gbhw_ch[3].len, gbhw_ch[3].len_enable, gbhw_ch[3].div_tc, gbhw_ch[3].leftgate, gbhw_ch[3].rightgate);
+//				printf(" ch4: vol=%02d envd=%ld envspd=%ld duty_ctr=%ld len=%03d len_en=%ld key=%04d gate=%ld%ld\n", gbhw->ch[3].volume, gbhw->ch[3].env_dir, gbhw->ch[3].env_ctr, gbhw->ch[3].duty_ctr, gbhw->ch[3].len, gbhw->ch[3].len_enable, gbhw->ch[3].div_tc, gbhw->ch[3].leftgate, gbhw->ch[3].rightgate);
 			}
 			break;
 		case 0xff25:
-			gbhw_ch[0].leftgate = (val & 0x10) > 0;
-			gbhw_ch[0].rightgate = (val & 0x01) > 0;
-			gbhw_ch[1].leftgate = (val & 0x20) > 0;
-			gbhw_ch[1].rightgate = (val & 0x02) > 0;
-			gbhw_ch[2].leftgate = (val & 0x40) > 0;
-			gbhw_ch[2].rightgate = (val & 0x04) > 0;
-			gbhw_ch[3].leftgate = (val & 0x80) > 0;
-			gbhw_ch[3].rightgate = (val & 0x08) > 0;
-			update_level = 1;
+			gbhw->ch[0].leftgate = (val & 0x10) > 0;
+			gbhw->ch[0].rightgate = (val & 0x01) > 0;
+			gbhw->ch[1].leftgate = (val & 0x20) > 0;
+			gbhw->ch[1].rightgate = (val & 0x02) > 0;
+			gbhw->ch[2].leftgate = (val & 0x40) > 0;
+			gbhw->ch[2].rightgate = (val & 0x04) > 0;
+			gbhw->ch[3].leftgate = (val & 0x80) > 0;
+			gbhw->ch[3].rightgate = (val & 0x08) > 0;
+			gbhw->update_level = 1;
 			break;
 		case 0xff26:
 			if (val & 0x80) {
-				ioregs[0x26] = 0x80;
-				apu_on = 1;
+				gbhw->ioregs[0x26] = 0x80;
+				gbhw->apu_on = 1;
 			} else {
-				apu_reset();
-				apu_on = 0;
+				apu_reset(gbhw);
+				gbhw->apu_on = 0;
 			}
 			break;
 		case 0xff70:
@@ -561,7 +511,9 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 		case 0xff3f:
 		case 0xff50: /* bootrom lockout reg */
 			if (val == 0x01) {
-				rom_lockout = 1;
+				gbhw->rom_lockout = 1;
+				gbhw_map_rom(gbhw);
+				gbcpu_flush_code(&gbhw->gbcpu);
 			}
 			break;
 		case 0xffff:
@@ -572,24 +524,16 @@ static regparm void io_put(uint32_t addr, uint8_t val)
 	}
 }
 
-static regparm void intram_put(uint32_t addr, uint8_t val)
-{
-	intram[addr & 0x1fff] = val;
-}
 
-static regparm void extram_put(uint32_t addr, uint8_t val)
-{
-	extram[addr & 0x1fff] = val;
-}
 
-static regparm void sequencer_step(void)
+static regparm void sequencer_step(struct gbhw *gbhw)
 {
 	long i;
 	long clock_len = 0;
 	long clock_env = 0;
 	long clock_sweep = 0;
 
-	switch (sequence_ctr & 7) {
+	switch (gbhw->sequence_ctr & 7) {
 	case 0: clock_len = 1; break;
 	case 1: break;
 	case 2: clock_len = 1; clock_sweep = 1; break;
@@ -600,65 +544,65 @@ static regparm void sequencer_step(void)
 	case 7: clock_env = 1; break;
 	}
 
-	sequence_ctr++;
+	gbhw->sequence_ctr++;
 
-	if (clock_sweep && gbhw_ch[0].sweep_tc) {
-		gbhw_ch[0].sweep_ctr--;
-		if (gbhw_ch[0].sweep_ctr < 0) {
-			long val = (2048 - gbhw_ch[0].div_tc_shadow) >> gbhw_ch[0].sweep_shift;
+	if (clock_sweep && gbhw->ch[0].sweep_tc) {
+		gbhw->ch[0].sweep_ctr--;
+		if (gbhw->ch[0].sweep_ctr < 0) {
+			long val = (2048 - gbhw->ch[0].div_tc_shadow) >> gbhw->ch[0].sweep_shift;
 
-			gbhw_ch[0].sweep_ctr = gbhw_ch[0].sweep_tc;
-			if (sweep_check_overflow()) {
-				if (gbhw_ch[0].sweep_dir) {
-					gbhw_ch[0].div_tc_shadow += val;
+			gbhw->ch[0].sweep_ctr = gbhw->ch[0].sweep_tc;
+			if (sweep_check_overflow(gbhw)) {
+				if (gbhw->ch[0].sweep_dir) {
+					gbhw->ch[0].div_tc_shadow += val;
 				} else {
-					gbhw_ch[0].div_tc_shadow -= val;
+					gbhw->ch[0].div_tc_shadow -= val;
 				}
-				gbhw_ch[0].div_tc = gbhw_ch[0].div_tc_shadow;
+				gbhw->ch[0].div_tc = gbhw->ch[0].div_tc_shadow;
 			}
-			gbhw_ch[0].duty_tc = gbhw_ch[0].div_tc*gbhw_ch[0].duty_ctr/8;
+			gbhw->ch[0].duty_tc = gbhw->ch[0].div_tc*gbhw->ch[0].duty_ctr/8;
 		}
 	}
 	for (i=0; clock_len && i<4; i++) {
-		sequencer_update_len(i);
+		sequencer_update_len(gbhw, i);
 	}
 	for (i=0; clock_env && i<4; i++) {
-		if (gbhw_ch[i].env_tc) {
-			gbhw_ch[i].env_ctr--;
-			if (gbhw_ch[i].env_ctr <=0 ) {
-				gbhw_ch[i].env_ctr = gbhw_ch[i].env_tc;
-				if (gbhw_ch[i].running) {
-					if (!gbhw_ch[i].env_dir) {
-						if (gbhw_ch[i].volume > 0)
-							gbhw_ch[i].volume--;
+		if (gbhw->ch[i].env_tc) {
+			gbhw->ch[i].env_ctr--;
+			if (gbhw->ch[i].env_ctr <=0 ) {
+				gbhw->ch[i].env_ctr = gbhw->ch[i].env_tc;
+				if (gbhw->ch[i].running) {
+					if (!gbhw->ch[i].env_dir) {
+						if (gbhw->ch[i].volume > 0)
+							gbhw->ch[i].volume--;
 					} else {
-						if (gbhw_ch[i].volume < 15)
-						gbhw_ch[i].volume++;
+						if (gbhw->ch[i].volume < 15)
+						gbhw->ch[i].volume++;
 					}
 				}
 			}
 		}
 	}
-	if (master_fade) {
-		master_volume += master_fade;
-		if ((master_fade > 0 &&
-		     master_volume >= master_dstvol) ||
-		    (master_fade < 0 &&
-		     master_volume <= master_dstvol)) {
-			master_fade = 0;
-			master_volume = master_dstvol;
+	if (gbhw->master_fade) {
+		gbhw->master_volume += gbhw->master_fade;
+		if ((gbhw->master_fade > 0 &&
+		     gbhw->master_volume >= gbhw->master_dstvol) ||
+		    (gbhw->master_fade < 0 &&
+		     gbhw->master_volume <= gbhw->master_dstvol)) {
+			gbhw->master_fade = 0;
+			gbhw->master_volume = gbhw->master_dstvol;
 		}
 	}
 }
 
-regparm void gbhw_master_fade(long speed, long dstvol)
+regparm void gbhw_master_fade(struct gbhw *gbhw, long speed, long dstvol)
 {
 	if (dstvol < MASTER_VOL_MIN) dstvol = MASTER_VOL_MIN;
 	if (dstvol > MASTER_VOL_MAX) dstvol = MASTER_VOL_MAX;
-	master_dstvol = dstvol;
-	if (dstvol > master_volume)
-		master_fade = speed;
-	else master_fade = -speed;
+	gbhw->master_dstvol = dstvol;
+	if (dstvol > gbhw->master_volume)
+		gbhw->master_fade = speed;
+	else gbhw->master_fade = -speed;
 }
 
 #define GET_NIBBLE(p, n) ({ \
@@ -666,364 +610,675 @@ regparm void gbhw_master_fade(long speed, long dstvol)
 	long shift = (~(n) & 1) << 2; \
 	(((p)[index] >> shift) & 0xf); })
 
-static regparm void gb_flush_buffer(void)
+/*
+ * The impulse buffer is a ring of impbuf_mask+1 samples, followed by
+ * IMPULSE_WIDTH guard samples so that gb_change_level() can add a
+ * step in one go even where it wraps.  impbuf->pos is the ring index
+ * of the first sample not yet flushed and impbuf->cycles counts from
+ * there.  impbuf->samples is how far ahead of pos steps may land.
+ */
+static regparm void gb_flush_buffer(struct gbhw *gbhw)
 {
-	long i;
-	long overlap;
+	long ring = gbhw->impbuf_mask + 1;
+	long i, j, n;
 	long l_smpl, r_smpl;
 	long l_cap, r_cap;
+	long filter;
+	int32_t out[FLUSH_CHUNK*2];
+	int32_t minmax[4];
 
-	assert(soundbuf != NULL);
-	assert(impbuf != NULL);
+	assert(gbhw->soundbuf != NULL);
+	assert(gbhw->impbuf != NULL);
 
 	/* integrate buffer */
-	l_smpl = soundbuf->l_lvl;
-	r_smpl = soundbuf->r_lvl;
-	l_cap = soundbuf->l_cap;
-	r_cap = soundbuf->r_cap;
-	for (i=0; i<soundbuf->samples; i++) {
-		long l_out, r_out;
-		l_smpl = l_smpl + impbuf->data[i*2  ];
-		r_smpl = r_smpl + impbuf->data[i*2+1];
-		if (filter_enabled && cap_factor <= 0x10000) {
-			/*
-			 * RC High-pass & DC decoupling filter. Gameboy
-			 * Classic uses 1uF and 510 Ohms in series,
-			 * followed by 10K Ohms pot to ground between
-			 * CPU output and amplifier input, which gives a
-			 * cutoff frequency of 15.14Hz.
-			 */
-			l_out = l_smpl - (l_cap >> 16);
-			r_out = r_smpl - (r_cap >> 16);
-			/* cap factor is 0x10000 for a factor of 1.0 */
-			l_cap = (l_smpl << 16) - l_out * cap_factor;
-			r_cap = (r_smpl << 16) - r_out * cap_factor;
+	l_smpl = gbhw->soundbuf->l_lvl;
+	r_smpl = gbhw->soundbuf->r_lvl;
+	l_cap = gbhw->soundbuf->l_cap;
+	r_cap = gbhw->soundbuf->r_cap;
+	filter = gbhw->filter_enabled && gbhw->cap_factor <= 0x10000;
+	minmax[0] = gbhw->lminval;
+	minmax[1] = gbhw->lmaxval;
+	minmax[2] = gbhw->rminval;
+	minmax[3] = gbhw->rmaxval;
+
+	/* fold steps that ran into the guard back to the ring start */
+	for (i=0; i<IMPULSE_WIDTH*2; i++) {
+		gbhw->impbuf->data[i] += gbhw->impbuf->data[ring*2 + i];
+		gbhw->impbuf->data[ring*2 + i] = 0;
+	}
+
+	for (i=0; i<gbhw->soundbuf->samples; i+=n) {
+		long idx = (gbhw->impbuf->pos + i) & gbhw->impbuf_mask;
+		int16_t *imp = &gbhw->impbuf->data[idx*2];
+
+		n = gbhw->soundbuf->samples - i;
+		if (n > FLUSH_CHUNK)
+			n = FLUSH_CHUNK;
+		if (n > ring - idx)
+			n = ring - idx;
+		/*
+		 * The integrator and the filter feed back into themselves
+		 * and stay serial, volume scaling and metering are left
+		 * to the vector kernel.
+		 */
+		if (filter) {
+			for (j=0; j<n; j++) {
+				long l_out, r_out;
+				l_smpl = l_smpl + imp[j*2  ];
+				r_smpl = r_smpl + imp[j*2+1];
+				/*
+				 * RC High-pass & DC decoupling filter. Gameboy
+				 * Classic uses 1uF and 510 Ohms in series,
+				 * followed by 10K Ohms pot to ground between
+				 * CPU output and amplifier input, which gives a
+				 * cutoff frequency of 15.14Hz.
+				 */
+				l_out = l_smpl - (l_cap >> 16);
+				r_out = r_smpl - (r_cap >> 16);
+				/* cap factor is 0x10000 for a factor of 1.0 */
+				l_cap = (l_smpl << 16) - l_out * gbhw->cap_factor;
+				r_cap = (r_smpl << 16) - r_out * gbhw->cap_factor;
+				out[j*2  ] = l_out;
+				out[j*2+1] = r_out;
+			}
 		} else {
-			l_out = l_smpl;
-			r_out = r_smpl;
+			for (j=0; j<n; j++) {
+				l_smpl = l_smpl + imp[j*2  ];
+				r_smpl = r_smpl + imp[j*2+1];
+				out[j*2  ] = l_smpl;
+				out[j*2+1] = r_smpl;
+			}
 		}
-		soundbuf->data[i*2  ] = l_out * master_volume / MASTER_VOL_MAX;
-		soundbuf->data[i*2+1] = r_out * master_volume / MASTER_VOL_MAX;
-		if (l_out > lmaxval) lmaxval = l_out;
-		if (l_out < lminval) lminval = l_out;
-		if (r_out > rmaxval) rmaxval = r_out;
-		if (r_out < rminval) rminval = r_out;
+		synth_scale(&gbhw->soundbuf->data[i*2], out, n*2, gbhw->master_volume, minmax);
+		/* consumed, ready to be reused by later steps */
+		memset(imp, 0, n*4);
 	}
-	soundbuf->pos = soundbuf->samples;
-	soundbuf->l_lvl = l_smpl;
-	soundbuf->r_lvl = r_smpl;
-	soundbuf->l_cap = l_cap;
-	soundbuf->r_cap = r_cap;
-
-	if (callback != NULL) callback(soundbuf, callbackpriv);
-
-	overlap = impbuf->samples - soundbuf->samples;
-	memmove(impbuf->data, impbuf->data+(2*soundbuf->samples), 4*overlap);
-	memset(impbuf->data + 2*overlap, 0, impbuf->bytes - 4*overlap);
-	assert(impbuf->bytes == impbuf->samples*4);
-	assert(soundbuf->bytes == soundbuf->samples*4);
-	memset(soundbuf->data, 0, soundbuf->bytes);
-	soundbuf->pos = 0;
-
-	impbuf->cycles -= (sound_div_tc * soundbuf->samples) / SOUND_DIV_MULT;
+	gbhw->lminval = minmax[0];
+	gbhw->lmaxval = minmax[1];
+	gbhw->rminval = minmax[2];
+	gbhw->rmaxval = minmax[3];
+	gbhw->soundbuf->pos = gbhw->soundbuf->samples;
+	gbhw->soundbuf->l_lvl = l_smpl;
+	gbhw->soundbuf->r_lvl = r_smpl;
+	gbhw->soundbuf->l_cap = l_cap;
+	gbhw->soundbuf->r_cap = r_cap;
+
+	if (gbhw->callback != NULL) gbhw->callback(gbhw->soundbuf, gbhw->callbackpriv);
+
+	assert(gbhw->soundbuf->bytes == gbhw->soundbuf->samples*4);
+	gbhw->soundbuf->pos = 0;
+
+	gbhw->impbuf->pos = (gbhw->impbuf->pos + gbhw->soundbuf->samples) & gbhw->impbuf_mask;
+	gbhw->impbuf->cycles -= (gbhw->sound_div_tc * gbhw->soundbuf->samples) / SOUND_DIV_MULT;
 }
 
-static regparm void gb_change_level(long l_ofs, long r_ofs)
+static regparm void gb_change_level(struct gbhw *gbhw, long l_ofs, long r_ofs)
 {
+	long long phase;
 	long pos;
 	long imp_idx;
-	long imp_l = -IMPULSE_WIDTH/2;
-	long imp_r = IMPULSE_WIDTH/2;
-	long i;
-	const short *ptr = base_impulse;
 
-	assert(impbuf != NULL);
-	pos = (long)(impbuf->cycles * SOUND_DIV_MULT / sound_div_tc);
-	imp_idx = (long)((impbuf->cycles << IMPULSE_N_SHIFT)*SOUND_DIV_MULT / sound_div_tc) & IMPULSE_N_MASK;
-	assert(pos + imp_r < impbuf->samples);
-	assert(pos + imp_l >= 0);
+	assert(gbhw->impbuf != NULL);
+	/* sample position and impulse phase from a single division */
+	phase = (gbhw->impbuf->cycles << IMPULSE_N_SHIFT)*SOUND_DIV_MULT / gbhw->sound_div_tc;
+	pos = (long)(phase >> IMPULSE_N_SHIFT);
+	imp_idx = (long)phase & IMPULSE_N_MASK;
+	assert(pos + IMPULSE_WIDTH/2 < gbhw->impbuf->samples);
+	assert(pos - IMPULSE_WIDTH/2 >= 0);
+
+	pos = (gbhw->impbuf->pos + pos - IMPULSE_WIDTH/2) & gbhw->impbuf_mask;
+	synth_step(&gbhw->impbuf->data[pos*2],
+	           &base_impulse[imp_idx * IMPULSE_WIDTH],
+	           IMPULSE_WIDTH, l_ofs, r_ofs);
+
+	gbhw->impbuf->l_lvl += l_ofs*256;
+	gbhw->impbuf->r_lvl += r_ofs*256;
+}
+
+/*
+ * Number of cycles until the next cycle on which gb_sound() has
+ * something to do: a buffer flush, a channel 3/4 divider expiring,
+ * the main divider tick or a pending level update.  Always >= 1.
+ */
+static regparm long gb_sound_next_event(struct gbhw *gbhw)
+{
+	long long flush_at;
+	long next;
 
-	ptr += imp_idx * IMPULSE_WIDTH;
+	if (gbhw->update_level)
+		return 1;
 
-	for (i=imp_l; i<imp_r; i++) {
-		long bufi = pos + i;
-		long impi = i + IMPULSE_WIDTH/2;
-		impbuf->data[bufi*2  ] += ptr[impi] * l_ofs;
-		impbuf->data[bufi*2+1] += ptr[impi] * r_ofs;
-	}
+	next = main_div_tc + 1 - gbhw->main_div;
+
+	flush_at = gbhw->sound_div_tc*(gbhw->impbuf->samples - IMPULSE_WIDTH/2);
+	flush_at = (flush_at + SOUND_DIV_MULT - 1) / SOUND_DIV_MULT;
+	if (flush_at - gbhw->impbuf->cycles < next)
+		next = flush_at - gbhw->impbuf->cycles;
 
-	impbuf->l_lvl += l_ofs*256;
-	impbuf->r_lvl += r_ofs*256;
+	if (gbhw->ch[2].running && gbhw->ch[2].div_ctr < next)
+		next = gbhw->ch[2].div_ctr;
+	if (gbhw->ch[3].running && gbhw->ch[3].div_ctr < next)
+		next = gbhw->ch[3].div_ctr;
+
+	return next < 1 ? 1 : next;
 }
 
-static regparm void gb_sound(long cycles)
+/*
+ * Advance the APU by the given number of cycles.  Cycles on which
+ * nothing can change are skipped in one go, only event cycles as
+ * reported by gb_sound_next_event() are stepped individually.
+ */
+static regparm void gb_sound(struct gbhw *gbhw, long cycles)
 {
-	long i, j;
+	long i;
 	long l_lvl = 0, r_lvl = 0;
 
-	assert(impbuf != NULL);
-
-	for (j=0; j<cycles; j++) {
-		main_div++;
-		impbuf->cycles++;
-		if (impbuf->cycles*SOUND_DIV_MULT >= sound_div_tc*(impbuf->samples - IMPULSE_WIDTH/2))
-			gb_flush_buffer();
-
-		if (gbhw_ch[2].running) {
-			gbhw_ch[2].div_ctr--;
-			if (gbhw_ch[2].div_ctr <= 0) {
-				long val = ch3_next_nibble;
-				long pos = ch3pos++;
-				ch3_next_nibble = GET_NIBBLE(&ioregs[0x30], pos) * 2;
-				gbhw_ch[2].div_ctr = gbhw_ch[2].div_tc*2;
-				if (gbhw_ch[2].volume) {
-					val = val >> (gbhw_ch[2].volume-1);
+	assert(gbhw->impbuf != NULL);
+
+	while (cycles > 0) {
+		long skip = gb_sound_next_event(gbhw) - 1;
+
+		if (skip >= cycles) {
+			skip = cycles;
+		}
+		gbhw->main_div += skip;
+		gbhw->impbuf->cycles += skip;
+		if (gbhw->ch[2].running)
+			gbhw->ch[2].div_ctr -= skip;
+		if (gbhw->ch[3].running)
+			gbhw->ch[3].div_ctr -= skip;
+		cycles -= skip;
+		if (cycles == 0)
+			break;
+		cycles--;
+
+		gbhw->main_div++;
+		gbhw->impbuf->cycles++;
+		if (gbhw->impbuf->cycles*SOUND_DIV_MULT >= gbhw->sound_div_tc*(gbhw->impbuf->samples - IMPULSE_WIDTH/2))
+			gb_flush_buffer(gbhw);
+
+		if (gbhw->ch[2].running) {
+			gbhw->ch[2].div_ctr--;
+			if (gbhw->ch[2].div_ctr <= 0) {
+				long val = gbhw->ch3_next_nibble;
+				long pos = gbhw->ch3pos++;
+				gbhw->ch3_next_nibble = GET_NIBBLE(&gbhw->ioregs[0x30], pos) * 2;
+				gbhw->ch[2].div_ctr = gbhw->ch[2].div_tc*2;
+				if (gbhw->ch[2].volume) {
+					val = val >> (gbhw->ch[2].volume-1);
 				} else val = 0;
-				gbhw_ch[2].lvl = val - 15;
-				update_level = 1;
+				gbhw->ch[2].lvl = val - 15;
+				gbhw->update_level = 1;
 			}
 		}
 
-		if (gbhw_ch[3].running) {
-			gbhw_ch[3].div_ctr--;
-			if (gbhw_ch[3].div_ctr <= 0) {
+		if (gbhw->ch[3].running) {
+			gbhw->ch[3].div_ctr--;
+			if (gbhw->ch[3].div_ctr <= 0) {
 				long val;
-				gbhw_ch[3].div_ctr = gbhw_ch[3].div_tc;
-				lfsr = (lfsr << 1) | (((lfsr & tap1) > 0) ^ ((lfsr & tap2) > 0));
-				val = gbhw_ch[3].volume * 2 * (!(lfsr & tap1));
-				gbhw_ch[3].lvl = val - 15;
-				update_level = 1;
+				gbhw->ch[3].div_ctr = gbhw->ch[3].div_tc;
+				gbhw->lfsr = (gbhw->lfsr << 1) | (((gbhw->lfsr & gbhw->tap1) > 0) ^ ((gbhw->lfsr & gbhw->tap2) > 0));
+				val = gbhw->ch[3].volume * 2 * (!(gbhw->lfsr & gbhw->tap1));
+				gbhw->ch[3].lvl = val - 15;
+				gbhw->update_level = 1;
 			}
 		}
 
-		if (main_div > main_div_tc) {
-			main_div -= main_div_tc;
+		if (gbhw->main_div > main_div_tc) {
+			gbhw->main_div -= main_div_tc;
 
-			for (i=0; i<2; i++) if (gbhw_ch[i].running) {
-				long val = 2 * gbhw_ch[i].volume;
-				if (gbhw_ch[i].div_ctr > gbhw_ch[i].duty_tc) {
+			for (i=0; i<2; i++) if (gbhw->ch[i].running) {
+				long val = 2 * gbhw->ch[i].volume;
+				if (gbhw->ch[i].div_ctr > gbhw->ch[i].duty_tc) {
 					val = 0;
 				}
-				gbhw_ch[i].lvl = val - 15;
-				gbhw_ch[i].div_ctr--;
-				if (gbhw_ch[i].div_ctr <= 0) {
-					gbhw_ch[i].div_ctr = gbhw_ch[i].div_tc;
+				gbhw->ch[i].lvl = val - 15;
+				gbhw->ch[i].div_ctr--;
+				if (gbhw->ch[i].div_ctr <= 0) {
+					gbhw->ch[i].div_ctr = gbhw->ch[i].div_tc;
 				}
 			}
 
-			sweep_div += 1;
-			if (sweep_div >= sweep_div_tc) {
-				sweep_div = 0;
-				sequencer_step();
+			gbhw->sweep_div += 1;
+			if (gbhw->sweep_div >= sweep_div_tc) {
+				gbhw->sweep_div = 0;
+				sequencer_step(gbhw);
 			}
-			update_level = 1;
+			gbhw->update_level = 1;
 		}
 
-		if (update_level) {
-			update_level = 0;
+		if (gbhw->update_level) {
+			gbhw->update_level = 0;
 			l_lvl = 0;
 			r_lvl = 0;
 			for (i=0; i<4; i++) {
-				if (gbhw_ch[i].mute)
+				if (gbhw->ch[i].mute)
 					continue;
-				if (gbhw_ch[i].leftgate)
-					l_lvl += gbhw_ch[i].lvl;
-				if (gbhw_ch[i].rightgate)
-					r_lvl += gbhw_ch[i].lvl;
+				if (gbhw->ch[i].leftgate)
+					l_lvl += gbhw->ch[i].lvl;
+				if (gbhw->ch[i].rightgate)
+					r_lvl += gbhw->ch[i].lvl;
 			}
 
-			if (l_lvl != last_l_value || r_lvl != last_r_value) {
-				gb_change_level(l_lvl - last_l_value, r_lvl - last_r_value);
-				last_l_value = l_lvl;
-				last_r_value = r_lvl;
+			if (l_lvl != gbhw->last_l_value || r_lvl != gbhw->last_r_value) {
+				gb_change_level(gbhw, l_lvl - gbhw->last_l_value, r_lvl - gbhw->last_r_value);
+				gbhw->last_l_value = l_lvl;
+				gbhw->last_r_value = r_lvl;
 			}
 		}
 	}
 }
 
-regparm void gbhw_setcallback(gbhw_callback_fn fn, void *priv)
+/*
+ * Count down a divider by steps the way gb_sound() does one step at a
+ * time, reloading it with tc whenever it runs out.  Returns how often
+ * it ran out.
+ */
+static regparm long gb_div_expire(long *ctr, long tc, long steps)
 {
-	callback = fn;
-	callbackpriv = priv;
+	long first = *ctr > 1 ? *ctr : 1;
+
+	if (tc < 1)
+		tc = 1;
+	if (steps < first) {
+		*ctr -= steps;
+		return 0;
+	}
+	steps -= first;
+	*ctr = tc - steps % tc;
+	return 1 + steps / tc;
 }
 
-regparm void gbhw_setiocallback(gbhw_iocallback_fn fn, void *priv)
+/*
+ * Meter range for gbhw_setaudio(gbhw, 0): a running channel with a
+ * non-zero volume counts with the whole range it can swing through.
+ */
+static regparm void gb_sound_meter(struct gbhw *gbhw)
 {
-	iocallback = fn;
-	iocallback_priv = priv;
+	long lo[2] = { 0, 0 }, hi[2] = { 0, 0 };
+	long i, side;
+
+	for (i=0; i<4; i++) {
+		long l = gbhw->ch[i].lvl, h = l;
+		if (gbhw->ch[i].mute)
+			continue;
+		if (gbhw->ch[i].running && gbhw->ch[i].volume) {
+			l = -15;
+			h = (i == 2 ? 30 >> (gbhw->ch[i].volume-1) : 2 * gbhw->ch[i].volume) - 15;
+		}
+		for (side=0; side<2; side++) {
+			if (side ? gbhw->ch[i].rightgate : gbhw->ch[i].leftgate) {
+				lo[side] += l;
+				hi[side] += h;
+			}
+		}
+	}
+	if (lo[0] < gbhw->lminval) gbhw->lminval = lo[0];
+	if (hi[0] > gbhw->lmaxval) gbhw->lmaxval = hi[0];
+	if (lo[1] < gbhw->rminval) gbhw->rminval = lo[1];
+	if (hi[1] > gbhw->rmaxval) gbhw->rmaxval = hi[1];
 }
 
-regparm void gbhw_setstepcallback(gbhw_stepcallback_fn fn, void *priv)
+/*
+ * gb_sound() without any synthesis for gbhw_setaudio(gbhw, 0).  The
+ * channel and sequencer state ends up the same, but is advanced from
+ * one frame sequencer step to the next in one go: the divider steps in
+ * between only matter for the output levels, which are caught up for
+ * the last one.
+ */
+static regparm void gb_sound_noaudio(struct gbhw *gbhw, long cycles)
 {
-	stepcallback = fn;
-	stepcallback_priv = priv;
+	while (cycles > 0) {
+		long first = main_div_tc + 1 - gbhw->main_div;
+		long skip = first + (sweep_div_tc - gbhw->sweep_div - 1) * main_div_tc;
+		long ticks, n, i;
+
+		if (skip > cycles)
+			skip = cycles;
+		ticks = skip < first ? 0 : 1 + (skip - first) / main_div_tc;
+		gbhw->main_div += skip - ticks * main_div_tc;
+		cycles -= skip;
+
+		if (gbhw->ch[2].running &&
+		    (n = gb_div_expire(&gbhw->ch[2].div_ctr, gbhw->ch[2].div_tc*2, skip)) > 0) {
+			long val = gbhw->ch3_next_nibble;
+			if (n > 1)
+				val = GET_NIBBLE(&gbhw->ioregs[0x30], gbhw->ch3pos + n - 2) * 2;
+			gbhw->ch3pos += n;
+			gbhw->ch3_next_nibble = GET_NIBBLE(&gbhw->ioregs[0x30], gbhw->ch3pos - 1) * 2;
+			if (gbhw->ch[2].volume) {
+				val = val >> (gbhw->ch[2].volume-1);
+			} else val = 0;
+			gbhw->ch[2].lvl = val - 15;
+		}
+
+		if (gbhw->ch[3].running &&
+		    (n = gb_div_expire(&gbhw->ch[3].div_ctr, gbhw->ch[3].div_tc, skip)) > 0) {
+			long val;
+			while (n-- > 0)
+				gbhw->lfsr = (gbhw->lfsr << 1) | (((gbhw->lfsr & gbhw->tap1) > 0) ^ ((gbhw->lfsr & gbhw->tap2) > 0));
+			val = gbhw->ch[3].volume * 2 * (!(gbhw->lfsr & gbhw->tap1));
+			gbhw->ch[3].lvl = val - 15;
+		}
+
+		if (ticks == 0)
+			continue;
+		for (i=0; i<2; i++) if (gbhw->ch[i].running) {
+			long val = 2 * gbhw->ch[i].volume;
+			gb_div_expire(&gbhw->ch[i].div_ctr, gbhw->ch[i].div_tc, ticks - 1);
+			if (gbhw->ch[i].div_ctr > gbhw->ch[i].duty_tc) {
+				val = 0;
+			}
+			gbhw->ch[i].lvl = val - 15;
+			gb_div_expire(&gbhw->ch[i].div_ctr, gbhw->ch[i].div_tc, 1);
+		}
+
+		gbhw->sweep_div += ticks;
+		if (gbhw->sweep_div >= sweep_div_tc) {
+			gbhw->sweep_div = 0;
+			sequencer_step(gbhw);
+		}
+		gb_sound_meter(gbhw);
+	}
 }
 
-static regparm void gbhw_impbuf_reset(struct gbhw_buffer *impbuf)
+/* Advance vblank, cycle counter and sound by cycles executed by the cpu. */
+static regparm void gbhw_account(struct gbhw *gbhw, long cycles)
 {
-	assert(sound_div_tc != 0);
-	impbuf->cycles = (long)(sound_div_tc * IMPULSE_WIDTH/2 / SOUND_DIV_MULT);
-	impbuf->l_lvl = 0;
-	impbuf->r_lvl = 0;
-	memset(impbuf->data, 0, impbuf->bytes);
+	if (cycles == 0)
+		return;
+	gbhw->sum_cycles += cycles;
+	gbhw->vblankctr -= cycles;
+	if (gbhw->vblankctr <= 0) {
+		gbhw->vblankctr += vblanktc;
+		gbhw->ioregs[REG_IF] |= 0x01;
+		DPRINTF("vblank_interrupt\n");
+	}
+	if (gbhw->audio_off)
+		gb_sound_noaudio(gbhw, cycles);
+	else gb_sound(gbhw, cycles);
 }
 
-regparm void gbhw_setbuffer(struct gbhw_buffer *buffer)
+/*
+ * Sync callback for gbcpu_run(): IO registers depend on the current
+ * time, so pending cycles have to be accounted before they are
+ * accessed.  High RAM does not care.
+ */
+static regparm long gbhw_sync(void *priv, uint32_t addr, long cycles)
 {
-	soundbuf = buffer;
-	soundbuf->samples = soundbuf->bytes / 4;
+	struct gbhw *gbhw = priv;
 
-	if (impbuf) free(impbuf);
-	impbuf = malloc(sizeof(*impbuf) + (soundbuf->samples + IMPULSE_WIDTH + 1) * 4);
-	if (impbuf == NULL) {
+	if (addr >= 0xff80 && addr <= 0xfffe)
+		return 0;
+	gbhw_account(gbhw, cycles);
+	return 1;
+}
+
+regparm void gbhw_setcallback(struct gbhw *gbhw, gbhw_callback_fn fn, void *priv)
+{
+	gbhw->callback = fn;
+	gbhw->callbackpriv = priv;
+}
+
+regparm void gbhw_setiocallback(struct gbhw *gbhw, gbhw_iocallback_fn fn, void *priv)
+{
+	gbhw->iocallback = fn;
+	gbhw->iocallback_priv = priv;
+}
+
+regparm void gbhw_setstepcallback(struct gbhw *gbhw, gbhw_stepcallback_fn fn, void *priv)
+{
+	gbhw->stepcallback = fn;
+	gbhw->stepcallback_priv = priv;
+}
+
+/*
+ * With a player set the cpu does not run at all, the player writes
+ * the registers itself at the right cycle.  Internal for gbs.c, not
+ * exported from libgbs.
+ */
+regparm void gbhw_setplayer(struct gbhw *gbhw, gbhw_player_fn fn, void *priv)
+{
+	gbhw->player = fn;
+	gbhw->player_priv = priv;
+}
+
+static regparm void gbhw_impbuf_reset(struct gbhw *gbhw)
+{
+	assert(gbhw->sound_div_tc != 0);
+	gbhw->impbuf->cycles = (long)(gbhw->sound_div_tc * IMPULSE_WIDTH/2 / SOUND_DIV_MULT);
+	gbhw->impbuf->l_lvl = 0;
+	gbhw->impbuf->r_lvl = 0;
+	gbhw->impbuf->pos = 0;
+	memset(gbhw->impbuf->data, 0, gbhw->impbuf->bytes);
+}
+
+regparm void gbhw_setbuffer(struct gbhw *gbhw, struct gbhw_buffer *buffer)
+{
+	long ring = 1;
+
+	gbhw->soundbuf = buffer;
+	gbhw->soundbuf->samples = gbhw->soundbuf->bytes / 4;
+
+	while (ring < gbhw->soundbuf->samples + IMPULSE_WIDTH + 1)
+		ring <<= 1;
+	gbhw->impbuf_mask = ring - 1;
+
+	if (gbhw->impbuf) free(gbhw->impbuf);
+	gbhw->impbuf = malloc(sizeof(*gbhw->impbuf) + (ring + IMPULSE_WIDTH) * 4);
+	if (gbhw->impbuf == NULL) {
 		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
 		return;
 	}
-	memset(impbuf, 0, sizeof(*impbuf));
-	impbuf->data = (void*)(impbuf+1);
-	impbuf->samples = soundbuf->samples + IMPULSE_WIDTH + 1;
-	impbuf->bytes = impbuf->samples * 4;
-	gbhw_impbuf_reset(impbuf);
+	memset(gbhw->impbuf, 0, sizeof(*gbhw->impbuf));
+	gbhw->impbuf->data = (void*)(gbhw->impbuf+1);
+	gbhw->impbuf->samples = gbhw->soundbuf->samples + IMPULSE_WIDTH + 1;
+	gbhw->impbuf->bytes = (ring + IMPULSE_WIDTH) * 4;
+	gbhw->render_pending = 0;
+	gbhw_impbuf_reset(gbhw);
 }
 
-static void gbhw_update_filter()
+/*
+ * Turn sound synthesis and output on or off.  While it is off, the
+ * channels and the sequencer are emulated but nothing is rendered or
+ * passed to the callback and no output buffer is needed, for analysis
+ * passes that only want the register and channel state.
+ */
+regparm void gbhw_setaudio(struct gbhw *gbhw, long enabled)
 {
-	double cap_constant = pow(filter_constant, (double)GBHW_CLOCK / sample_rate);
-	cap_factor = round(65536.0 * cap_constant);
+	if ((!enabled) == gbhw->audio_off)
+		return;
+	gbhw->audio_off = !enabled;
+	if (enabled && gbhw->impbuf) {
+		gbhw_impbuf_reset(gbhw);
+		gbhw->render_pending = 0;
+		gbhw->update_level = 1;
+	}
 }
 
-regparm long gbhw_setfilter(const char *type)
+static void gbhw_update_filter(struct gbhw *gbhw)
+{
+	double cap_constant = pow(gbhw->filter_constant, (double)GBHW_CLOCK / gbhw->sample_rate);
+	gbhw->cap_factor = round(65536.0 * cap_constant);
+}
+
+regparm long gbhw_setfilter(struct gbhw *gbhw, const char *type)
 {
 	if (strcasecmp(type, GBHW_CFG_FILTER_OFF) == 0) {
-		filter_enabled = 0;
-		filter_constant = GBHW_FILTER_CONST_OFF;
+		gbhw->filter_enabled = 0;
+		gbhw->filter_constant = GBHW_FILTER_CONST_OFF;
 	} else if (strcasecmp(type, GBHW_CFG_FILTER_DMG) == 0) {
-		filter_enabled = 1;
-		filter_constant = GBHW_FILTER_CONST_DMG;
+		gbhw->filter_enabled = 1;
+		gbhw->filter_constant = GBHW_FILTER_CONST_DMG;
 	} else if (strcasecmp(type, GBHW_CFG_FILTER_CGB) == 0) {
-		filter_enabled = 1;
-		filter_constant = GBHW_FILTER_CONST_CGB;
+		gbhw->filter_enabled = 1;
+		gbhw->filter_constant = GBHW_FILTER_CONST_CGB;
 	} else {
 		return 0;
 	}
 
-	gbhw_update_filter();
+	gbhw_update_filter(gbhw);
 
 	return 1;
 }
 
-regparm void gbhw_setrate(long rate)
+regparm void gbhw_setrate(struct gbhw *gbhw, long rate)
 {
-	sample_rate = rate;
-	sound_div_tc = GBHW_CLOCK*SOUND_DIV_MULT/rate;
-	gbhw_update_filter();
+	gbhw->sample_rate = rate;
+	gbhw->sound_div_tc = GBHW_CLOCK*SOUND_DIV_MULT/rate;
+	gbhw_update_filter(gbhw);
 }
 
-regparm void gbhw_getminmax(int16_t *lmin, int16_t *lmax, int16_t *rmin, int16_t *rmax)
+regparm void gbhw_getminmax(struct gbhw *gbhw, int16_t *lmin, int16_t *lmax, int16_t *rmin, int16_t *rmax)
 {
-	if (lminval == INT_MAX) return;
-	*lmin = lminval;
-	*lmax = lmaxval;
-	*rmin = rminval;
-	*rmax = rmaxval;
-	lminval = rminval = INT_MAX;
-	lmaxval = rmaxval = INT_MIN;
+	if (gbhw->lminval == INT_MAX) return;
+	*lmin = gbhw->lminval;
+	*lmax = gbhw->lmaxval;
+	*rmin = gbhw->rminval;
+	*rmax = gbhw->rmaxval;
+	gbhw->lminval = gbhw->rminval = INT_MAX;
+	gbhw->lmaxval = gbhw->rmaxval = INT_MIN;
 }
 
 /*
  * Initialize Gameboy hardware emulation.
  * The size should be a multiple of 0x4000,
- * so we don't need range checking in rom_get and
- * rombank_get.
+ * so we don't need range checking for the
+ * mapped ROM banks.
  */
-regparm void gbhw_init(uint8_t *rombuf, uint32_t size)
+regparm void gbhw_init(struct gbhw *gbhw, uint8_t *rombuf, uint32_t size)
 {
 	long i;
 
-	vblankctr = vblanktc;
-	timerctr = 0;
-
-	if (impbuf)
-		gbhw_impbuf_reset(impbuf);
-	rom = rombuf;
-	lastbank = ((size + 0x3fff) / 0x4000) - 1;
-	rombank = 1;
-	master_volume = MASTER_VOL_MAX;
-	master_fade = 0;
-	apu_on = 1;
-	if (soundbuf) {
-		soundbuf->pos = 0;
-		soundbuf->l_lvl = 0;
-		soundbuf->r_lvl = 0;
-		soundbuf->l_cap = 0;
-		soundbuf->r_cap = 0;
+	gbhw->vblankctr = vblanktc;
+	gbhw->timerctr = 0;
+
+	if (gbhw->impbuf)
+		gbhw_impbuf_reset(gbhw);
+	gbhw->render_pending = 0;
+	gbhw->step_surplus = 0;
+	gbhw->rom = rombuf;
+	gbhw->lastbank = ((size + 0x3fff) / 0x4000) - 1;
+	/* like rom_put(), a single bank rom is also mapped at 0x4000 */
+	gbhw->rombank = gbhw->lastbank > 0;
+	gbhw->master_volume = MASTER_VOL_MAX;
+	gbhw->master_fade = 0;
+	gbhw->apu_on = 1;
+	if (gbhw->soundbuf) {
+		gbhw->soundbuf->pos = 0;
+		gbhw->soundbuf->l_lvl = 0;
+		gbhw->soundbuf->r_lvl = 0;
+		gbhw->soundbuf->l_cap = 0;
+		gbhw->soundbuf->r_cap = 0;
 	}
-	lminval = rminval = INT_MAX;
-	lmaxval = rmaxval = INT_MIN;
-	apu_reset();
-	memset(extram, 0, sizeof(extram));
-	memset(intram, 0, sizeof(intram));
-	memset(hiram, 0, sizeof(hiram));
-	memset(ioregs, 0, sizeof(ioregs));
+	gbhw->lminval = gbhw->rminval = INT_MAX;
+	gbhw->lmaxval = gbhw->rmaxval = INT_MIN;
+	apu_reset(gbhw);
+	memset(gbhw->extram, 0, sizeof(gbhw->extram));
+	memset(gbhw->intram, 0, sizeof(gbhw->intram));
+	memset(gbhw->hiram, 0, sizeof(gbhw->hiram));
+	memset(gbhw->ioregs, 0, sizeof(gbhw->ioregs));
 	for (i=0x10; i<0x40; i++) {
-		io_put(0xff00 + i, ioregs_initdata[i]);
+		io_put(gbhw, 0xff00 + i, ioregs_initdata[i]);
 	}
 
-	sum_cycles = 0;
-	halted_noirq_cycles = 0;
-	ch3pos = 0;
-	ch3_next_nibble = 0;
-	last_l_value = 0;
-	last_r_value = 0;
-
-	gbcpu_init();
-	gbcpu_addmem(0x00, 0x3f, rom_put, rom_get);
-	gbcpu_addmem(0x40, 0x7f, rom_put, rombank_get);
-	gbcpu_addmem(0xa0, 0xbf, extram_put, extram_get);
-	gbcpu_addmem(0xc0, 0xfe, intram_put, intram_get);
-	gbcpu_addmem(0xff, 0xff, io_put, io_get);
+	gbhw->sum_cycles = 0;
+	gbhw->idle_cycles = 0;
+	gbhw->halted_noirq_cycles = 0;
+	gbhw->ch3pos = 0;
+	gbhw->ch3_next_nibble = 0;
+	gbhw->last_l_value = 0;
+	gbhw->last_r_value = 0;
+
+	gbcpu_init(&gbhw->gbcpu);
+	gbcpu_addmem(&gbhw->gbcpu, 0x00, 0x7f, rom_put, NULL, gbhw);
+	gbcpu_addmem(&gbhw->gbcpu, 0xff, 0xff, io_put, io_get, gbhw);
+	gbcpu_mapmem(&gbhw->gbcpu, 0xa0, 0xbf, gbhw->extram, gbhw->extram);
+	gbcpu_mapmem(&gbhw->gbcpu, 0xc0, 0xdf, gbhw->intram, gbhw->intram);
+	gbcpu_mapmem(&gbhw->gbcpu, 0xe0, 0xfe, gbhw->intram, gbhw->intram);
+	/*
+	 * Internal RAM is not cached as code, writes to its echo at
+	 * 0xe000 would not invalidate blocks decoded at 0xc000.
+	 */
+	gbcpu_addcode(&gbhw->gbcpu, 0x00, 0x3f, GBCPU_CODE_ROM);
+	gbcpu_addcode(&gbhw->gbcpu, 0x40, 0x7f, GBCPU_CODE_BANKED);
+	gbcpu_addcode(&gbhw->gbcpu, 0xa0, 0xbf, GBCPU_CODE_RAM);
+	gbcpu_addsync(&gbhw->gbcpu, 0xff, 0xff, gbhw_sync, gbhw);
+	gbhw_map_rom(gbhw);
+}
+
+/*
+ * Set up a freshly allocated (zeroed) instance with the
+ * defaults that do not depend on the loaded ROM.
+ */
+regparm void gbhw_init_struct(struct gbhw *gbhw)
+{
+	gbhw->rombank = 1;
+	gbhw->apu_on = 1;
+	gbhw->filter_constant = GBHW_FILTER_CONST_DMG;
+	gbhw->filter_enabled = 1;
+	gbhw->cap_factor = 0x10000;
+	gbhw->timertc = 16;
+	gbhw->rom_lockout = 1;
+	gbhw->tap1 = TAP1_15;
+	gbhw->tap2 = TAP2_15;
+	gbhw->lfsr = 0xffffffff;
+	synth_init();
+}
+
+/* Release resources held by the instance, the struct itself is not freed. */
+regparm void gbhw_cleanup(struct gbhw *gbhw)
+{
+	linkport_write(gbhw, -1);
+	free(gbhw->impbuf);
+	gbhw->impbuf = NULL;
+	if (gbhw->soundbuf == &gbhw->renderbuf) {
+		free(gbhw->renderbuf.data);
+		gbhw->renderbuf.data = NULL;
+		gbhw->soundbuf = NULL;
+	}
 }
 
-regparm void gbhw_enable_bootrom(const uint8_t *rombuf)
+regparm void gbhw_enable_bootrom(struct gbhw *gbhw, const uint8_t *rombuf)
 {
-	memcpy(boot_rom, rombuf, sizeof(boot_rom));
-	rom_lockout = 0;
+	memcpy(gbhw->boot_rom, rombuf, sizeof(gbhw->boot_rom));
+	gbhw->rom_lockout = 0;
 }
 
 /* internal for gbs.c, not exported from libgbs */
-regparm void gbhw_io_put(uint16_t addr, uint8_t val) {
+regparm void gbhw_io_put(struct gbhw *gbhw, uint16_t addr, uint8_t val) {
 	if (addr != 0xffff && (addr < 0xff00 || addr > 0xff7f))
 		return;
-	io_put(addr, val);
+	io_put(gbhw, addr, val);
 }
 
 /* unmasked peek used by gbsplay.c to print regs */
-regparm uint8_t gbhw_io_peek(uint16_t addr)
+regparm uint8_t gbhw_io_peek(struct gbhw *gbhw, uint16_t addr)
 {
 	if (addr >= 0xff10 && addr <= 0xff3f) {
-		return ioregs[addr & 0x7f];
+		return gbhw->ioregs[addr & 0x7f];
 	}
 	return 0xff;
 }
 
 
-regparm void gbhw_check_if(void)
+regparm void gbhw_check_if(struct gbhw *gbhw)
 {
 	uint8_t mask = 0x01; /* lowest bit is highest priority irq */
 	uint8_t vec = 0x40;
-	if (!gbcpu_if) {
+	if (!gbhw->gbcpu.if_flag) {
 		/* interrupts disabled */
-		if (ioregs[REG_IF] & ioregs[REG_IE]) {
+		if (gbhw->ioregs[REG_IF] & gbhw->ioregs[REG_IE]) {
 			/* but will still exit halt */
-			gbcpu_halted = 0;
+			gbhw->gbcpu.halted = 0;
 		}
 		return;
 	}
 	while (mask <= 0x10) {
-		if (ioregs[REG_IF] & ioregs[REG_IE] & mask) {
-			ioregs[REG_IF] &= ~mask;
-			gbcpu_halted = 0;
-			gbcpu_intr(vec);
+		if (gbhw->ioregs[REG_IF] & gbhw->ioregs[REG_IE] & mask) {
+			gbhw->ioregs[REG_IF] &= ~mask;
+			gbhw->gbcpu.halted = 0;
+			gbcpu_intr(&gbhw->gbcpu, vec);
 			break;
 		}
 		vec += 0x08;
@@ -1031,21 +1286,21 @@ regparm void gbhw_check_if(void)
 	}
 }
 
-static regparm void blargg_debug(void)
+static regparm void blargg_debug(struct gbhw *gbhw)
 {
 	long i;
 
 	/* Blargg GB debug output signature. */
-	if (gbcpu_mem_get(0xa001) != 0xde ||
-	    gbcpu_mem_get(0xa002) != 0xb0 ||
-	    gbcpu_mem_get(0xa003) != 0x61) {
+	if (gbcpu_mem_get(&gbhw->gbcpu, 0xa001) != 0xde ||
+	    gbcpu_mem_get(&gbhw->gbcpu, 0xa002) != 0xb0 ||
+	    gbcpu_mem_get(&gbhw->gbcpu, 0xa003) != 0x61) {
 		return;
 	}
 
 	fprintf(stderr, "\nBlargg debug output:\n");
 
 	for (i = 0xa004; i < 0xb000; i++) {
-		uint8_t c = gbcpu_mem_get(i);
+		uint8_t c = gbcpu_mem_get(&gbhw->gbcpu, i);
 		if (c == 0 || c >= 128) {
 			return;
 		}
@@ -1056,68 +1311,295 @@ static regparm void blargg_debug(void)
 	}
 }
 
-/**
- * @param time_to_work  emulated time in milliseconds
- * @return  elapsed cpu cycles
+#define IDLE_MAX_OPS 4
+
+struct idle_loop {
+	uint32_t addr;	/* polled register */
+	long read_cycles;	/* cycles of the read instruction */
+	long period;	/* cycles per iteration */
+	long cond;	/* branch condition as in the opcode */
+	long n;
+	uint8_t op[IDLE_MAX_OPS];
+	uint8_t imm[IDLE_MAX_OPS];
+};
+
+/*
+ * Recognize a loop polling STAT or LY at pc, e.g.
+ *
+ *	wait:	ldh a, (0x44)
+ *		cp 0x90
+ *		jr nz, wait
+ *
+ * with pc pointing just behind the read.  Only a few ALU operations
+ * on A, which do not depend on the flags, may sit between the read and
+ * the conditional branch back.
  */
-regparm long gbhw_step(long time_to_work)
+static regparm long idle_loop_find(struct gbhw *gbhw, struct idle_loop *l)
 {
-	long cycles_total = 0;
+	struct gbcpu *gbcpu = &gbhw->gbcpu;
+	uint32_t pc = REGS16_R(gbcpu->regs, PC);
+	uint32_t addr = pc;
+	uint32_t head;
+	uint32_t start;
+	uint8_t op;
+
+	l->n = 0;
+	l->period = 0;
+	for (;;) {
+		op = gbcpu_peek(gbcpu, addr);
+		if (op == 0xcb) {
+			/* BIT n, A */
+			l->imm[l->n] = gbcpu_peek(gbcpu, addr + 1);
+			if ((l->imm[l->n] & 0xc7) != 0x47)
+				break;
+		} else if (op == 0xfe || op == 0xe6 || op == 0xf6 || op == 0xee) {
+			/* CP/AND/OR/XOR imm */
+			l->imm[l->n] = gbcpu_peek(gbcpu, addr + 1);
+		} else {
+			break;
+		}
+		if (l->n == IDLE_MAX_OPS)
+			return 0;
+		l->op[l->n++] = op;
+		l->period += 8;
+		addr += 2;
+	}
 
-	if (pause_output) {
-		(void)usleep(time_to_work*1000);
+	if ((op & 0xe7) == 0x20) {
+		/* JR cc */
+		head = addr + 2 + (int8_t)gbcpu_peek(gbcpu, addr + 1);
+		l->period += 12;
+		addr += 2;
+	} else if ((op & 0xe7) == 0xc2) {
+		/* JP cc */
+		head = gbcpu_peek(gbcpu, addr + 1) | gbcpu_peek(gbcpu, addr + 2) << 8;
+		l->period += 16;
+		addr += 3;
+	} else {
+		return 0;
+	}
+	l->cond = (op >> 3) & 3;
+	head &= 0xffff;
+	start = head;
+
+	switch (gbcpu_peek(gbcpu, head)) {
+	case 0xf0:  /* LDH A, (n) */
+		l->addr = 0xff00 | gbcpu_peek(gbcpu, head + 1);
+		l->read_cycles = 12;
+		head += 2;
+		break;
+	case 0xf2:  /* LDH A, (C) */
+		l->addr = 0xff00 | gbcpu->regs.rn.c;
+		l->read_cycles = 8;
+		head += 1;
+		break;
+	case 0xfa:  /* LD A, (nn) */
+		l->addr = gbcpu_peek(gbcpu, head + 1) | gbcpu_peek(gbcpu, head + 2) << 8;
+		l->read_cycles = 16;
+		head += 3;
+		break;
+	default:
+		return 0;
+	}
+	if ((head & 0xffff) != pc)
+		return 0;
+	if (l->addr != 0xff41 && l->addr != 0xff44)
+		return 0;
+	if (gbcpu->halt_at_pc != -1 &&
+	    ((gbcpu->halt_at_pc - start) & 0xffff) < ((addr - start) & 0xffff))
+		return 0;
+	l->period += l->read_cycles;
+
+	return 1;
+}
+
+/* Run one iteration's ALU operations, returns whether the loop continues. */
+static regparm long idle_loop_iter(const struct idle_loop *l, uint8_t a, uint8_t *f)
+{
+	long i;
+
+	for (i=0; i<l->n; i++) {
+		uint8_t imm = l->imm[i];
+		uint8_t res;
+
+		switch (l->op[i]) {
+		case 0xfe:
+			res = a - imm;
+			*f = NF;
+			if (a < res) *f |= CF;
+			if ((a & 15) < (res & 15)) *f |= HF;
+			if (res == 0) *f |= ZF;
+			break;
+		case 0xe6:
+			a &= imm;
+			*f = HF;
+			if (a == 0) *f |= ZF;
+			break;
+		case 0xf6:
+			a |= imm;
+			*f = 0;
+			if (a == 0) *f |= ZF;
+			break;
+		case 0xee:
+			a ^= imm;
+			*f = 0;
+			if (a == 0) *f |= ZF;
+			break;
+		case 0xcb:
+			*f &= ~NF;
+			*f |= HF | ZF;
+			*f ^= ((a << 8) >> (((imm >> 3) & 7) + 1)) & ZF;
+			break;
+		}
+	}
+	switch (l->cond) {
+		case 0: return (*f & ZF) == 0;
+		case 1: return (*f & ZF) != 0;
+		case 2: return (*f & CF) == 0;
+	}
+	return (*f & CF) != 0;
+}
+
+/*
+ * Busy-wait loops on STAT or LY only depend on the time, so instead of
+ * interpreting them, find the iteration whose read ends the loop.
+ * gbcpu_run() stops after every read of an IO register, so this is
+ * checked with the cpu sitting right behind the read.  Iterations are
+ * skipped only as far as gbcpu_run() would have got within cycles.
+ * Returns the number of cycles skipped.
+ */
+static regparm long gbhw_idle_skip(struct gbhw *gbhw, long cycles)
+{
+	struct gbcpu *gbcpu = &gbhw->gbcpu;
+	struct idle_loop l;
+	uint8_t f = gbcpu->regs.rn.f;
+	uint8_t val;
+	long maxiter;
+	long i;
+
+	if (!idle_loop_find(gbhw, &l))
 		return 0;
+	if (!idle_loop_iter(&l, gbcpu->regs.rn.a, &f))
+		return 0;
+
+	/* the read of iteration i happens at i * period - read_cycles */
+	maxiter = (cycles + l.read_cycles - 1) / l.period;
+	if (maxiter < 2)
+		return 0;
+	i = 1;
+	for (;;) {
+		long vblankctr = gbhw->vblankctr - (i * l.period - l.read_cycles);
+		uint8_t nf = f;
+
+		val = lcd_get(vblankctr, l.addr);
+		if (i == maxiter || !idle_loop_iter(&l, val, &nf))
+			break;
+		f = nf;
+		/* the value does not change before the next lcd mode change */
+		i += 1 + (lcd_next_change(vblankctr) - 1) / l.period;
+		if (i > maxiter)
+			i = maxiter;
+	}
+	if (i < 2)
+		return 0;
+
+	gbcpu->regs.rn.a = val;
+	gbcpu->regs.rn.f = f;
+	gbhw->idle_cycles += i * l.period;
+	return i * l.period;
+}
+
+/*
+ * A halted cpu idles in 16 cycle steps and nothing but the vblank
+ * and timer counters can wake it up.  Those already bound maxcycles
+ * in gbhw_step(), so all steps up to there can be taken at once.
+ * Only the lockup detection needs to see the step where it triggers.
+ */
+static regparm long gbhw_halt_cycles(struct gbhw *gbhw, long cycles)
+{
+	long n = (cycles + 15) / 16;
+
+	if (gbhw->gbcpu.if_flag == 0) {
+		long left = (GBHW_CLOCK/10 - gbhw->halted_noirq_cycles) / 16 + 1;
+		if (gbhw->ioregs[REG_IE] == 0 || left < 1)
+			left = 1;
+		if (n > left)
+			n = left;
 	}
+	return n * 16;
+}
+
+/*
+ * Run the emulation for at least time_to_work cycles.  Returns the
+ * number of cycles run, which may be a few more, or -1 on lockup.
+ */
+static regparm long gbhw_run(struct gbhw *gbhw, long time_to_work)
+{
+	long cycles_total = 0;
 
-	time_to_work *= msec_cycles;
-	
 	while (cycles_total < time_to_work) {
 		long maxcycles = time_to_work - cycles_total;
 		long cycles = 0;
 
-		if (vblankctr > 0 && vblankctr < maxcycles) maxcycles = vblankctr;
-		if (timerctr > 0 && timerctr < maxcycles) maxcycles = timerctr;
+		if (gbhw->vblankctr > 0 && gbhw->vblankctr < maxcycles) maxcycles = gbhw->vblankctr;
+		if (gbhw->timerctr > 0 && gbhw->timerctr < maxcycles) maxcycles = gbhw->timerctr;
 
-		io_written = 0;
-		while (cycles < maxcycles && !io_written) {
+		gbhw->io_written = 0;
+		while (cycles < maxcycles && !gbhw->io_written) {
 			long step;
-			gbhw_check_if();
-			step = gbcpu_step();
-			if (gbcpu_halted) {
-				halted_noirq_cycles += step;
-				if (gbcpu_if == 0 &&
-				    (ioregs[REG_IE] == 0 ||
-				     halted_noirq_cycles > GBHW_CLOCK/10)) {
+			if (gbhw->player == NULL)
+				gbhw_check_if(gbhw);
+			if (gbhw->player) {
+				step = gbhw->player(gbhw, maxcycles - cycles, gbhw->player_priv);
+			} else if (gbhw->stepcallback == NULL && !gbhw->gbcpu.halted) {
+				/*
+				 * Unless busy-waiting on STAT or LY can be
+				 * skipped, run a batch of instructions.
+				 * Everything but the last one is accounted
+				 * for here or from gbhw_sync().
+				 */
+				step = gbhw_idle_skip(gbhw, maxcycles - cycles);
+				if (step == 0) {
+					long total = gbcpu_run(&gbhw->gbcpu, maxcycles - cycles);
+					step = gbhw->gbcpu.cycles;
+					gbhw_account(gbhw, gbhw->gbcpu.run_pending - step);
+					cycles += total - step;
+					if (gbhw->gbcpu.run_insns > 1)
+						gbhw->halted_noirq_cycles = 0;
+				}
+			} else if (gbhw->stepcallback == NULL && !gbhw->gbcpu.stopped) {
+				step = gbhw_halt_cycles(gbhw, maxcycles - cycles);
+			} else {
+				step = gbcpu_step(&gbhw->gbcpu);
+			}
+			if (gbhw->gbcpu.halted) {
+				gbhw->halted_noirq_cycles += step;
+				if (gbhw->gbcpu.if_flag == 0 &&
+				    (gbhw->ioregs[REG_IE] == 0 ||
+				     gbhw->halted_noirq_cycles > GBHW_CLOCK/10)) {
 					fprintf(stderr, "CPU locked up (halt with interrupts disabled).\n");
-					blargg_debug();
+					blargg_debug(gbhw);
 					return -1;
 				}
 			} else {
-				halted_noirq_cycles = 0;
+				gbhw->halted_noirq_cycles = 0;
 			}
 			if (step < 0) return step;
 			cycles += step;
-			sum_cycles += step;
-			vblankctr -= step;
-			if (vblankctr <= 0) {
-				vblankctr += vblanktc;
-				ioregs[REG_IF] |= 0x01;
-				DPRINTF("vblank_interrupt\n");
-			}
-			gb_sound(step);
-			if (stepcallback)
-			   stepcallback(sum_cycles, gbhw_ch, stepcallback_priv);
+			gbhw_account(gbhw, step);
+			if (gbhw->stepcallback)
+			   gbhw->stepcallback(gbhw->sum_cycles, gbhw->ch, gbhw->stepcallback_priv);
 		}
 
-		if (ioregs[REG_TAC] & 4) {
-			if (timerctr > 0) timerctr -= cycles;
-			while (timerctr <= 0) {
-				timerctr += timertc;
-				ioregs[REG_TIMA]++;
+		if (gbhw->ioregs[REG_TAC] & 4) {
+			if (gbhw->timerctr > 0) gbhw->timerctr -= cycles;
+			while (gbhw->timerctr <= 0) {
+				gbhw->timerctr += gbhw->timertc;
+				gbhw->ioregs[REG_TIMA]++;
 				//DPRINTF("TIMA=%02x\n", ioregs[REG_TIMA]);
-				if (ioregs[REG_TIMA] == 0) {
-					ioregs[REG_TIMA] = ioregs[REG_TMA];
-					ioregs[REG_IF] |= 0x04;
+				if (gbhw->ioregs[REG_TIMA] == 0) {
+					gbhw->ioregs[REG_TIMA] = gbhw->ioregs[REG_TMA];
+					gbhw->ioregs[REG_IF] |= 0x04;
 					DPRINTF("timer_interrupt\n");
 				}
 			}
@@ -1128,7 +1610,308 @@ regparm long gbhw_step(long time_to_work)
 	return cycles_total;
 }
 
-regparm void gbhw_pause(long new_pause)
+/**
+ * @param time_to_work  emulated time in milliseconds
+ * @return  elapsed cpu cycles
+ */
+regparm long gbhw_step(struct gbhw *gbhw, long time_to_work)
+{
+	if (gbhw->pause_output) {
+		(void)usleep(time_to_work*1000);
+		return 0;
+	}
+
+	return gbhw_run(gbhw, time_to_work * msec_cycles);
+}
+
+/*
+ * Run the emulation for the given number of cycles.  Instructions
+ * can overshoot the end a bit, that surplus is taken off the next
+ * call, so consecutive calls stay in sync with the sum of requested
+ * cycles.  Returns the cycles actually run or -1 on lockup.
+ */
+regparm long gbhw_step_cycles(struct gbhw *gbhw, long cycles)
+{
+	long cycles_run;
+
+	if (gbhw->pause_output) {
+		(void)usleep(cycles * 1000000LL / GBHW_CLOCK);
+		return 0;
+	}
+
+	cycles -= gbhw->step_surplus;
+	if (cycles <= 0) {
+		gbhw->step_surplus = -cycles;
+		return 0;
+	}
+	cycles_run = gbhw_run(gbhw, cycles);
+	if (cycles_run < 0)
+		return cycles_run;
+	gbhw->step_surplus = cycles_run - cycles;
+
+	return cycles_run;
+}
+
+/*
+ * Run until the next flush of the output buffer.
+ */
+static regparm long gbhw_run_flush(struct gbhw *gbhw)
+{
+	long long flush_at = gbhw->sound_div_tc*(gbhw->impbuf->samples - IMPULSE_WIDTH/2);
+
+	flush_at = (flush_at + SOUND_DIV_MULT - 1) / SOUND_DIV_MULT;
+	return gbhw_run(gbhw, flush_at - gbhw->impbuf->cycles);
+}
+
+/*
+ * Render exactly frames stereo frames into out, running the emulation
+ * as far as needed.  Whole buffers are flushed straight into out, the
+ * callback is not called.  Only a partial buffer at the end is
+ * flushed into the output buffer and handed out by the next call, so
+ * the samples are the same as with gbhw_step() and the callback.
+ * Without gbhw_setbuffer() a buffer of RENDER_CHUNK frames is set up
+ * on the first call.
+ */
+static regparm long gbhw_render_setbuffer(struct gbhw *gbhw)
+{
+	memset(&gbhw->renderbuf, 0, sizeof(gbhw->renderbuf));
+	gbhw->renderbuf.data = malloc(RENDER_CHUNK * 4);
+	if (gbhw->renderbuf.data == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return 0;
+	}
+	gbhw->renderbuf.bytes = RENDER_CHUNK * 4;
+	gbhw_setbuffer(gbhw, &gbhw->renderbuf);
+	return gbhw->impbuf != NULL;
+}
+
+regparm long gbhw_render(struct gbhw *gbhw, int16_t *out, long frames)
+{
+	gbhw_callback_fn callback = gbhw->callback;
+	struct gbhw_buffer *buf;
+	int16_t *data;
+	long cycles_total = 0;
+
+	if (gbhw->audio_off)
+		return -1;
+	if (gbhw->soundbuf == NULL && !gbhw_render_setbuffer(gbhw))
+		return -1;
+	if (gbhw->impbuf == NULL)
+		return -1;
+
+	buf = gbhw->soundbuf;
+	data = buf->data;
+	gbhw->callback = NULL;
+	while (frames > 0) {
+		long cycles;
+
+		if (gbhw->render_pending > 0) {
+			long n = frames < gbhw->render_pending ? frames : gbhw->render_pending;
+
+			memcpy(out, &data[(buf->samples - gbhw->render_pending) * 2], n * 4);
+			gbhw->render_pending -= n;
+			out += n * 2;
+			frames -= n;
+			continue;
+		}
+		if (frames >= buf->samples) {
+			buf->data = out;
+			cycles = gbhw_run_flush(gbhw);
+			buf->data = data;
+			out += buf->samples * 2;
+			frames -= buf->samples;
+		} else {
+			cycles = gbhw_run_flush(gbhw);
+			gbhw->render_pending = buf->samples;
+		}
+		if (cycles < 0) {
+			cycles_total = cycles;
+			break;
+		}
+		cycles_total += cycles;
+	}
+	gbhw->callback = callback;
+
+	return cycles_total;
+}
+
+/*
+ * Cycles between two interrupts that call the play routine: the timer
+ * overflow period while the timer interrupt is in use, the vblank
+ * period otherwise.  Internal for gbs.c, not exported from libgbs.
+ */
+regparm long gbhw_play_cycles(struct gbhw *gbhw)
+{
+	if ((gbhw->ioregs[REG_TAC] & 4) && (gbhw->ioregs[REG_IE] & 0x04))
+		return gbhw->timertc * (256 - gbhw->ioregs[REG_TMA]);
+	return vblanktc;
+}
+
+/*
+ * Walk the complete emulation state for a snapshot, see snapshot.h.
+ * Configuration (rate, filter, callbacks, muted channels) is not part
+ * of it, the output buffer sizes and the rom must match on loading.
+ * Internal for gbs.c, not exported from libgbs.
+ */
+regparm void gbhw_snapshot(struct gbhw *gbhw, struct snap *s)
+{
+	long samples = gbhw->soundbuf ? gbhw->soundbuf->samples : 0;
+	long ring = gbhw->impbuf ? gbhw->impbuf_mask + 1 : 0;
+	long long div_tc = gbhw->sound_div_tc;
+	long lastbank = gbhw->lastbank;
+	long rombank = gbhw->rombank;
+	long render_pending = gbhw->render_pending;
+	long ch3pos = gbhw->ch3pos;
+	long linkport_idx = gbhw->linkport.idx;
+	long soundbuf_pos = gbhw->soundbuf ? gbhw->soundbuf->pos : 0;
+	long dry = s->dry;
+	long i;
+
+	/* the header only goes to locals, also on a dry load */
+	s->dry = 0;
+	snap_long(s, &samples);
+	snap_long(s, &ring);
+	snap_llong(s, &div_tc);
+	snap_long(s, &lastbank);
+	s->dry = dry;
+	if (s->error)
+		return;
+	if (s->load) {
+		if (samples == RENDER_CHUNK && gbhw->soundbuf == NULL &&
+		    !gbhw_render_setbuffer(gbhw)) {
+			s->error = 1;
+			return;
+		}
+		if (samples != (gbhw->soundbuf ? gbhw->soundbuf->samples : 0) ||
+		    ring != (gbhw->impbuf ? gbhw->impbuf_mask + 1 : 0) ||
+		    div_tc != gbhw->sound_div_tc) {
+			fprintf(stderr, "%s", _("Snapshot output buffer or rate does not match.\n"));
+			s->error = 1;
+			return;
+		}
+		if (lastbank != gbhw->lastbank) {
+			fprintf(stderr, "%s", _("Snapshot ROM size does not match.\n"));
+			s->error = 1;
+			return;
+		}
+	}
+
+	snap_u16s(s, gbhw->gbcpu.regs.rw, 6);
+	snap_long(s, &gbhw->gbcpu.halted);
+	snap_long(s, &gbhw->gbcpu.stopped);
+	snap_long(s, &gbhw->gbcpu.if_flag);
+	snap_long(s, &gbhw->gbcpu.halt_at_pc);
+
+	for (i=0; i<4; i++) {
+		struct gbhw_channel *ch = &gbhw->ch[i];
+		snap_long(s, &ch->running);
+		snap_long(s, &ch->master);
+		snap_long(s, &ch->leftgate);
+		snap_long(s, &ch->rightgate);
+		snap_long(s, &ch->lvl);
+		snap_long(s, &ch->volume);
+		snap_long(s, &ch->env_dir);
+		snap_long(s, &ch->env_tc);
+		snap_long(s, &ch->env_ctr);
+		snap_long(s, &ch->sweep_dir);
+		snap_long(s, &ch->sweep_tc);
+		snap_long(s, &ch->sweep_ctr);
+		snap_long(s, &ch->sweep_shift);
+		snap_long(s, &ch->len);
+		snap_long(s, &ch->len_enable);
+		snap_long(s, &ch->len_gate);
+		snap_long(s, &ch->div_tc);
+		snap_long(s, &ch->div_tc_shadow);
+		snap_long(s, &ch->div_ctr);
+		snap_long(s, &ch->duty_tc);
+		snap_long(s, &ch->duty_ctr);
+	}
+
+	snap_bytes(s, gbhw->intram, sizeof(gbhw->intram));
+	snap_bytes(s, gbhw->extram, sizeof(gbhw->extram));
+	snap_bytes(s, gbhw->ioregs, sizeof(gbhw->ioregs));
+	snap_bytes(s, gbhw->hiram, sizeof(gbhw->hiram));
+	snap_bytes(s, gbhw->boot_rom, sizeof(gbhw->boot_rom));
+	snap_value(s, &rombank);
+	snap_long(s, &gbhw->apu_on);
+	snap_long(s, &gbhw->io_written);
+	snap_long(s, &gbhw->rom_lockout);
+
+	snap_long(s, &gbhw->lminval);
+	snap_long(s, &gbhw->lmaxval);
+	snap_long(s, &gbhw->rminval);
+	snap_long(s, &gbhw->rmaxval);
+	snap_long(s, &gbhw->master_volume);
+	snap_long(s, &gbhw->master_fade);
+	snap_long(s, &gbhw->master_dstvol);
+	snap_long(s, &gbhw->update_level);
+	snap_long(s, &gbhw->sequence_ctr);
+	snap_long(s, &gbhw->halted_noirq_cycles);
+	snap_long(s, &gbhw->vblankctr);
+	snap_long(s, &gbhw->timertc);
+	snap_long(s, &gbhw->timerctr);
+	snap_long(s, &gbhw->sum_cycles);
+	snap_long(s, &gbhw->idle_cycles);
+	snap_long(s, &gbhw->step_surplus);
+	snap_value(s, &render_pending);
+
+	snap_u32(s, &gbhw->tap1);
+	snap_u32(s, &gbhw->tap2);
+	snap_u32(s, &gbhw->lfsr);
+	snap_long(s, &gbhw->main_div);
+	snap_long(s, &gbhw->sweep_div);
+	snap_value(s, &ch3pos);
+	snap_long(s, &gbhw->last_l_value);
+	snap_long(s, &gbhw->last_r_value);
+	snap_long(s, &gbhw->ch3_next_nibble);
+
+	snap_bytes(s, gbhw->linkport.buf, sizeof(gbhw->linkport.buf));
+	snap_value(s, &linkport_idx);
+	snap_long(s, &gbhw->linkport.disabled);
+
+	if (gbhw->impbuf) {
+		snap_long(s, &gbhw->impbuf->pos);
+		snap_long(s, &gbhw->impbuf->cycles);
+		snap_long(s, &gbhw->impbuf->l_lvl);
+		snap_long(s, &gbhw->impbuf->r_lvl);
+		snap_u16s(s, (uint16_t *)gbhw->impbuf->data, gbhw->impbuf->bytes / 2);
+	}
+	if (gbhw->soundbuf) {
+		/* holds the frames gbhw_render() has not handed out yet */
+		snap_value(s, &soundbuf_pos);
+		snap_long(s, &gbhw->soundbuf->l_lvl);
+		snap_long(s, &gbhw->soundbuf->r_lvl);
+		snap_long(s, &gbhw->soundbuf->l_cap);
+		snap_long(s, &gbhw->soundbuf->r_cap);
+		snap_u16s(s, (uint16_t *)gbhw->soundbuf->data, gbhw->soundbuf->samples * 2);
+	}
+
+	if (!s->load || s->error)
+		return;
+	/* values used as an index or offset are only taken once checked */
+	if (rombank < (lastbank > 0) || rombank > lastbank ||
+	    render_pending < 0 || render_pending > samples ||
+	    soundbuf_pos < 0 || soundbuf_pos > samples * 2 ||
+	    ch3pos < 0 ||
+	    linkport_idx < 0 || linkport_idx >= (long)sizeof(gbhw->linkport.buf)) {
+		fprintf(stderr, "%s", _("Snapshot state is out of range.\n"));
+		s->error = 1;
+		return;
+	}
+	if (!s->dry) {
+		gbhw->rombank = rombank;
+		gbhw->render_pending = render_pending;
+		gbhw->ch3pos = ch3pos;
+		gbhw->linkport.idx = linkport_idx;
+		if (gbhw->soundbuf)
+			gbhw->soundbuf->pos = soundbuf_pos;
+		gbhw->gbcpu.running = 0;
+		gbhw_map_rom(gbhw);
+		gbcpu_flush_code(&gbhw->gbcpu);
+	}
+}
+
+regparm void gbhw_pause(struct gbhw *gbhw, long new_pause)
 {
-	pause_output = new_pause != 0;
+	gbhw->pause_output = new_pause != 0;
 }
@@ -10,6 +10,7 @@
 
 #include <inttypes.h>
 #include "common.h"
+#include "gbcpu.h"
 
 #define GBHW_CLOCK 4194304
 
@@ -59,25 +60,115 @@ struct gbhw_channel {
 	long duty_ctr;
 };
 
-extern struct gbhw_channel gbhw_ch[4];
-
 typedef regparm void (*gbhw_callback_fn)(/*@temp@*/ struct gbhw_buffer *buf, /*@temp@*/ void *priv);
 typedef regparm void (*gbhw_iocallback_fn)(long cycles, uint32_t addr, uint8_t valu, /*@temp@*/ void *priv);
 typedef regparm void (*gbhw_stepcallback_fn)(const long cycles, const struct gbhw_channel[], /*@temp@*/ void *priv);
+struct gbhw;
+
+/*
+ * Drives the hardware instead of the cpu: does whatever is due now and
+ * returns the cycles until it wants to be called again, at most cycles.
+ */
+typedef regparm long (*gbhw_player_fn)(struct gbhw *gbhw, long cycles, /*@temp@*/ void *priv);
+
+struct gbhw_linkport {
+	char buf[256];
+	long idx;
+	long disabled;
+};
+
+/*
+ * Complete state of one emulated Gameboy.  Instances are independent,
+ * so several songs can be rendered side by side.
+ */
+struct gbhw {
+	struct gbcpu gbcpu;
+	struct gbhw_channel ch[4];
+
+	/*@dependent@*/ uint8_t *rom;
+	uint8_t intram[0x2000];
+	uint8_t extram[0x2000];
+	uint8_t ioregs[0x80];
+	uint8_t hiram[0x80];
+	uint8_t boot_rom[256];
+	long rombank;
+	long lastbank;
+	long apu_on;
+	long io_written;
+	long rom_lockout;
+
+	long lminval, lmaxval, rminval, rmaxval;
+	double filter_constant;
+	int filter_enabled;
+	long cap_factor;
+
+	long master_volume;
+	long master_fade;
+	long master_dstvol;
+	long sample_rate;
+	long update_level;
+	long sequence_ctr;
+	long halted_noirq_cycles;
+
+	long vblankctr;
+	long timertc;
+	long timerctr;
+	long sum_cycles;
+	long step_surplus;	/* cycles gbhw_step_cycles() ran ahead */
+	long idle_cycles;	/* cycles skipped in busy-wait loops */
+	long pause_output;
+	long audio_off;	/* see gbhw_setaudio() */
+
+	gbhw_callback_fn callback;
+	/*@null@*/ /*@dependent@*/ void *callbackpriv;
+	/*@null@*/ /*@dependent@*/ struct gbhw_buffer *soundbuf; /* externally visible output buffer */
+	/*@null@*/ /*@only@*/ struct gbhw_buffer *impbuf;   /* internal impulse output buffer */
+	long impbuf_mask;	/* impbuf is a ring of impbuf_mask+1 samples */
+	struct gbhw_buffer renderbuf;	/* output buffer for gbhw_render() if none was set */
+	long render_pending;	/* frames left in the output buffer for gbhw_render() */
+	gbhw_iocallback_fn iocallback;
+	/*@null@*/ /*@dependent@*/ void *iocallback_priv;
+	gbhw_stepcallback_fn stepcallback;
+	/*@null@*/ /*@dependent@*/ void *stepcallback_priv;
+	gbhw_player_fn player;	/* see gbhw_setplayer() */
+	/*@null@*/ /*@dependent@*/ void *player_priv;
+
+	uint32_t tap1;
+	uint32_t tap2;
+	uint32_t lfsr;
+	long long sound_div_tc;
+	long main_div;
+	long sweep_div;
+	long ch3pos;
+	long last_l_value, last_r_value;
+	long ch3_next_nibble;
+
+	struct gbhw_linkport linkport;
+};
+
+regparm void gbhw_init_struct(struct gbhw *gbhw);
+regparm void gbhw_cleanup(struct gbhw *gbhw);
+regparm void gbhw_setcallback(struct gbhw *gbhw, /*@dependent@*/ gbhw_callback_fn fn, /*@dependent@*/ void *priv);
+regparm void gbhw_setiocallback(struct gbhw *gbhw, /*@dependent@*/ gbhw_iocallback_fn fn, /*@dependent@*/ void *priv);
+regparm void gbhw_setstepcallback(struct gbhw *gbhw, /*@dependent@*/ gbhw_stepcallback_fn fn, /*@dependent@*/ void *priv);
+regparm long gbhw_setfilter(struct gbhw *gbhw, const char *type);
+regparm void gbhw_setrate(struct gbhw *gbhw, long rate);
+regparm void gbhw_setaudio(struct gbhw *gbhw, long enabled);
+regparm void gbhw_setbuffer(struct gbhw *gbhw, /*@dependent@*/ struct gbhw_buffer *buffer);
+regparm void gbhw_init(struct gbhw *gbhw, uint8_t *rombuf, uint32_t size);
+regparm void gbhw_enable_bootrom(struct gbhw *gbhw, const uint8_t *rombuf);
+regparm void gbhw_pause(struct gbhw *gbhw, long new_pause);
+regparm void gbhw_master_fade(struct gbhw *gbhw, long speed, long dstvol);
+regparm void gbhw_getminmax(struct gbhw *gbhw, int16_t *lmin, int16_t *lmax, int16_t *rmin, int16_t *rmax);
+regparm long gbhw_step(struct gbhw *gbhw, long time_to_work);
+regparm long gbhw_step_cycles(struct gbhw *gbhw, long cycles);
+regparm long gbhw_render(struct gbhw *gbhw, int16_t *out, long frames);
+regparm uint8_t gbhw_io_peek(struct gbhw *gbhw, uint16_t addr);  /* unmasked peek */
+regparm void gbhw_io_put(struct gbhw *gbhw, uint16_t addr, uint8_t val);
 
-regparm void gbhw_setcallback(/*@dependent@*/ gbhw_callback_fn fn, /*@dependent@*/ void *priv);
-regparm void gbhw_setiocallback(/*@dependent@*/ gbhw_iocallback_fn fn, /*@dependent@*/ void *priv);
-regparm void gbhw_setstepcallback(/*@dependent@*/ gbhw_stepcallback_fn fn, /*@dependent@*/ void *priv);
-regparm long gbhw_setfilter(const char *type);
-regparm void gbhw_setrate(long rate);
-regparm void gbhw_setbuffer(/*@dependent@*/ struct gbhw_buffer *buffer);
-regparm void gbhw_init(uint8_t *rombuf, uint32_t size);
-regparm void gbhw_enable_bootrom(const uint8_t *rombuf);
-regparm void gbhw_pause(long new_pause);
-regparm void gbhw_master_fade(long speed, long dstvol);
-regparm void gbhw_getminmax(int16_t *lmin, int16_t *lmax, int16_t *rmin, int16_t *rmax);
-regparm long gbhw_step(long time_to_work);
-regparm uint8_t gbhw_io_peek(uint16_t addr);  /* unmasked peek */
-regparm void gbhw_io_put(uint16_t addr, uint8_t val);
+regparm long gbhw_play_cycles(struct gbhw *gbhw);
+regparm void gbhw_setplayer(struct gbhw *gbhw, /*@dependent@*/ gbhw_player_fn fn, /*@dependent@*/ void *priv);
+struct snap;
+regparm void gbhw_snapshot(struct gbhw *gbhw, struct snap *s);
 
 #endif
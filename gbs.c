@@ -14,18 +14,32 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 
 #include "common.h"
 #include "gbhw.h"
-#include "gbcpu.h"
+#include "gbcpu_priv.h"
 #include "gbs.h"
 #include "crc32.h"
+#include "snapshot.h"
+#include "songcache.h"
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 #ifdef USE_ZLIB
 #include <zlib.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 /* Max GB rom size is 4MiB (mapper with 256 banks) */
 #define GB_MAX_ROM_SIZE (256 * 0x4000)
 
@@ -34,6 +48,9 @@
 #define HDR_LEN_GB	0x150
 #define HDR_LEN_GZIP	10
 #define HDR_LEN_VGM	0x100
+#define HDR_LEN_ZIP	30
+
+#define VGM_RATE	44100	/* VGM wait commands count samples at this rate */
 
 #define GBS_MAGIC		"GBS"
 #define GBS_EXTHDR_MAGIC	"GBSX"
@@ -41,12 +58,24 @@
 #define GD3_MAGIC		"Gd3 "
 #define VGM_MAGIC		"Vgm "
 #define GZIP_MAGIC		"\037\213\010"
+#define ZIP_MAGIC		"PK\003\004"
 
 const char *boot_rom_file = ".dmg_rom.bin";
 
+static regparm void gbs_free_keyframes(struct gbs *gbs)
+{
+	long i;
+
+	for (i=0; i<gbs->keyframes; i++)
+		free(gbs->keyframe[i].data);
+	free(gbs->keyframe);
+	gbs->keyframe = NULL;
+	gbs->keyframes = 0;
+}
+
 regparm long gbs_init(struct gbs *gbs, long subsong)
 {
-	gbhw_init(gbs->rom, gbs->romsize);
+	gbhw_init(&gbs->gbhw, gbs->rom, gbs->romsize);
 
 	if (subsong == -1) subsong = gbs->defaultsong - 1;
 	if (subsong >= gbs->songs) {
@@ -55,28 +84,35 @@ regparm long gbs_init(struct gbs *gbs, long subsong)
 	}
 
 	if (gbs->defaultbank != 1) {
-		gbcpu_mem_put(0x2000, gbs->defaultbank);
+		gbcpu_mem_put(&gbs->gbhw.gbcpu, 0x2000, gbs->defaultbank);
 	}
-	gbhw_io_put(0xff06, gbs->tma);
-	gbhw_io_put(0xff07, gbs->tac);
-	gbhw_io_put(0xffff, 0x05);
+	gbhw_io_put(&gbs->gbhw, 0xff06, gbs->tma);
+	gbhw_io_put(&gbs->gbhw, 0xff07, gbs->tac);
+	gbhw_io_put(&gbs->gbhw, 0xffff, 0x05);
 
-	REGS16_W(gbcpu_regs, SP, gbs->stack);
+	REGS16_W(gbs->gbhw.gbcpu.regs, SP, gbs->stack);
 
 	/* put halt breakpoint PC on stack */
-	gbcpu_halt_at_pc = 0xffff;
-	REGS16_W(gbcpu_regs, PC, 0xff80);
-	REGS16_W(gbcpu_regs, HL, gbcpu_halt_at_pc);
-	gbcpu_mem_put(0xff80, 0xe5); /* push hl */
-	gbcpu_step();
+	gbs->gbhw.gbcpu.halt_at_pc = 0xffff;
+	REGS16_W(gbs->gbhw.gbcpu.regs, PC, 0xff80);
+	REGS16_W(gbs->gbhw.gbcpu.regs, HL, gbs->gbhw.gbcpu.halt_at_pc);
+	gbcpu_mem_put(&gbs->gbhw.gbcpu, 0xff80, 0xe5); /* push hl */
+	gbcpu_step(&gbs->gbhw.gbcpu);
 	/* clear regs/memory touched by stack etup */
-	REGS16_W(gbcpu_regs, HL, 0x0000);
-	gbcpu_mem_put(0xff80, 0x00);
+	REGS16_W(gbs->gbhw.gbcpu.regs, HL, 0x0000);
+	gbcpu_mem_put(&gbs->gbhw.gbcpu, 0xff80, 0x00);
 
-	REGS16_W(gbcpu_regs, PC, gbs->init);
-	gbcpu_regs.rn.a = subsong;
+	REGS16_W(gbs->gbhw.gbcpu.regs, PC, gbs->init);
+	gbs->gbhw.gbcpu.regs.rn.a = subsong;
 
 	gbs->ticks = 0;
+	gbs->sample_remainder = 0;
+	gbs->vgm_pos = 0;
+	gbs->vgm_samples = 0;
+	gbs->vgm_cycles = 0;
+	if (subsong != gbs->keyframe_subsong)
+		gbs_free_keyframes(gbs);
+	gbs->keyframe_subsong = subsong;
 	gbs->subsong = subsong;
 
 	return 1;
@@ -101,9 +137,38 @@ static regparm long gbs_nextsubsong(struct gbs *gbs)
 	return true;
 }
 
-regparm long gbs_step(struct gbs *gbs, long time_to_work)
+/*
+ * Keyframes are snapshots taken every keyframe_interval seconds while
+ * the current subsong plays.  They are taken at the end of a
+ * gbs_step() or gbs_render() call, keyframe[i] at the first one that
+ * ends after i times the interval.  Seeking restores the closest one
+ * before the target and runs the emulation from there.
+ */
+static regparm void gbs_add_keyframe(struct gbs *gbs)
+{
+	struct gbs_keyframe *kf;
+	long size = gbs_snapshot_save(gbs, NULL, 0);
+
+	kf = realloc(gbs->keyframe, (gbs->keyframes + 1) * sizeof(*kf));
+	if (kf == NULL)
+		return;
+	gbs->keyframe = kf;
+	kf = &kf[gbs->keyframes];
+	kf->ticks = gbs->ticks;
+	kf->size = size;
+	kf->data = malloc(size);
+	if (kf->data == NULL)
+		return;
+	gbs_snapshot_save(gbs, kf->data, size);
+	gbs->keyframes++;
+}
+
+/*
+ * Bookkeeping after emulating some cycles: level metering, fadeout,
+ * silence detection and subsong timeouts.
+ */
+static regparm long gbs_update(struct gbs *gbs, long cycles)
 {
-	long cycles = gbhw_step(time_to_work);
 	long time;
 
 	if (cycles < 0) {
@@ -111,8 +176,11 @@ regparm long gbs_step(struct gbs *gbs, long time_to_work)
 	}
 
 	gbs->ticks += cycles;
+	if (gbs->keyframe_interval &&
+	    gbs->ticks >= (long long)gbs->keyframes * gbs->keyframe_interval * GBHW_CLOCK)
+		gbs_add_keyframe(gbs);
 
-	gbhw_getminmax(&gbs->lmin, &gbs->lmax, &gbs->rmin, &gbs->rmax);
+	gbhw_getminmax(&gbs->gbhw, &gbs->lmin, &gbs->lmax, &gbs->rmin, &gbs->rmax);
 	gbs->lvol = -gbs->lmin > gbs->lmax ? -gbs->lmin : gbs->lmax;
 	gbs->rvol = -gbs->rmin > gbs->rmax ? -gbs->rmin : gbs->rmax;
 
@@ -126,10 +194,10 @@ regparm long gbs_step(struct gbs *gbs, long time_to_work)
 
 	if (gbs->fadeout && gbs->subsong_timeout &&
 	    time >= gbs->subsong_timeout - gbs->fadeout - gbs->gap)
-		gbhw_master_fade(128/gbs->fadeout, 0);
+		gbhw_master_fade(&gbs->gbhw, 128/gbs->fadeout, 0);
 	if (gbs->subsong_timeout &&
 	    time >= gbs->subsong_timeout - gbs->gap)
-		gbhw_master_fade(128*16, 0);
+		gbhw_master_fade(&gbs->gbhw, 128*16, 0);
 
 	if (gbs->silence_start &&
 	    (gbs->ticks - gbs->silence_start) / GBHW_CLOCK >= gbs->silence_timeout) {
@@ -144,6 +212,466 @@ regparm long gbs_step(struct gbs *gbs, long time_to_work)
 	return true;
 }
 
+regparm long gbs_step(struct gbs *gbs, long time_to_work)
+{
+	return gbs_update(gbs, gbhw_step(&gbs->gbhw, time_to_work));
+}
+
+/*
+ * Seek to msec into the current subsong.  Starts from the closest
+ * keyframe, or the subsong start if there is none, and runs the
+ * emulation silently from there, recording keyframes on the way.
+ * Output continues with the output buffer the target falls into.
+ * Returns false like gbs_step() if the last subsong ends first.
+ */
+regparm long gbs_seek(struct gbs *gbs, long msec)
+{
+	long long target = (long long)msec * GBHW_CLOCK / 1000;
+	gbhw_callback_fn callback = gbs->gbhw.callback;
+	gbhw_iocallback_fn iocallback = gbs->gbhw.iocallback;
+	gbhw_stepcallback_fn stepcallback = gbs->gbhw.stepcallback;
+	long pause_output = gbs->gbhw.pause_output;
+	long subsong = gbs->subsong;
+	long res = true;
+	long i;
+
+	/* emulation needs an output buffer, set up the gbs_render() one */
+	if (gbs->gbhw.soundbuf == NULL && gbhw_render(&gbs->gbhw, NULL, 0) < 0)
+		return false;
+
+	for (i=gbs->keyframes-1; i>=0; i--)
+		if (gbs->keyframe[i].ticks <= target)
+			break;
+	if (gbs->ticks > target || (i >= 0 && gbs->keyframe[i].ticks > gbs->ticks)) {
+		if (i < 0)
+			gbs_init(gbs, subsong);
+		else if (!gbs_snapshot_load(gbs, gbs->keyframe[i].data, gbs->keyframe[i].size))
+			return false;
+	}
+
+	gbs->gbhw.callback = NULL;
+	gbs->gbhw.iocallback = NULL;
+	gbs->gbhw.stepcallback = NULL;
+	gbs->gbhw.pause_output = 0;
+	while (res && gbs->subsong == subsong && gbs->ticks < target) {
+		long long cycles = target - gbs->ticks;
+		if (cycles > GBHW_CLOCK)
+			cycles = GBHW_CLOCK;
+		res = gbs_update(gbs, gbhw_step_cycles(&gbs->gbhw, cycles));
+	}
+	gbs->gbhw.callback = callback;
+	gbs->gbhw.iocallback = iocallback;
+	gbs->gbhw.stepcallback = stepcallback;
+	gbs->gbhw.pause_output = pause_output;
+	/* output restarts with the buffer holding the target */
+	gbs->gbhw.render_pending = 0;
+
+	return res;
+}
+
+/*
+ * Step by a number of output samples.  The cycles per sample are not
+ * an integer, the remainder is carried over to the next call.
+ */
+regparm long gbs_step_samples(struct gbs *gbs, long samples)
+{
+	long long total = (long long)samples * GBHW_CLOCK + gbs->sample_remainder;
+	long rate = gbs->gbhw.sample_rate;
+
+	gbs->sample_remainder = total % rate;
+	return gbs_update(gbs, gbhw_step_cycles(&gbs->gbhw, total / rate));
+}
+
+/*
+ * Render exactly frames stereo frames into out instead of going
+ * through the callback.  Returns false like gbs_step() once the
+ * last subsong has ended.
+ */
+regparm long gbs_render(struct gbs *gbs, int16_t *out, long frames)
+{
+	return gbs_update(gbs, gbhw_render(&gbs->gbhw, out, frames));
+}
+
+/*
+ * Loop detection: the APU register writes are grouped into frames of
+ * one play routine period each, and every frame is reduced to a crc
+ * of its writes and the wave RAM at its end.  Once a subsong loops,
+ * the frame sequence repeats.
+ */
+#define GBS_LOOP_CHUNK	(GBHW_CLOCK / 4)
+#define GBS_LOOP_STEP	456	/* one LCD line, while waiting for init */
+#define GBS_LOOP_MIN_SECS	10
+
+struct gbs_loopscan {
+	struct gbs *gbs;
+	long start;		/* cycle frame 0 starts at */
+	long period;		/* cycles per frame */
+	long frame;		/* frame the next writes belong to */
+	long frames;		/* frames recorded */
+	long max;
+	uint32_t *hash;
+	uint8_t *trigger;	/* a note was started in the frame */
+	unsigned long crc;
+	long triggered;
+};
+
+static regparm void gbs_loopscan_close(struct gbs_loopscan *ls)
+{
+	const char *wave = (const char *)&ls->gbs->gbhw.ioregs[0x30];
+
+	if (ls->frames < ls->max) {
+		ls->hash[ls->frames] = gbs_crc32(ls->crc, wave, 16);
+		ls->trigger[ls->frames] = ls->triggered;
+		ls->frames++;
+	}
+	ls->crc = 0;
+	ls->triggered = 0;
+	ls->frame++;
+}
+
+static regparm void gbs_loopscan_io(long cycles, uint32_t addr, uint8_t val, void *priv)
+{
+	struct gbs_loopscan *ls = priv;
+	char w[2];
+
+	while (ls->frame < (cycles - ls->start) / ls->period)
+		gbs_loopscan_close(ls);
+	if (addr < 0xff10 || addr > 0xff3f)
+		return;
+	w[0] = addr;
+	w[1] = val;
+	ls->crc = gbs_crc32(ls->crc, w, 2);
+	if ((addr == 0xff14 || addr == 0xff19 || addr == 0xff1e || addr == 0xff23) &&
+	    (val & 0x80))
+		ls->triggered = 1;
+}
+
+/*
+ * Find the shortest period p the recorded frames end in and the first
+ * frame of the repetition.  The repeating part has to hold the period
+ * twice and last GBS_LOOP_MIN_SECS, so a few equal frames at the end
+ * do not count.  Returns 0 if there is none.
+ */
+static regparm long gbs_loopscan_find(const struct gbs_loopscan *ls, long *intro)
+{
+	long n = ls->frames;
+	long min = (long long)GBS_LOOP_MIN_SECS * GBHW_CLOCK / ls->period;
+	long p, i;
+
+	for (p=1; p <= n/2; p++) {
+		for (i=n-p; i>0 && ls->hash[i-1] == ls->hash[i-1+p]; i--);
+		if (n - i >= 2*p && n - i >= min) {
+			*intro = i;
+			return p;
+		}
+	}
+	return 0;
+}
+
+/* Length of frames frames, with the time before frame 0 if from_start */
+static regparm uint32_t gbs_loopscan_len(const struct gbs_loopscan *ls, long frames, long from_start)
+{
+	long long cycles = (long long)frames * ls->period;
+
+	if (from_start)
+		cycles += ls->start;
+	return (cycles * GBS_LEN_DIV + GBHW_CLOCK - 1) / GBHW_CLOCK;
+}
+
+/*
+ * Play max_secs seconds of a subsong without audio and find its
+ * intro and loop from the APU register writes.  On success the
+ * subsong_info entry gets the intro and loop length and len covers
+ * both, a subsong that ends instead of looping gets a loop of 0.
+ * Returns false if no loop showed up within max_secs.  The instance
+ * is left initialized to the start of the subsong.
+ */
+regparm long gbs_detect_length(struct gbs *gbs, long subsong, long max_secs)
+{
+	struct gbhw *gbhw = &gbs->gbhw;
+	gbhw_callback_fn callback = gbhw->callback;
+	gbhw_iocallback_fn iocallback = gbhw->iocallback;
+	void *iocallback_priv = gbhw->iocallback_priv;
+	gbhw_stepcallback_fn stepcallback = gbhw->stepcallback;
+	long pause_output = gbhw->pause_output;
+	long audio_off = gbhw->audio_off;
+	long long end = (long long)max_secs * GBHW_CLOCK;
+	long long total = 0;
+	struct gbs_loopscan ls;
+	long loop = 0, intro = 0;
+	long i;
+
+	if (!gbs_init(gbs, subsong))
+		return false;
+
+	gbhw->callback = NULL;
+	gbhw->stepcallback = NULL;
+	gbhw->pause_output = 0;
+	gbhw_setiocallback(gbhw, NULL, NULL);
+	gbhw_setaudio(gbhw, 0);
+	/*
+	 * The init routine may still program the timer, so the play rate
+	 * is taken once it returned to the halt address.  Drivers that do
+	 * not return are given one chunk.
+	 */
+	while (!gbs->vgm && total < GBS_LOOP_CHUNK &&
+	       !(gbhw->gbcpu.halted && REGS16_R(gbhw->gbcpu.regs, PC) == gbhw->gbcpu.halt_at_pc)) {
+		long cycles = gbhw_step_cycles(gbhw, GBS_LOOP_STEP);
+		if (cycles < 0)
+			break;
+		total += cycles;
+	}
+
+	memset(&ls, 0, sizeof(ls));
+	ls.gbs = gbs;
+	ls.start = gbhw->sum_cycles;
+	ls.period = gbhw_play_cycles(gbhw);
+	ls.max = (end - total) / ls.period + 1;
+	ls.hash = malloc(ls.max * sizeof(*ls.hash));
+	ls.trigger = malloc(ls.max);
+	if (ls.hash == NULL || ls.trigger == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		goto exit_restore;
+	}
+
+	gbhw_setiocallback(gbhw, gbs_loopscan_io, &ls);
+	while (total < end) {
+		long cycles = end - total < GBS_LOOP_CHUNK ? end - total : GBS_LOOP_CHUNK;
+		cycles = gbhw_step_cycles(gbhw, cycles);
+		if (cycles < 0)
+			break;
+		total += cycles;
+	}
+	/* the play routine must keep its rate for frames to line up */
+	if (total >= end && gbhw_play_cycles(gbhw) == ls.period) {
+		while (ls.frame < (gbhw->sum_cycles - ls.start) / ls.period)
+			gbs_loopscan_close(&ls);
+		loop = gbs_loopscan_find(&ls, &intro);
+	}
+exit_restore:
+	gbhw_setaudio(gbhw, !audio_off);
+	gbhw_setiocallback(gbhw, iocallback, iocallback_priv);
+	gbhw->stepcallback = stepcallback;
+	gbhw->callback = callback;
+	gbhw->pause_output = pause_output;
+	gbs_init(gbs, subsong);
+
+	if (loop) {
+		/* nothing is played in a loop without new notes, the song ended */
+		for (i=intro; i<intro+loop && !ls.trigger[i]; i++);
+		if (i == intro+loop)
+			loop = 0;
+		gbs->subsong_info[subsong].intro = gbs_loopscan_len(&ls, intro, 1);
+		gbs->subsong_info[subsong].loop = gbs_loopscan_len(&ls, loop, 0);
+		gbs->subsong_info[subsong].len = gbs_loopscan_len(&ls, intro + loop, 1);
+	}
+	free(ls.hash);
+	free(ls.trigger);
+
+	return loop || intro;
+}
+
+/*
+ * Fill in subsong lengths and titles the song cache knows and the
+ * file does not.  Titles are copied, the cache can be closed after.
+ * Returns the number of subsongs found in the cache.
+ */
+regparm long gbs_songcache_apply(struct gbs *gbs, struct songcache *cache)
+{
+	struct songcache_entry e;
+	char *old = gbs->cachestrings;
+	size_t oldsize = gbs->cachestrings_size;
+	size_t size = 0;
+	long found = 0;
+	long i;
+
+	/* titles from an earlier call are replaced */
+	for (i=0; i<gbs->songs; i++) {
+		char *title = gbs->subsong_info[i].title;
+		if (title && title >= old && title < old + oldsize)
+			gbs->subsong_info[i].title = NULL;
+	}
+	for (i=0; i<gbs->songs; i++) {
+		if (songcache_lookup(cache, gbs->crcnow, i, &e) &&
+		    e.title && !gbs->subsong_info[i].title)
+			size += strlen(e.title) + 1;
+	}
+	gbs->cachestrings = NULL;
+	gbs->cachestrings_size = 0;
+	if (size && (gbs->cachestrings = malloc(size)) == NULL)
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+	else gbs->cachestrings_size = size;
+
+	size = 0;
+	for (i=0; i<gbs->songs; i++) {
+		struct gbs_subsong_info *info = &gbs->subsong_info[i];
+		if (!songcache_lookup(cache, gbs->crcnow, i, &e))
+			continue;
+		found++;
+		if (!info->len) {
+			info->len = e.len;
+			info->intro = e.intro;
+			info->loop = e.loop;
+		}
+		if (e.title && !info->title && gbs->cachestrings) {
+			info->title = strcpy(&gbs->cachestrings[size], e.title);
+			size += strlen(e.title) + 1;
+		}
+	}
+	free(old);
+
+	return found;
+}
+
+/*
+ * Store the known subsong lengths and titles in the song cache,
+ * keeping what else it knows about them.
+ */
+regparm void gbs_songcache_update(struct gbs *gbs, struct songcache *cache)
+{
+	struct songcache_entry e;
+	long i;
+
+	for (i=0; i<gbs->songs; i++) {
+		struct gbs_subsong_info *info = &gbs->subsong_info[i];
+		if (!info->len && !info->title)
+			continue;
+		if (!songcache_lookup(cache, gbs->crcnow, i, &e)) {
+			memset(&e, 0, sizeof(e));
+			e.crc = gbs->crcnow;
+			e.subsong = i;
+		}
+		if (info->len) {
+			e.len = info->len;
+			e.intro = info->intro;
+			e.loop = info->loop;
+		}
+		if (info->title)
+			e.title = info->title;
+		songcache_store(cache, &e);
+	}
+}
+
+#define GBS_SNAPSHOT_MAGIC	"GBSs"
+#define GBS_SNAPSHOT_VERSION	3
+#define GBS_SNAPSHOT_SUM	20	/* offset of the checksum */
+#define GBS_SNAPSHOT_HDRLEN	24
+
+/*
+ * Snapshot layout: magic, version, total size, the crc of the loaded
+ * file and the crc of everything after the header, then the gbhw
+ * state and the playback position.
+ */
+static regparm void gbs_snapshot(struct gbs *gbs, struct snap *s, long total)
+{
+	char magic[4];
+	uint32_t version = GBS_SNAPSHOT_VERSION;
+	uint32_t crc = gbs->crcnow;
+	uint32_t sum = 0;
+	long size = total;
+	long subsong = gbs->subsong;
+	long vgm_pos = gbs->vgm_pos;
+	long dry = s->dry;
+
+	if (s->load)
+		memset(magic, 0, sizeof(magic));
+	else
+		memcpy(magic, GBS_SNAPSHOT_MAGIC, sizeof(magic));
+	/* the header only goes to locals, also on a dry load */
+	s->dry = 0;
+	snap_bytes(s, magic, sizeof(magic));
+	snap_u32(s, &version);
+	snap_long(s, &size);
+	snap_u32(s, &crc);
+	snap_u32(s, &sum);
+	s->dry = dry;
+	if (s->load) {
+		if (s->pos > s->size || memcmp(magic, GBS_SNAPSHOT_MAGIC, sizeof(magic)) != 0 ||
+		    version != GBS_SNAPSHOT_VERSION || size != s->size ||
+		    sum != gbs_crc32(0, (const char *)&s->in[GBS_SNAPSHOT_HDRLEN], size - GBS_SNAPSHOT_HDRLEN)) {
+			fprintf(stderr, "%s", _("Not a valid snapshot.\n"));
+			s->error = 1;
+			return;
+		}
+		if (crc != gbs->crcnow) {
+			fprintf(stderr, "%s", _("Snapshot is for a different file.\n"));
+			s->error = 1;
+			return;
+		}
+	}
+
+	gbhw_snapshot(&gbs->gbhw, s);
+	snap_llong(s, &gbs->ticks);
+	snap_llong(s, &gbs->silence_start);
+	snap_long(s, &gbs->sample_remainder);
+	snap_value(s, &vgm_pos);
+	snap_llong(s, &gbs->vgm_samples);
+	snap_llong(s, &gbs->vgm_cycles);
+	snap_value(s, &subsong);
+	if (!s->load || s->error)
+		return;
+	if (subsong < 0 || subsong >= gbs->songs ||
+	    vgm_pos < 0 || vgm_pos > (gbs->vgm ? gbs->codelen : 0)) {
+		fprintf(stderr, "%s", _("Snapshot state is out of range.\n"));
+		s->error = 1;
+		return;
+	}
+	if (!s->dry) {
+		gbs->subsong = subsong;
+		gbs->vgm_pos = vgm_pos;
+	}
+}
+
+/*
+ * Save the complete emulation state to buf.  Returns the size of the
+ * snapshot, buf is only written if size is large enough for it.
+ */
+regparm long gbs_snapshot_save(struct gbs *gbs, void *buf, long size)
+{
+	struct snap s;
+	uint32_t sum;
+	long total;
+
+	memset(&s, 0, sizeof(s));
+	gbs_snapshot(gbs, &s, 0);
+	total = s.pos;
+	if (total > size)
+		return total;
+
+	memset(&s, 0, sizeof(s));
+	s.out = buf;
+	s.size = total;
+	gbs_snapshot(gbs, &s, total);
+	sum = gbs_crc32(0, (char *)buf + GBS_SNAPSHOT_HDRLEN, total - GBS_SNAPSHOT_HDRLEN);
+	s.pos = GBS_SNAPSHOT_SUM;
+	snap_u32(&s, &sum);
+	return total;
+}
+
+/*
+ * Restore a snapshot taken with the same file, sample rate and output
+ * buffer size.  Returns false if it does not fit, the state is left
+ * alone then.
+ */
+regparm long gbs_snapshot_load(struct gbs *gbs, const void *buf, long size)
+{
+	struct snap s;
+
+	memset(&s, 0, sizeof(s));
+	s.in = buf;
+	s.size = size;
+	s.load = 1;
+	s.dry = 1;
+	gbs_snapshot(gbs, &s, 0);
+	if (s.error || s.pos != size)
+		return false;
+
+	s.pos = 0;
+	s.dry = 0;
+	gbs_snapshot(gbs, &s, 0);
+	return !s.error;
+}
+
 regparm void gbs_printinfo(struct gbs *gbs, long verbose)
 {
 	printf(_("GBSVersion:       %u\n"
@@ -212,15 +740,123 @@ regparm void gbs_printinfo(struct gbs *gbs, long verbose)
 	}
 }
 
+/* Does p point into the file mapping of the instance? */
+static regparm long gbs_mapped(struct gbs *gbs, const void *p)
+{
+	return gbs->map && (const char *)p >= gbs->map &&
+	       (const char *)p < gbs->map + gbs->mapsize;
+}
+
+/*
+ * Rom images are immutable once built, so instances of the same file
+ * share one copy.  The images are kept in a refcounted list keyed by
+ * crcnow and compared in full, a crc collision only costs a copy.
+ */
+struct gbs_romimage {
+	struct gbs_romimage *next;
+	uint32_t crc;
+	unsigned long size;
+	long refs;
+	uint8_t *rom;
+};
+
+static struct gbs_romimage *romimages;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t romimages_lock = PTHREAD_MUTEX_INITIALIZER;
+#define romimages_lock()	pthread_mutex_lock(&romimages_lock)
+#define romimages_unlock()	pthread_mutex_unlock(&romimages_lock)
+#else
+#define romimages_lock()
+#define romimages_unlock()
+#endif
+
+/*
+ * Replace the rom image of a freshly opened instance by a shared one,
+ * once the instance knows its file mapping.  Roms built in place in the
+ * file mapping are left alone, their pages are shared with the page
+ * cache already.
+ */
+static regparm void gbs_share_rom(struct gbs *gbs)
+{
+	struct gbs_romimage *img;
+
+	if (gbs->romimage || gbs_mapped(gbs, gbs->rom))
+		return;
+
+	romimages_lock();
+	for (img = romimages; img; img = img->next) {
+		if (img->crc == gbs->crcnow && img->size == gbs->romsize &&
+		    memcmp(img->rom, gbs->rom, gbs->romsize) == 0)
+			break;
+	}
+	if (img) {
+		img->refs++;
+		free(gbs->rom);
+		gbs->rom = img->rom;
+	} else if ((img = malloc(sizeof(*img))) != NULL) {
+		img->crc = gbs->crcnow;
+		img->size = gbs->romsize;
+		img->refs = 1;
+		img->rom = gbs->rom;
+		img->next = romimages;
+		romimages = img;
+	}
+	gbs->romimage = img;
+	romimages_unlock();
+}
+
+static regparm void gbs_release_rom(struct gbs_romimage *img)
+{
+	struct gbs_romimage **p;
+
+	romimages_lock();
+	if (--img->refs == 0) {
+		for (p = &romimages; *p != img; p = &(*p)->next);
+		*p = img->next;
+		free(img->rom);
+		free(img);
+	}
+	romimages_unlock();
+}
+
 static regparm void gbs_free(struct gbs *gbs)
 {
-	if (gbs->buf)
+	if (gbs->buf && !gbs_mapped(gbs, gbs->buf))
 		free(gbs->buf);
-	if (gbs->subsong_info)
-		free(gbs->subsong_info);
+	if (gbs->romimage)
+		gbs_release_rom(gbs->romimage);
+	else if (gbs->rom && !gbs_mapped(gbs, gbs->rom))
+		free(gbs->rom);
+#ifdef HAVE_MMAP
+	if (gbs->map)
+		munmap(gbs->map, gbs->mapsize);
+#endif
+	free(gbs->arena);
+	gbs_free_keyframes(gbs);
+	free(gbs->cachestrings);
+	gbhw_cleanup(&gbs->gbhw);
 	free(gbs);
 }
 
+/*
+ * subsong_info and strsize bytes for strings come from one zeroed
+ * allocation, the strings start at gbs->arena.
+ */
+static regparm long gbs_alloc_arena(struct gbs *gbs, size_t strsize)
+{
+	size_t infosize = gbs->songs * sizeof(struct gbs_subsong_info);
+	char *arena = calloc(1, infosize + strsize);
+
+	if (arena == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return false;
+	}
+	gbs->subsong_info = (struct gbs_subsong_info *)arena;
+	gbs->arena = arena;
+	gbs->arenastrings = arena + infosize;
+	return true;
+}
+
 regparm void gbs_close(struct gbs *gbs)
 {
 	gbs_free(gbs);
@@ -260,12 +896,32 @@ regparm long gbs_write(struct gbs *gbs, char *name, long version)
 	long stringofs = 0;
 	long newlen = gbs->filesize;
 	long namelen = strlen(name);
-	char *tmpname = malloc(namelen + sizeof(".tmp\0"));
+	char *tmpname;
 
+	if (gbs->vgm) {
+		fprintf(stderr, _("Could not write %s: %s\n"), name, _("VGM files have no GBS header"));
+		return 0;
+	}
+	tmpname = malloc(namelen + sizeof(".tmp\0"));
 	memcpy(tmpname, name, namelen);
 	sprintf(&tmpname[namelen], ".tmp");
 	memset(pad, 0xff, sizeof(pad));
 
+	if (gbs_mapped(gbs, gbs->buf)) {
+		/* a mapped file is edited in a copy, its header may be rom */
+		size_t size = gbs->filesize > 0x70 + gbs->codelen ? gbs->filesize : 0x70 + gbs->codelen;
+		char *buf = malloc(size);
+		if (buf == NULL) {
+			fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+			free(tmpname);
+			return 0;
+		}
+		memcpy(buf, gbs->buf, size);
+		if (gbs_mapped(gbs, gbs->rom))
+			memcpy(buf, gbs->header, sizeof(gbs->header));
+		gbs->buf = buf;
+	}
+
 	if ((fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1) {
 		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
 		return 0;
@@ -353,6 +1009,7 @@ static regparm struct gbs *gb_open(const char *name, char *buf, size_t size)
 	char *na_str = _("gb / not available");
 
 	memset(gbs, 0, sizeof(struct gbs));
+	gbhw_init_struct(&gbs->gbhw);
 	gbs->silence_timeout = 2*60;
 	gbs->subsong_timeout = 2*60;
 	gbs->gap = 2;
@@ -373,7 +1030,7 @@ static regparm struct gbs *gb_open(const char *name, char *buf, size_t size)
 	snprintf(bootname, name_len, "%s/%s", getenv("HOME"), boot_rom_file);
 	if ((fd = open(bootname, O_RDONLY)) != -1) {
 		if (read(fd, bootrom, sizeof(bootrom)) == sizeof(bootrom)) {
-			gbhw_enable_bootrom(bootrom);
+			gbhw_enable_bootrom(&gbs->gbhw, bootrom);
 			gbs->init = 0;
 		}
 	}
@@ -395,8 +1052,10 @@ static regparm struct gbs *gb_open(const char *name, char *buf, size_t size)
 	gbs->code = buf;
 	gbs->filesize = size;
 
-	gbs->subsong_info = malloc(gbs->songs * sizeof(struct gbs_subsong_info));
-	memset(gbs->subsong_info, 0, gbs->songs * sizeof(struct gbs_subsong_info));
+	if (!gbs_alloc_arena(gbs, 0)) {
+		gbs_free(gbs);
+		return NULL;
+	}
 	gbs->codelen = size - 0x20;
 	gbs->crcnow = gbs_crc32(0, buf, gbs->filesize);
 	gbs->romsize = (gbs->codelen + 0x3fff) & ~0x3fff;
@@ -418,6 +1077,7 @@ static regparm struct gbs *gbr_open(const char *name, char *buf, size_t size)
 	uint16_t timer_addr;
 
 	memset(gbs, 0, sizeof(struct gbs));
+	gbhw_init_struct(&gbs->gbhw);
 	gbs->silence_timeout = 2;
 	gbs->subsong_timeout = 2*60;
 	gbs->gap = 2;
@@ -471,8 +1131,10 @@ static regparm struct gbs *gbr_open(const char *name, char *buf, size_t size)
 	gbs->code = &buf[0x20];
 	gbs->filesize = size;
 
-	gbs->subsong_info = malloc(gbs->songs * sizeof(struct gbs_subsong_info));
-	memset(gbs->subsong_info, 0, gbs->songs * sizeof(struct gbs_subsong_info));
+	if (!gbs_alloc_arena(gbs, 0)) {
+		gbs_free(gbs);
+		return NULL;
+	}
 	gbs->codelen = size - 0x20;
 	gbs->crcnow = gbs_crc32(0, buf, gbs->filesize);
 	gbs->romsize = (gbs->codelen + 0x3fff) & ~0x3fff;
@@ -495,6 +1157,8 @@ static regparm struct gbs *gbr_open(const char *name, char *buf, size_t size)
 		gbs->rom[0x52] = timer_addr >> 8;
 	}
 
+	/* the title refers to buf */
+	gbs->buf = buf;
 	return gbs;
 }
 
@@ -510,24 +1174,8 @@ static uint16_t le16(const char *buf)
 	return b[0] | (b[1] << 8);
 }
 
-static void emit(struct gbs *gbs, long *code_used, uint8_t data, long reserve)
-{
-	long remain = gbs->codelen - *code_used;
-	uint8_t *code = (uint8_t*) &gbs->code[*code_used];
-	if (reserve + 1 > remain) {
-		while (remain-- > 0) {
-			*(code++) = 0xc9;  /* RET */
-			(*code_used)++;
-		}
-		gbs->code = realloc(gbs->code, gbs->codelen + 0x4000);
-		gbs->codelen += 0x4000;
-		code = (uint8_t*) &gbs->code[*code_used];
-	}
-	*(code++) = data;
-	(*code_used)++;
-}
-
-static regparm void gd3_parse(struct gbs **gbs, const char *gd3, long gd3_len)
+/* The strings go to the arena, it needs gd3_len / 2 bytes. */
+static regparm void gd3_parse(struct gbs *gbs, const char *gd3, long gd3_len)
 {
 	char *buf;
 	char *s;
@@ -545,16 +1193,15 @@ static regparm void gd3_parse(struct gbs **gbs, const char *gd3, long gd3_len)
 	if (le32(&gd3[8]) != gd3_len - ofs) {
 		return;
 	}
-	*gbs = realloc(*gbs, sizeof(struct gbs) + gd3_len);
-	s = buf = (char *)&(*gbs)[1];
-	while (ofs < gd3_len) {
+	s = buf = gbs->arenastrings;
+	while (ofs + 1 < gd3_len) {
 		uint16_t val = le16(&gd3[ofs]);
 		if (val == 0) {
 			*(buf++) = 0;
 			switch (idx) {
-			case 0: (*gbs)->subsong_info[0].title = s; break;
-			case 2: (*gbs)->title = s; break;
-			case 6: (*gbs)->author = s; break;
+			case 0: gbs->subsong_info[0].title = s; break;
+			case 2: gbs->title = s; break;
+			case 6: gbs->author = s; break;
 			default: break;
 			}
 			s = buf;
@@ -568,6 +1215,75 @@ static regparm void gd3_parse(struct gbs **gbs, const char *gd3, long gd3_len)
 	}
 }
 
+/* Length of the VGM command at cmd, 0 for unsupported commands. */
+static regparm long vgm_cmdlen(uint8_t cmd)
+{
+	switch (cmd) {
+	case 0x61:  /* Wait n samples */
+	case 0xb3:  /* DMG write */
+		return 3;
+	case 0x62:  /* Wait 735 (1/60s) */
+	case 0x63:  /* Wait 882 (1/50s) */
+	case 0x66:  /* End of sound data */
+		return 1;
+	default:
+		/* 0x70-0x7f: Wait n+1 samples */
+		return (cmd & 0xf0) == 0x70;
+	}
+}
+
+/* Samples the VGM command at cmd waits for. */
+static regparm long vgm_wait(const char *cmd)
+{
+	switch ((uint8_t)*cmd) {
+	case 0x61:
+		return le16(&cmd[1]);
+	case 0x62:
+		return 735;
+	case 0x63:
+		return 882;
+	case 0x66:
+	case 0xb3:
+		return 0;
+	default:
+		return (*cmd & 0xf) + 1;
+	}
+}
+
+/*
+ * VGM files are not converted to code, the commands are played as
+ * they are: a player walks them in place of the cpu and each DMG
+ * write goes to the hardware at the cycle its sample position falls
+ * on.  At the end the stream continues at its loop offset, a stream
+ * without loop stays silent.
+ */
+static regparm long vgm_play(struct gbhw *gbhw, long cycles, void *priv)
+{
+	struct gbs *gbs = priv;
+	long long due;
+
+	while ((due = gbs->vgm_samples * GBHW_CLOCK / VGM_RATE) <= gbs->vgm_cycles) {
+		const char *cmd = &gbs->vgm[gbs->vgm_pos];
+
+		if ((uint8_t)*cmd == 0x66) {
+			if (gbs->vgm_loop < 0) {
+				due = gbs->vgm_cycles + cycles;
+				break;
+			}
+			gbs->vgm_pos = gbs->vgm_loop;
+			continue;
+		}
+		if ((uint8_t)*cmd == 0xb3)
+			gbhw_io_put(gbhw, 0xff10 + ((uint8_t)cmd[1] & 0x7f), cmd[2]);
+		gbs->vgm_samples += vgm_wait(cmd);
+		gbs->vgm_pos += vgm_cmdlen(*cmd);
+	}
+	if (due - gbs->vgm_cycles < cycles)
+		cycles = due - gbs->vgm_cycles;
+	gbs->vgm_cycles += cycles;
+	return cycles;
+}
+
 static regparm struct gbs *vgm_open(const char *name, char *buf, size_t size)
 {
 	struct gbs *gbs = malloc(sizeof(struct gbs));
@@ -580,19 +1296,17 @@ static regparm struct gbs *vgm_open(const char *name, char *buf, size_t size)
 	long gd3_len;
 	long data_ofs;
 	long data_len;
-	long vgm_parsed = false;
-	long total_wait;
-	long total_clocks;
-	long code_used;
-	long addr;
-	long jpaddr;
+	long loop_ofs;
+	long pos;
+	long long total_wait;
+	long long loop_wait = -1;
 
 	memset(gbs, 0, sizeof(struct gbs));
+	gbhw_init_struct(&gbs->gbhw);
 	gbs->silence_timeout = 2;
 	gbs->subsong_timeout = 2*60;
 	gbs->gap = 2;
 	gbs->fadeout = 3;
-	gbs->buf = buf;
 	if (strncmp(buf, VGM_MAGIC, 4) != 0) {
 		fprintf(stderr, _("Not a VGM-File: %s\n"), name);
 		gbs_free(gbs);
@@ -636,79 +1350,45 @@ static regparm struct gbs *vgm_open(const char *name, char *buf, size_t size)
 		gbs_free(gbs);
 		return NULL;
 	}
+	loop_ofs = le32(&buf[0x1c]) ? le32(&buf[0x1c]) + 0x1c - data_ofs : -1;
 
-	gbs->codelen = 0x4000;
-	gbs->code = calloc(1, gbs->codelen);
-	code_used = 0;
-
-	total_wait = total_clocks = 0;
-	while (!vgm_parsed) {
-		switch ((uint8_t)*data) {
-		default:
-			fprintf(stderr, _("Unsupported VGM opcode: 0x%02x\n"), *data);
+	/* check the commands once, the player trusts them */
+	total_wait = 0;
+	for (pos = 0; ; pos += vgm_cmdlen(data[pos])) {
+		if (pos >= data_len || pos + vgm_cmdlen(data[pos]) > data_len) {
+			fprintf(stderr, _("Bad data length: %d\n"), data_len);
 			gbs_free(gbs);
 			return NULL;
-		case 0x61:  /* Wait n samples */
-			total_wait += le16(&data[1]);
-			data += 2;
-			break;
-		case 0x62:  /* Wait 735 (1/60s) */
-			total_wait += 735;
-			break;
-		case 0x63:  /* Wait 882 (1/50s) */
-			total_wait += 882;
-			break;
-		case 0x66:  /* End of sound data */
-			vgm_parsed = true;
-			break;
-		case 0x70:
-		case 0x71:
-		case 0x72:
-		case 0x73:
-		case 0x74:
-		case 0x75:
-		case 0x76:
-		case 0x77:
-		case 0x78:
-		case 0x79:
-		case 0x7a:
-		case 0x7b:
-		case 0x7c:
-		case 0x7d:
-		case 0x7e:
-		case 0x7f:
-			/* Wait n+1 samples */
-			total_wait += (*data & 0xf) + 1;
-			break;
-		case 0xb3:  /* DMG write */
-			{
-				long delay = (total_wait * 41943L / 441L) - total_clocks;
-				long units = (delay + 31) / 64;
-				uint8_t reg = 0x10 + ((uint8_t)data[1] & 0x7f);
-				uint8_t val = (uint8_t)data[2];
-
-				while (units > 0) {
-					long d = units > 0x10000 ?  0x10000 : units;
-					emit(gbs, &code_used, 0xcf, 3); // RST 0x08
-					emit(gbs, &code_used, (d - 1) & 0xff, 0);
-					emit(gbs, &code_used, (d - 1) >> 8, 0);
-					units -= d;
-					total_clocks += d * 64;
-				}
-				/* LD a, imm8 */
-				emit(gbs, &code_used, 0x3e, 4);
-				emit(gbs, &code_used, val, 0);
-				/* LDH (a8), A */
-				emit(gbs, &code_used, 0xe0, 0);
-				emit(gbs, &code_used, reg, 0);
-			}
-			data += 2;
-			break;
 		}
-		data++;
+		if (vgm_cmdlen(data[pos]) == 0) {
+			fprintf(stderr, _("Unsupported VGM opcode: 0x%02x\n"), (uint8_t)data[pos]);
+			gbs_free(gbs);
+			return NULL;
+		}
+		if (pos == loop_ofs)
+			loop_wait = total_wait;
+		if ((uint8_t)data[pos] == 0x66)
+			break;
+		total_wait += vgm_wait(&data[pos]);
+	}
+	/* a loop has to start on a command and wait for something */
+	if (loop_wait < 0 || loop_wait == total_wait)
+		loop_ofs = -1;
+
+	gbs->vgm = data;
+	gbs->vgm_loop = loop_ofs;
+	gbhw_setplayer(&gbs->gbhw, vgm_play, gbs);
+
+	/* the cpu does not run, it gets an empty rom */
+	gbs->code = data;
+	gbs->codelen = data_len;
+	gbs->romsize = 0x8000;
+	gbs->rom = calloc(1, gbs->romsize);
+	if (gbs->rom == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		gbs_free(gbs);
+		return NULL;
 	}
-	/* RST 0x38 */
-	emit(gbs, &code_used, 0xff, 1);
 
 	gbs->version = 0;
 	gbs->songs = 1;
@@ -726,76 +1406,30 @@ static regparm struct gbs *vgm_open(const char *name, char *buf, size_t size)
 	gbs->filesize = size;
 	gbs->crcnow = gbs_crc32(0, buf, gbs->filesize);
 
-	gbs->subsong_info = malloc(gbs->songs * sizeof(struct gbs_subsong_info));
-	memset(gbs->subsong_info, 0, gbs->songs * sizeof(struct gbs_subsong_info));
-	gbs->subsong_info[0].len = total_clocks / 4096;
+	if (!gbs_alloc_arena(gbs, gd3_len <= 4096 ? gd3_len / 2 : 0)) {
+		gbs_free(gbs);
+		return NULL;
+	}
+	gbs->subsong_info[0].len = total_wait * GBS_LEN_DIV / VGM_RATE;
+	if (loop_ofs >= 0) {
+		gbs->subsong_info[0].intro = loop_wait * GBS_LEN_DIV / VGM_RATE;
+		gbs->subsong_info[0].loop = gbs->subsong_info[0].len - gbs->subsong_info[0].intro;
+	}
 
 	if (gd3_len > 0) {
-		gd3_parse(&gbs, gd3, gd3_len);
+		gd3_parse(gbs, gd3, gd3_len);
 	}
 
-	gbs->romsize = gbs->codelen + 0x4000;
-	gbs->rom = calloc(1, gbs->romsize);
-	memcpy(&gbs->rom[0x4000], gbs->code, gbs->codelen);
-
-	/* 16 + 52 for RST + setup */
-	addr = 0x8;
-	gbs->rom[addr++] = 0xe1; /* 12: pop hl */
-	gbs->rom[addr++] = 0x2a; /*  8: ld a, (hl+) */
-	gbs->rom[addr++] = 0x5f; /*  4: ld e, a */
-	gbs->rom[addr++] = 0x2a; /*  8: ld a, (hl+) */
-	gbs->rom[addr++] = 0x57; /*  4: ld d, a */
-	gbs->rom[addr++] = 0xe5; /* 16: push hl */
-
-	/* 64 cycles for loop */
-	jpaddr = addr;
-	gbs->rom[addr++] = 0x7a; /*  4: ld a, d */
-	gbs->rom[addr++] = 0xb3; /*  4: or e */
-	gbs->rom[addr++] = 0xc8; /*  8: ret z */
-	gbs->rom[addr++] = 0x1b; /*  8: dec de */
-	gbs->rom[addr++] = 0x23; /*  8: inc hl */
-	gbs->rom[addr++] = 0x23; /*  8: inc hl */
-	gbs->rom[addr++] = 0x23; /*  8: inc hl */
-	gbs->rom[addr++] = 0xc3; /* 16: jp @loop */
-	gbs->rom[addr++] = jpaddr & 0xff;
-	gbs->rom[addr++] = jpaddr >> 8;
-
-	/* Trap opcode 0xff (rst 0x38) execution */
-	jpaddr = addr = 0x38;
-	gbs->rom[addr++] = 0xf3; /* di */
-	gbs->rom[addr++] = 0x76; /* halt */
-	gbs->rom[addr++] = 0xc3; /* jp $ */
-	gbs->rom[addr++] = jpaddr & 0xff;
-	gbs->rom[addr++] = jpaddr >> 8;
-
-	gbs->rom[0x0040] = 0xd9; /* reti */
-	gbs->rom[0x0050] = 0xd9; /* reti */
-
-	addr = 0x440;
-	gbs->rom[addr++] = 0xf3; /* di */
-	gbs->rom[addr++] = 0x3e; /* ld a, 1 */
-	gbs->rom[addr++] = 0x01;
-	jpaddr = addr;
-	gbs->rom[addr++] = 0xe0; /* ldh (0x80), a */
-	gbs->rom[addr++] = 0x80;
-	gbs->rom[addr++] = 0x21; /* ld hl, 0x2000 */
-	gbs->rom[addr++] = 0x00;
-	gbs->rom[addr++] = 0x20;
-	gbs->rom[addr++] = 0x77; /* ld (hl), a */
-	gbs->rom[addr++] = 0xcd; /* call 0x4000 */
-	gbs->rom[addr++] = 0x00;
-	gbs->rom[addr++] = 0x40;
-	gbs->rom[addr++] = 0xf0; /* ldh a, (0x80) */
-	gbs->rom[addr++] = 0x80;
-	gbs->rom[addr++] = 0x3c; /* inc a */
-	gbs->rom[addr++] = 0xc3; /* jp @loop */
-	gbs->rom[addr++] = jpaddr & 0xff;
-	gbs->rom[addr++] = jpaddr >> 8;
-
+	/* the commands are played from buf */
+	gbs->buf = buf;
 	return gbs;
 }
 
-static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t size)
+/*
+ * With rom_in_place, buf is mapped so that the rom image can be built
+ * around the code at its load address, see gbs_map().
+ */
+static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t size, long rom_in_place)
 {
 	struct gbs *gbs = malloc(sizeof(struct gbs));
 	long i;
@@ -803,6 +1437,7 @@ static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t
 	char *buf2;
 
 	memset(gbs, 0, sizeof(struct gbs));
+	gbhw_init_struct(&gbs->gbhw);
 	gbs->silence_timeout = 2;
 	gbs->subsong_timeout = 2*60;
 	gbs->gap = 2;
@@ -845,8 +1480,10 @@ static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t
 	gbs->code = &buf[0x70];
 	gbs->filesize = size;
 
-	gbs->subsong_info = malloc(gbs->songs * sizeof(struct gbs_subsong_info));
-	memset(gbs->subsong_info, 0, gbs->songs * sizeof(struct gbs_subsong_info));
+	if (!gbs_alloc_arena(gbs, 0)) {
+		gbs_free(gbs);
+		return NULL;
+	}
 	gbs->codelen = (buf[0x6e] + (buf[0x6f] << 8)) << 4;
 	if ((0x70 + gbs->codelen) < (gbs->filesize - 8) &&
 	    strncmp(&buf[0x70 + gbs->codelen], GBS_EXTHDR_MAGIC, 4) == 0) {
@@ -894,7 +1531,7 @@ static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t
 		if (gbs_copyex != 0xffff)
 			gbs->copyright = gbs->strings + gbs_copyex;
 
-		for (i=0; i<entries; i++) {
+		for (i=0; i<entries && i<gbs->songs; i++) {
 			long ofs = readint(&buf2[32 + 8*i + 4], 2);
 			gbs->subsong_info[i].len = readint(&buf2[32 + 8*i], 4);
 			if (ofs == 0xffff)
@@ -910,8 +1547,15 @@ static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t
 
 	gbs->romsize = (gbs->codelen + gbs->load + 0x3fff) & ~0x3fff;
 
-	gbs->rom = calloc(1, gbs->romsize);
-	memcpy(&gbs->rom[gbs->load], gbs->code, gbs->codelen);
+	if (rom_in_place && !have_ehdr) {
+		/* the code stays where it is, the header becomes empty rom */
+		memcpy(gbs->header, buf, sizeof(gbs->header));
+		memset(buf, 0, sizeof(gbs->header));
+		gbs->rom = (uint8_t *)&buf[0x70 - gbs->load];
+	} else {
+		gbs->rom = calloc(1, gbs->romsize);
+		memcpy(&gbs->rom[gbs->load], gbs->code, gbs->codelen);
+	}
 
 	for (i=0; i<8; i++) {
 		long addr = gbs->load + 8*i; /* jump address */
@@ -947,58 +1591,380 @@ static regparm struct gbs *gbs_open_internal(const char *name, char *buf, size_t
 	gbs->rom[0x58] = 0xd9; /* reti (Serial) */
 	gbs->rom[0x60] = 0xd9; /* reti (Joypad) */
 
+	/* the instance refers to buf */
+	gbs->buf = buf;
 	return gbs;
 }
 
 #ifdef USE_ZLIB
+/*
+ * Inflate step by step into a buffer sized from the ISIZE trailer,
+ * the uncompressed size modulo 2^32.  That is only a hint, truncated
+ * files or several members make it wrong, so the buffer still grows
+ * as needed up to the maximum rom size and is trimmed at the end.
+ */
 static regparm struct gbs *gzip_open(const char *name, char *buf, size_t size)
 {
 	struct gbs *gbs;
 	int ret;
-	char *out = malloc(GB_MAX_ROM_SIZE);
+	size_t isize = size >= 18 ? le32(&buf[size - 4]) : 0;
+	size_t alloc;
+	size_t len = 0;
+	char *out, *tmp;
 	z_stream strm;
 
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
+	if (isize > GB_MAX_ROM_SIZE)
+		isize = 0;
+	alloc = isize + 1; /* room to see the stream end */
+	if ((out = malloc(alloc)) == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return NULL;
+	}
+
+	memset(&strm, 0, sizeof(strm));
 	strm.next_in = (Bytef*)buf;
 	strm.avail_in = size;
-	strm.next_out = (Bytef*)out;
-	strm.avail_out = GB_MAX_ROM_SIZE;
 
 	/* inflate with gzip auto-detect */
 	ret = inflateInit2(&strm, 15|32);
 	if (ret != Z_OK) {
 		fprintf(stderr, _("Could not open %s: inflateInit2: %d\n"), name, ret);
+		free(out);
 		return NULL;
 	}
 
-	ret = inflate(&strm, Z_FINISH);
+	do {
+		if (len == alloc) {
+			if (alloc > GB_MAX_ROM_SIZE) {
+				fprintf(stderr, _("Could not read %s: %s\n"), name, _("Bigger than allowed maximum (4MiB)"));
+				goto exit_free;
+			}
+			alloc = alloc < GB_MAX_ROM_SIZE / 2 ? 2 * alloc : GB_MAX_ROM_SIZE + 1;
+			if ((tmp = realloc(out, alloc)) == NULL) {
+				fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+				goto exit_free;
+			}
+			out = tmp;
+		}
+		strm.next_out = (Bytef*)&out[len];
+		strm.avail_out = alloc - len;
+		ret = inflate(&strm, Z_NO_FLUSH);
+		len = alloc - strm.avail_out;
+	} while (ret == Z_OK);
+
 	if (ret != Z_STREAM_END) {
 		fprintf(stderr, _("Could not open %s: inflate: %d\n"), name, ret);
-		return NULL;
+		goto exit_free;
 	}
 	inflateEnd(&strm);
-	gbs = gbs_open_mem(name, out, GB_MAX_ROM_SIZE - strm.avail_out);
-	if (gbs == NULL) {
+
+	if (len < alloc && len > 0 && (tmp = realloc(out, len)) != NULL)
+		out = tmp;
+	gbs = gbs_open_mem(name, out, len);
+	if (gbs == NULL || gbs->buf != out) {
 		free(out);
 	}
 
 	return gbs;
+
+exit_free:
+	inflateEnd(&strm);
+	free(out);
+	return NULL;
 }
 #else
-static regparm struct gbs *gzip_open(char *name)
+static regparm struct gbs *gzip_open(const char *name, char *buf, size_t size)
 {
 	fprintf(stderr, _("Could not open %s: %s\n"), name, _("Not compiled with zlib support"));
 	return NULL;
 }
 #endif
 
-regparm struct gbs *gbs_open_mem(const char *name, char *buf, size_t size)
+/*
+ * ZIP archives are read through their central directory and only the
+ * selected member is inflated.  Members are selected by their path in
+ * the archive or just their file name, without a selection the first
+ * .gbs member is used, or the first file if there is none.
+ */
+#define ZIP_EOCD_LEN	22
+#define ZIP_CDIR_LEN	46
+#define ZIP_EOCD_SIG	0x06054b50
+#define ZIP_CDIR_SIG	0x02014b50
+
+static regparm long zip_match(const char *entry, size_t len, const char *member)
+{
+	const char *base = entry + len;
+	size_t mlen = strlen(member);
+
+	while (base > entry && base[-1] != '/')
+		base--;
+	return (len == mlen && memcmp(entry, member, len) == 0) ||
+	       (entry + len - base == mlen && memcmp(base, member, mlen) == 0);
+}
+
+/* Returns the end of central directory record, NULL if there is none. */
+static regparm const char *zip_eocd(const char *name, const char *buf, size_t size)
+{
+	const char *eocd = NULL;
+	size_t ofs;
+
+	for (ofs = size >= ZIP_EOCD_LEN ? size - ZIP_EOCD_LEN + 1 : 0;
+	     ofs > 0 && size - ofs < ZIP_EOCD_LEN + 0xffff; ofs--) {
+		if (le32(&buf[ofs - 1]) == ZIP_EOCD_SIG) {
+			eocd = &buf[ofs - 1];
+			break;
+		}
+	}
+	if (eocd == NULL || le32(&eocd[16]) > eocd - buf ||
+	    le32(&eocd[12]) > eocd - buf - le32(&eocd[16])) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, _("Not a ZIP archive"));
+		return NULL;
+	}
+	return eocd;
+}
+
+/* Returns the central directory entry of the member, NULL if not found. */
+static regparm const char *zip_find(const char *name, const char *buf, size_t size, const char *member)
+{
+	const char *eocd = zip_eocd(name, buf, size);
+	const char *cd, *end;
+	const char *first = NULL;
+	long entries;
+
+	if (eocd == NULL)
+		return NULL;
+
+	entries = le16(&eocd[10]);
+	cd = &buf[le32(&eocd[16])];
+	end = cd + le32(&eocd[12]);
+	for (; entries > 0; entries--) {
+		const char *entry = &cd[ZIP_CDIR_LEN];
+		size_t len;
+
+		if (end - cd < ZIP_CDIR_LEN || le32(cd) != ZIP_CDIR_SIG)
+			break;
+		len = le16(&cd[28]);
+		if ((size_t)(end - entry) < len)
+			break;
+		if (member) {
+			if (zip_match(entry, len, member))
+				return cd;
+		} else if (len > 0 && entry[len - 1] != '/') {
+			if (len > 4 && strncasecmp(&entry[len - 4], ".gbs", 4) == 0)
+				return cd;
+			if (first == NULL)
+				first = cd;
+		}
+		cd = entry + len + le16(&cd[30]) + le16(&cd[32]);
+		if (cd > end)
+			break;
+	}
+	if (first)
+		return first;
+
+	fprintf(stderr, _("Could not open %s: %s\n"), name, _("No such member in ZIP archive"));
+	return NULL;
+}
+
+#ifdef USE_ZLIB
+static regparm long zip_inflate(char *out, size_t usize, const char *data, size_t csize)
+{
+	z_stream strm;
+	long ret;
+
+	memset(&strm, 0, sizeof(strm));
+	strm.next_in = (Bytef*)data;
+	strm.avail_in = csize;
+	strm.next_out = (Bytef*)out;
+	strm.avail_out = usize;
+	/* ZIP members are raw deflate streams */
+	if (inflateInit2(&strm, -15) != Z_OK)
+		return false;
+	ret = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+
+	return ret == Z_STREAM_END && strm.avail_out == 0;
+}
+#else
+static regparm long zip_inflate(char *out, size_t usize, const char *data, size_t csize)
+{
+	return false;
+}
+#endif
+
+static regparm struct gbs *zip_open(const char *name, const char *buf, size_t size, const char *member)
+{
+	const char *cd = zip_find(name, buf, size, member);
+	struct gbs *gbs;
+	long method, ok;
+	size_t ofs, csize, usize;
+	char *out;
+
+	if (cd == NULL)
+		return NULL;
+
+	method = le16(&cd[10]);
+	csize = le32(&cd[20]);
+	usize = le32(&cd[24]);
+	ofs = le32(&cd[42]);
+	if (usize > GB_MAX_ROM_SIZE) {
+		fprintf(stderr, _("Could not read %s: %s\n"), name, _("Bigger than allowed maximum (4MiB)"));
+		return NULL;
+	}
+	if (size < HDR_LEN_ZIP || ofs > size - HDR_LEN_ZIP ||
+	    strncmp(&buf[ofs], ZIP_MAGIC, 4) != 0 ||
+	    (ofs += HDR_LEN_ZIP + le16(&buf[ofs + 26]) + le16(&buf[ofs + 28])) > size ||
+	    csize > size - ofs) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, _("Corrupt ZIP archive"));
+		return NULL;
+	}
+#ifndef USE_ZLIB
+	if (method == 8) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, _("Not compiled with zlib support"));
+		return NULL;
+	}
+#endif
+	if (method != 0 && method != 8) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, _("Unsupported ZIP compression method"));
+		return NULL;
+	}
+	if ((out = malloc(usize + 1)) == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return NULL;
+	}
+	if (method == 8)
+		ok = zip_inflate(out, usize, &buf[ofs], csize);
+	else if ((ok = csize == usize))
+		memcpy(out, &buf[ofs], usize);
+	if (!ok || gbs_crc32(0, out, usize) != le32(&cd[16])) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, _("Corrupt ZIP archive"));
+		free(out);
+		return NULL;
+	}
+
+	gbs = gbs_open_mem(name, out, usize);
+	if (gbs == NULL || gbs->buf != out) {
+		free(out);
+	}
+
+	return gbs;
+}
+
+/*
+ * Open a member of a ZIP file.  The archive is mapped where possible,
+ * so only the central directory and the member itself are read.
+ */
+static regparm struct gbs *zip_open_file(const char *name, int fd, size_t size, const char *member)
+{
+	struct gbs *gbs = NULL;
+	char *buf;
+
+#ifdef HAVE_MMAP
+	if (size > 0 && (buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+		gbs = zip_open(name, buf, size, member);
+		munmap(buf, size);
+		return gbs;
+	}
+#endif
+
+	if ((buf = malloc(size + 1)) == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return NULL;
+	}
+	if (read(fd, buf, size) != (ssize_t)size)
+		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
+	else gbs = zip_open(name, buf, size, member);
+	free(buf);
+	return gbs;
+}
+
+/* Call cb with the name of every file in the central directory. */
+static regparm long zip_list(const char *name, const char *buf, size_t size, gbs_member_cb cb, void *priv)
+{
+	const char *eocd = zip_eocd(name, buf, size);
+	const char *cd, *end;
+	char *member;
+	long entries;
+
+	if (eocd == NULL)
+		return false;
+
+	entries = le16(&eocd[10]);
+	cd = &buf[le32(&eocd[16])];
+	end = cd + le32(&eocd[12]);
+	for (; entries > 0; entries--) {
+		const char *entry = &cd[ZIP_CDIR_LEN];
+		size_t len;
+
+		if (end - cd < ZIP_CDIR_LEN || le32(cd) != ZIP_CDIR_SIG)
+			break;
+		len = le16(&cd[28]);
+		if ((size_t)(end - entry) < len)
+			break;
+		if (len > 0 && entry[len - 1] != '/') {
+			if ((member = malloc(len + 1)) == NULL) {
+				fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+				return false;
+			}
+			memcpy(member, entry, len);
+			member[len] = 0;
+			cb(member, priv);
+			free(member);
+		}
+		cd = entry + len + le16(&cd[30]) + le16(&cd[32]);
+		if (cd > end)
+			break;
+	}
+	return true;
+}
+
+/*
+ * List the members of a ZIP archive, each can be opened as
+ * name#member.  Returns false if name is no readable ZIP archive.
+ */
+regparm long gbs_zip_members(const char *name, gbs_member_cb cb, void *priv)
+{
+	struct stat st;
+	long ret = false;
+	char *buf;
+	int fd;
+
+	if ((fd = open(name, O_RDONLY)) == -1) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
+		return false;
+	}
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
+		close(fd);
+		return false;
+	}
+#ifdef HAVE_MMAP
+	if (st.st_size > 0 && (buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+		ret = zip_list(name, buf, st.st_size, cb, priv);
+		munmap(buf, st.st_size);
+		close(fd);
+		return ret;
+	}
+#endif
+
+	if ((buf = malloc(st.st_size + 1)) == NULL)
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+	else if (read(fd, buf, st.st_size) != (ssize_t)st.st_size)
+		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
+	else ret = zip_list(name, buf, st.st_size, cb, priv);
+	free(buf);
+	close(fd);
+	return ret;
+}
+
+static regparm struct gbs *gbs_open_buf(const char *name, char *buf, size_t size, long rom_in_place)
 {
 	if (size > HDR_LEN_GZIP && strncmp(buf, GZIP_MAGIC, 3) == 0) {
 		return gzip_open(name, buf, size);
 	}
+	if (size > HDR_LEN_ZIP && strncmp(buf, ZIP_MAGIC, 4) == 0) {
+		return zip_open(name, buf, size, NULL);
+	}
 	if (size > HDR_LEN_GBR && strncmp(buf, GBR_MAGIC, 4) == 0) {
 		return gbr_open(name, buf, size);
 	}
@@ -1006,7 +1972,7 @@ regparm struct gbs *gbs_open_mem(const char *name, char *buf, size_t size)
 		return vgm_open(name, buf, size);
 	}
 	if (size > HDR_LEN_GBS && strncmp(buf, GBS_MAGIC, 3) == 0) {
-		return gbs_open_internal(name, buf, size);
+		return gbs_open_internal(name, buf, size, rom_in_place);
 	}
 	if (size > HDR_LEN_GB && gbs_crc32(0, &buf[0x104], 48) == 0x46195417) {
 		return gb_open(name, buf, size);
@@ -1015,25 +1981,128 @@ regparm struct gbs *gbs_open_mem(const char *name, char *buf, size_t size)
 	return NULL;
 }
 
+regparm struct gbs *gbs_open_mem(const char *name, char *buf, size_t size)
+{
+	struct gbs *gbs = gbs_open_buf(name, buf, size, false);
+
+	if (gbs)
+		gbs_share_rom(gbs);
+	return gbs;
+}
+
+#ifdef HAVE_MMAP
+/*
+ * Map a file privately.  GBS files get zero pages around them, enough
+ * for the rom image to be built around the code at its load address
+ * without copying it.  Returns the file data, the whole mapping is
+ * stored in *map and *mapsize.
+ */
+static regparm char *gbs_map(int fd, size_t size, char **map, size_t *mapsize)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t pre = 0;
+	size_t len = size;
+	char hdr[HDR_LEN_GBS];
+	char *base;
+
+	if (pread(fd, hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+	    strncmp(hdr, GBS_MAGIC, 3) == 0) {
+		size_t load = readint(&hdr[0x06], 2);
+		size_t romsize = (size - 0x70 + load + 0x3fff) & ~0x3fff;
+
+		if (load > 0x70)
+			pre = (load - 0x70 + page - 1) & ~(page - 1);
+		if (romsize + 0x70 - load > len)
+			len = romsize + 0x70 - load;
+	}
+	*mapsize = (pre + len + page - 1) & ~(page - 1);
+	base = mmap(NULL, *mapsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+	if (mmap(base + pre, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(base, *mapsize);
+		return NULL;
+	}
+	*map = base;
+	return base + pre;
+}
+#endif
+
+/*
+ * Open name, or the archive part of archive.zip#member if there is no
+ * such file.  Returns the fd and the member, NULL for plain files.
+ */
+static regparm long gbs_open_fd(const char *name, const char **member)
+{
+	const char *hash;
+	char *path;
+	long fd;
+
+	*member = NULL;
+	if ((fd = open(name, O_RDONLY)) != -1 || errno != ENOENT ||
+	    (hash = strrchr(name, '#')) == NULL)
+		return fd;
+
+	if ((path = malloc(hash - name + 1)) == NULL)
+		return -1;
+	memcpy(path, name, hash - name);
+	path[hash - name] = 0;
+	if ((fd = open(path, O_RDONLY)) != -1)
+		*member = hash + 1;
+	free(path);
+	return fd;
+}
+
 regparm struct gbs *gbs_open(const char *name)
 {
 	struct gbs *gbs = NULL;
+	const char *member;
 	long fd;
 	struct stat st;
 	char *buf;
+	char magic[4];
 
-	if ((fd = open(name, O_RDONLY)) == -1) {
+	if ((fd = gbs_open_fd(name, &member)) == -1) {
 		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
 		return NULL;
 	}
 	fstat(fd, &st);
-	buf = malloc(st.st_size);
-	if (read(fd, buf, st.st_size) != st.st_size) {
-		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
-		goto exit_free;
+	/* archives may be bigger than any of their members */
+	if (member || (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+	               strncmp(magic, ZIP_MAGIC, 4) == 0)) {
+		gbs = zip_open_file(name, fd, st.st_size, member);
+		close(fd);
+		return gbs;
 	}
 	if (st.st_size > GB_MAX_ROM_SIZE) {
 		fprintf(stderr, _("Could not read %s: %s\n"), name, _("Bigger than allowed maximum (4MiB)"));
+		close(fd);
+		return NULL;
+	}
+
+#ifdef HAVE_MMAP
+	if (st.st_size > HDR_LEN_GBS) {
+		char *map;
+		size_t mapsize;
+
+		if ((buf = gbs_map(fd, st.st_size, &map, &mapsize)) != NULL) {
+			close(fd);
+			gbs = gbs_open_buf(name, buf, st.st_size, true);
+			/* compressed files do not refer to the mapping */
+			if (gbs && gbs->buf == buf) {
+				gbs->map = map;
+				gbs->mapsize = mapsize;
+			} else munmap(map, mapsize);
+			if (gbs)
+				gbs_share_rom(gbs);
+			return gbs;
+		}
+	}
+#endif
+
+	buf = malloc(st.st_size);
+	if (read(fd, buf, st.st_size) != st.st_size) {
+		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
 		goto exit_free;
 	}
 
@@ -1045,3 +2114,303 @@ exit_free:
 	close(fd);
 	return gbs;
 }
+
+/*
+ * Probing fills a struct gbs_probe from the file header, the GBS
+ * extended header and the VGM GD3 block without loading the file.
+ * Plain files are streamed through once for their crc, gzip files
+ * are only inflated as far as the header and take the crc from the
+ * gzip trailer, their extended header is not seen.
+ */
+#define PROBE_HDR_LEN	0x170	/* the GBR title ends at 0x163 */
+#define PROBE_CHUNK	4096
+#define PROBE_GD3_MAX	4096
+
+static regparm void probe_copy(char *dst, const char *src, long len)
+{
+	if (len > GBS_PROBE_STRLEN - 1)
+		len = GBS_PROBE_STRLEN - 1;
+	strncpy(dst, src, len);
+	dst[len] = 0;
+}
+
+static regparm long probe_crc(int fd, off_t size, uint32_t *crc)
+{
+	char buf[PROBE_CHUNK];
+	unsigned long c = 0;
+	off_t ofs = 0;
+
+	while (ofs < size) {
+		ssize_t n = pread(fd, buf, size - ofs < PROBE_CHUNK ? size - ofs : PROBE_CHUNK, ofs);
+		if (n <= 0)
+			return false;
+		c = gbs_crc32(c, buf, n);
+		ofs += n;
+	}
+	*crc = c;
+	return true;
+}
+
+static regparm off_t probe_exthdr_ofs(const char *buf)
+{
+	return 0x70 + (((uint8_t)buf[0x6e] | ((uint8_t)buf[0x6f] << 8)) << 4);
+}
+
+static regparm void probe_exthdr(struct gbs_probe *probe, int fd, off_t ofs, off_t size)
+{
+	char hdr[8];
+	char *ehdr;
+	long ehdrlen, entries, strofs, i;
+	uint32_t crc;
+
+	if (pread(fd, hdr, sizeof(hdr), ofs) != sizeof(hdr) ||
+	    strncmp(hdr, GBS_EXTHDR_MAGIC, 4) != 0)
+		return;
+	ehdrlen = readint(&hdr[0x04], 4) + 8;
+	if (ehdrlen < 32 || ehdrlen > size - ofs || (ehdr = malloc(ehdrlen)) == NULL)
+		return;
+	if (pread(fd, ehdr, ehdrlen, ofs) != ehdrlen)
+		goto exit_free;
+	crc = readint(&ehdr[0x08], 4);
+	writeint(&ehdr[0x08], 0, 4);
+	entries = (uint8_t)ehdr[0x1c];
+	strofs = 32 + 8*entries;
+	if (gbs_crc32(0, ehdr, ehdrlen) != crc || strofs > ehdrlen)
+		goto exit_free;
+
+	probe->filesize = readint(&ehdr[0x0c], 4);
+	probe->filecrc = readint(&ehdr[0x10], 4);
+	probe->copyright[30] = 0;
+	for (i=0; i<3; i++) {
+		char *dst[3] = { probe->title, probe->author, probe->copyright };
+		long ofs = readint(&ehdr[0x14 + 2*i], 2);
+		if (ofs != 0xffff && strofs + ofs < ehdrlen)
+			probe_copy(dst[i], &ehdr[strofs + ofs], ehdrlen - strofs - ofs);
+	}
+	for (i=0; i<entries; i++)
+		probe->len[i] = readint(&ehdr[32 + 8*i], 4);
+
+exit_free:
+	free(ehdr);
+}
+
+static regparm void probe_gd3(struct gbs_probe *probe, int fd, off_t ofs, long len)
+{
+	char gd3[PROBE_GD3_MAX];
+	char s[GBS_PROBE_STRLEN];
+	long n = 0, idx = 0;
+	long i;
+
+	if (len < 12 || len > PROBE_GD3_MAX ||
+	    pread(fd, gd3, len, ofs) != len ||
+	    strncmp(gd3, GD3_MAGIC, 4) != 0 ||
+	    le32(&gd3[4]) != 0x00000100 ||
+	    le32(&gd3[8]) != len - 12)
+		return;
+
+	for (i=12; i+1<len && idx<=6; i+=2) {
+		uint16_t val = le16(&gd3[i]);
+		if (val == 0) {
+			s[n] = 0;
+			if (idx == 2)
+				strcpy(probe->title, s);
+			else if (idx == 6)
+				strcpy(probe->author, s);
+			n = 0;
+			idx++;
+		} else if (n < GBS_PROBE_STRLEN - 1) {
+			s[n++] = val < 256 ? val : '?';
+		}
+	}
+}
+
+/*
+ * Fill in probe from the header in buf.  fd is the uncompressed file
+ * to read extended headers from, or -1 if there is none.
+ */
+static regparm long probe_parse(struct gbs_probe *probe, int fd, const char *buf, long len, off_t size)
+{
+	long i;
+
+	if (len > HDR_LEN_GBR && strncmp(buf, GBR_MAGIC, 4) == 0) {
+		if (buf[0x05] != 0 || buf[0x07] < 1 || buf[0x07] > 3)
+			return false;
+		probe->songs = 255;
+		probe->defaultsong = 1;
+		strcpy(probe->title, _("gbr / not available"));
+		strcpy(probe->author, probe->title);
+		strcpy(probe->copyright, probe->title);
+		for (i=0x0154; i<0x0163; i++) {
+			if (!(isalnum(buf[i]) || isspace(buf[i])))
+				break;
+		}
+		if (buf[i] == 0)
+			strcpy(probe->title, &buf[0x0154]);
+		return true;
+	}
+	if (len > HDR_LEN_VGM && strncmp(buf, VGM_MAGIC, 4) == 0) {
+		off_t gd3_ofs = le32(&buf[0x14]) + 0x14;
+		off_t eof_ofs = le32(&buf[0x04]) + 0x04;
+
+		if (buf[0x09] != 1 || buf[0x08] < 0x61 ||
+		    le32(&buf[0x80]) != 4194304 || eof_ofs > size)
+			return false;
+		probe->songs = 1;
+		probe->defaultsong = 1;
+		probe->len[0] = (uint64_t)le32(&buf[0x18]) * GBS_LEN_DIV / 44100;
+		strcpy(probe->title, _("vgm / not available"));
+		strcpy(probe->author, probe->title);
+		strcpy(probe->copyright, probe->title);
+		if (fd >= 0 && gd3_ofs != 0x14 && gd3_ofs < eof_ofs)
+			probe_gd3(probe, fd, gd3_ofs, eof_ofs - gd3_ofs);
+		return true;
+	}
+	if (len > HDR_LEN_GBS && strncmp(buf, GBS_MAGIC, 3) == 0) {
+		off_t ehdr_ofs = probe_exthdr_ofs(buf);
+
+		probe->songs = (uint8_t)buf[0x04];
+		probe->defaultsong = (uint8_t)buf[0x05];
+		if (buf[0x03] != 1 || probe->songs < 1 ||
+		    probe->defaultsong < 1 || probe->defaultsong > probe->songs)
+			return false;
+		probe_copy(probe->title, &buf[0x10], 32);
+		probe_copy(probe->author, &buf[0x30], 32);
+		probe_copy(probe->copyright, &buf[0x50], 32);
+		if (fd >= 0 && ehdr_ofs < size - 8)
+			probe_exthdr(probe, fd, ehdr_ofs, size);
+		return true;
+	}
+	if (len > HDR_LEN_GB && gbs_crc32(0, &buf[0x104], 48) == 0x46195417) {
+		probe->songs = 1;
+		probe->defaultsong = 1;
+		strcpy(probe->title, _("gb / not available"));
+		strcpy(probe->author, probe->title);
+		strcpy(probe->copyright, probe->title);
+		for (i=0x0134; i<0x0143; i++) {
+			if (!(isalnum(buf[i]) || isspace(buf[i])))
+				break;
+		}
+		if (buf[i] == 0)
+			strcpy(probe->title, &buf[0x0134]);
+		return true;
+	}
+	return false;
+}
+
+#ifdef USE_ZLIB
+static regparm long probe_gzip(struct gbs_probe *probe, int fd, off_t size)
+{
+	char in[PROBE_CHUNK];
+	char out[PROBE_HDR_LEN];
+	char trailer[8];
+	off_t ofs = 0;
+	long ret = Z_OK;
+	long len;
+	z_stream strm;
+
+	memset(out, 0, sizeof(out));
+	memset(&strm, 0, sizeof(strm));
+	strm.next_out = (Bytef*)out;
+	strm.avail_out = sizeof(out);
+	if (inflateInit2(&strm, 15|32) != Z_OK)
+		return false;
+	do {
+		ssize_t n = pread(fd, in, sizeof(in), ofs);
+		if (n <= 0)
+			break;
+		ofs += n;
+		strm.next_in = (Bytef*)in;
+		strm.avail_in = n;
+		ret = inflate(&strm, Z_NO_FLUSH);
+	} while (ret == Z_OK && strm.avail_out > 0);
+	inflateEnd(&strm);
+
+	if (size < 18 || pread(fd, trailer, sizeof(trailer), size - 8) != sizeof(trailer))
+		return false;
+	probe->filesize = size = le32(&trailer[4]);
+	len = sizeof(out) - strm.avail_out;
+	if (!probe_parse(probe, -1, out, len, size))
+		return false;
+	/* the file crc leaves out the crc fields of an extended header */
+	if (strncmp(out, GBS_MAGIC, 3) == 0) {
+		off_t ehdr_ofs = probe_exthdr_ofs(out);
+		if (ehdr_ofs < size - 8 &&
+		    (ehdr_ofs + 4 > len || strncmp(&out[ehdr_ofs], GBS_EXTHDR_MAGIC, 4) == 0))
+			return true;
+	}
+	probe->crc = le32(&trailer[0]);
+	return true;
+}
+#else
+static regparm long probe_gzip(struct gbs_probe *probe, int fd, off_t size)
+{
+	return false;
+}
+#endif
+
+/* ZIP members have to be inflated anyway, they are simply opened. */
+static regparm long probe_open(struct gbs_probe *probe, const char *name)
+{
+	struct gbs *gbs = gbs_open(name);
+	long i;
+
+	if (gbs == NULL)
+		return false;
+	if (gbs->title)
+		probe_copy(probe->title, gbs->title, strlen(gbs->title));
+	if (gbs->author)
+		probe_copy(probe->author, gbs->author, strlen(gbs->author));
+	if (gbs->copyright)
+		probe_copy(probe->copyright, gbs->copyright, strlen(gbs->copyright));
+	probe->songs = gbs->songs;
+	probe->defaultsong = gbs->defaultsong;
+	probe->filesize = gbs->filesize;
+	probe->crc = gbs->crcnow;
+	probe->filecrc = gbs->crc;
+	for (i=0; i<gbs->songs; i++)
+		probe->len[i] = gbs->subsong_info[i].len;
+	gbs_close(gbs);
+	return true;
+}
+
+/*
+ * Read what is needed for a playlist entry from a file: titles,
+ * subsongs, lengths and the crc, if known.  Much cheaper than
+ * gbs_open() as no rom image is built.
+ */
+regparm long gbs_probe(const char *name, struct gbs_probe *probe)
+{
+	char buf[PROBE_HDR_LEN];
+	const char *member;
+	struct stat st;
+	ssize_t len;
+	long ret;
+	int fd;
+
+	memset(probe, 0, sizeof(*probe));
+	if ((fd = gbs_open_fd(name, &member)) == -1) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
+		return false;
+	}
+	memset(buf, 0, sizeof(buf));
+	if (fstat(fd, &st) == -1 || (len = pread(fd, buf, sizeof(buf), 0)) < 0) {
+		fprintf(stderr, _("Could not read %s: %s\n"), name, strerror(errno));
+		close(fd);
+		return false;
+	}
+	probe->filesize = st.st_size;
+
+	if (member || (len > HDR_LEN_ZIP && strncmp(buf, ZIP_MAGIC, 4) == 0)) {
+		close(fd);
+		return probe_open(probe, name);
+	}
+	if (len > HDR_LEN_GZIP && strncmp(buf, GZIP_MAGIC, 3) == 0)
+		ret = probe_gzip(probe, fd, st.st_size);
+	else if ((ret = probe_parse(probe, fd, buf, len, st.st_size)))
+		ret = probe_crc(fd, probe->filesize, &probe->crc);
+	close(fd);
+
+	if (!ret)
+		fprintf(stderr, _("Not a GBS-File: %s\n"), name);
+	return ret;
+}
@@ -11,19 +11,31 @@
 
 #include <inttypes.h>
 #include "common.h"
+#include "gbhw.h"
 
 #define GBS_LEN_SHIFT	10
 #define GBS_LEN_DIV	(1 << GBS_LEN_SHIFT)
 
 struct gbs;
+struct songcache;
+struct gbs_romimage;
 
 typedef regparm long (*gbs_nextsubsong_cb)(struct gbs *gbs, void *priv);
+typedef regparm void (*gbs_member_cb)(const char *member, void *priv);
 
 struct gbs_subsong_info {
 	uint32_t len;
+	uint32_t intro;	/* set by gbs_detect_length(), like len */
+	uint32_t loop;
 	char *title;
 };
 
+struct gbs_keyframe {
+	long long ticks;
+	long size;
+	char *data;
+};
+
 struct gbs {
 	char *buf;
 	uint8_t version;
@@ -52,18 +64,67 @@ struct gbs {
 	unsigned long romsize;
 
 	long long ticks;
+	long sample_remainder;	/* GBHW_CLOCK * samples % rate left over by gbs_step_samples() */
 	int16_t lmin, lmax, lvol, rmin, rmax, rvol;
 	long subsong_timeout, silence_timeout, fadeout, gap;
 	long long silence_start;
 	int subsong;
 	gbs_nextsubsong_cb nextsubsong_cb;
 	void *nextsubsong_cb_priv;
+
+	long keyframe_interval;	/* seconds between seek keyframes, 0 to disable */
+	long keyframe_subsong;
+	long keyframes;
+	struct gbs_keyframe *keyframe;
+
+	char *arena;		/* subsong_info and strings */
+	char *arenastrings;
+	char *map;		/* mmap()ed file, see gbs_open() */
+	size_t mapsize;
+	char header[0x70];	/* GBS header when it became part of the rom */
+	struct gbs_romimage *romimage;	/* rom shared with other instances */
+
+	const char *vgm;	/* VGM commands, played by vgm_play() */
+	long vgm_loop;		/* offset the commands loop to, -1 if they do not */
+	long vgm_pos;
+	long long vgm_samples;	/* samples waited for up to vgm_pos */
+	long long vgm_cycles;	/* cycles played */
+
+	char *cachestrings;	/* titles from gbs_songcache_apply() */
+	size_t cachestrings_size;
+
+	struct gbhw gbhw;
+};
+
+#define GBS_PROBE_STRLEN	256
+
+/* What gbs_probe() finds out about a file, lengths and crc are 0 if unknown. */
+struct gbs_probe {
+	char title[GBS_PROBE_STRLEN];
+	char author[GBS_PROBE_STRLEN];
+	char copyright[GBS_PROBE_STRLEN];
+	long songs;
+	long defaultsong;
+	size_t filesize;	/* like gbs->filesize */
+	uint32_t crc;		/* like gbs->crcnow */
+	uint32_t filecrc;	/* like gbs->crc, from the extended header */
+	uint32_t len[256];	/* like subsong_info[].len */
 };
 
 regparm /*@only@*/ /*@null@*/ struct gbs *gbs_open(const char *name);
 regparm /*@only@*/ /*@null@*/ struct gbs *gbs_open_mem(const char *name, char *buf, size_t size);
+regparm long gbs_probe(const char *name, struct gbs_probe *probe);
+regparm long gbs_zip_members(const char *name, gbs_member_cb cb, void *priv);
 regparm long gbs_init(struct gbs *gbs, long subsong);
 regparm long gbs_step(struct gbs *gbs, long time_to_work);
+regparm long gbs_step_samples(struct gbs *gbs, long samples);
+regparm long gbs_seek(struct gbs *gbs, long msec);
+regparm long gbs_render(struct gbs *gbs, int16_t *out, long frames);
+regparm long gbs_detect_length(struct gbs *gbs, long subsong, long max_secs);
+regparm long gbs_songcache_apply(struct gbs *gbs, struct songcache *cache);
+regparm void gbs_songcache_update(struct gbs *gbs, struct songcache *cache);
+regparm long gbs_snapshot_save(struct gbs *gbs, void *buf, long size);
+regparm long gbs_snapshot_load(struct gbs *gbs, const void *buf, long size);
 regparm void gbs_set_nextsubsong_cb(struct gbs *gbs, gbs_nextsubsong_cb cb, void *priv);
 regparm void gbs_printinfo(struct gbs *gbs, long verbose);
 regparm void gbs_close(/*@only@*/ /*@out@*/ struct gbs *gbs);
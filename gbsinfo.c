@@ -8,26 +8,55 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <math.h>
 
 #include "common.h"
 #include "gbhw.h"
 #include "gbcpu.h"
 #include "gbs.h"
+#include "cfgparser.h"
+#include "songcache.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define DETECT_SECS	(10*60)
+#define LEVEL_RATE	44100
+#define LEVEL_CHUNK	4096
+
+#define SCAN_JSON	0
+#define SCAN_TSV	1
 
 /* global variables */
 char *myname;
+long detect_lengths = 0;
+long scan_mode = 0;
+long scan_format = SCAN_JSON;
+long scan_threads = 0;
 
 void usage(long exitcode)
 {
         FILE *out = exitcode ? stderr : stdout;
         fprintf(out,
                 _("Usage: %s [option] <gbs-file>\n"
+		  "       %s -r [option] <file or directory>...\n"
 		  "\n"
 		  "Available options are:\n"
+		  "  -f  record format for -r: json or tsv\n"
 		  "  -h  display this help and exit\n"
+		  "  -j  number of files to scan in parallel for -r\n"
+		  "  -l  detect subsong lengths and levels by playing them\n"
+		  "  -r  scan files and directories, one record per subsong\n"
 		  "  -V  print version and exit\n"),
-                myname);
+                myname, myname);
         exit(exitcode);
 }
 
@@ -41,14 +70,31 @@ void parseopts(int *argc, char ***argv)
 {
 	long res;
 	myname = *argv[0];
-	while ((res = getopt(*argc, *argv, "hV")) != -1) {
+	while ((res = getopt(*argc, *argv, "f:hj:lrV")) != -1) {
 		switch (res) {
 		default:
 			usage(1);
 			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0)
+				scan_format = SCAN_JSON;
+			else if (strcmp(optarg, "tsv") == 0)
+				scan_format = SCAN_TSV;
+			else usage(1);
+			break;
 		case 'h':
 			usage(0);
 			break;
+		case 'j':
+			if ((scan_threads = strtol(optarg, NULL, 0)) < 1)
+				usage(1);
+			break;
+		case 'l':
+			detect_lengths = 1;
+			break;
+		case 'r':
+			scan_mode = 1;
+			break;
 		case 'V':
 			version();
 			break;
@@ -58,6 +104,583 @@ void parseopts(int *argc, char ***argv)
 	*argv += optind;
 }
 
+/*
+ * Play the intro and one loop of a subsong and measure its peak
+ * sample value and mean power.
+ */
+long measurelevels(struct gbs *gbs, long subsong, struct songcache_entry *e)
+{
+	long subsong_timeout = gbs->subsong_timeout;
+	long silence_timeout = gbs->silence_timeout;
+	long long frames = (long long)gbs->subsong_info[subsong].len * LEVEL_RATE / GBS_LEN_DIV;
+	long long done = 0;
+	double power = 0;
+	int16_t *buf;
+	long peak = 0;
+	long ok = true;
+	long i;
+
+	if (!frames || (buf = malloc(LEVEL_CHUNK * 2 * sizeof(*buf))) == NULL)
+		return false;
+
+	gbs->subsong_timeout = 0;
+	gbs->silence_timeout = 0;
+	gbhw_setrate(&gbs->gbhw, LEVEL_RATE);
+	if (!gbs_init(gbs, subsong))
+		ok = false;
+	while (ok && done < frames) {
+		long n = frames - done < LEVEL_CHUNK ? frames - done : LEVEL_CHUNK;
+		if (!gbs_render(gbs, buf, n)) {
+			ok = false;
+			break;
+		}
+		for (i=0; i<n*2; i++) {
+			long v = buf[i] < 0 ? -buf[i] : buf[i];
+			if (v > peak)
+				peak = v;
+			power += (double)buf[i] * buf[i];
+		}
+		done += n;
+	}
+	gbs->subsong_timeout = subsong_timeout;
+	gbs->silence_timeout = silence_timeout;
+	free(buf);
+	if (!ok)
+		return false;
+
+	power /= done * 2 * 32768.0 * 32768.0;
+	e->peak = peak;
+	e->loudness = power > 0 ? lrint(1000 * log10(power)) : INT32_MIN;
+	return true;
+}
+
+void printlengths(struct gbs *gbs)
+{
+	char *cachefile = get_userconfig(SONGCACHE_FILE);
+	struct songcache *cache = NULL;
+	struct songcache_entry e;
+	long i;
+
+	if (cachefile) {
+		cache = songcache_open(cachefile);
+		free(cachefile);
+	}
+	if (cache)
+		gbs_songcache_apply(gbs, cache);
+
+	for (i=0; i<gbs->songs; i++) {
+		struct gbs_subsong_info *info = &gbs->subsong_info[i];
+
+		printf(_("Subsong %03ld:	"), i);
+		if (!info->len && !gbs_detect_length(gbs, i, DETECT_SECS)) {
+			printf("%s\n", _("no loop found"));
+			continue;
+		} else if (info->loop) {
+			printf(_("intro %.3f seconds, loop %.3f seconds"),
+			       info->intro / (double)GBS_LEN_DIV,
+			       info->loop / (double)GBS_LEN_DIV);
+		} else {
+			printf(_("ends after %.3f seconds"),
+			       info->len / (double)GBS_LEN_DIV);
+		}
+
+		/* zero peak and loudness means the levels are not known */
+		if (!cache || !songcache_lookup(cache, gbs->crcnow, i, &e) ||
+		    (!e.peak && !e.loudness)) {
+			memset(&e, 0, sizeof(e));
+			measurelevels(gbs, i, &e);
+		}
+		if (e.loudness == INT32_MIN)
+			printf("%s\n", _(", silent"));
+		else if (e.peak || e.loudness)
+			printf(_(", peak %ld, loudness %.2f dBFS\n"),
+			       (long)e.peak, e.loudness / 100.0);
+		else printf("\n");
+
+		if (cache) {
+			e.crc = gbs->crcnow;
+			e.subsong = i;
+			e.len = info->len;
+			e.intro = info->intro;
+			e.loop = info->loop;
+			e.title = info->title;
+			songcache_store(cache, &e);
+		}
+	}
+
+	if (cache) {
+		songcache_write(cache);
+		songcache_close(cache);
+	}
+}
+
+/*
+ * Catalog scan: all files are probed from their headers by a pool of
+ * worker threads and printed in the order they were found, one JSON
+ * object or TSV line per subsong.
+ */
+struct strbuf {
+	char *s;
+	size_t len;
+	size_t size;
+	long fields;		/* in the current record */
+};
+
+struct scan {
+	char **files;
+	long count;
+	long alloc;
+	long next;		/* next file to probe */
+	long printed;		/* next file to print */
+	char **records;
+	char *done;
+	struct songcache *cache;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;
+#endif
+};
+
+static const char *scan_suffixes[] = {
+	".gbs", ".gbr", ".gb", ".vgm", ".vgz", ".gz", ".zip", NULL
+};
+
+struct scan_zip {
+	struct scan *scan;
+	const char *name;
+};
+
+static void scan_lock(struct scan *scan)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&scan->mutex);
+#endif
+}
+
+static void scan_unlock(struct scan *scan)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&scan->mutex);
+#endif
+}
+
+static void sb_printf(struct strbuf *sb, const char *fmt, ...)
+{
+	va_list ap;
+	long n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (sb->len + n + 1 > sb->size) {
+		size_t size = (sb->len + n + 1) * 2;
+		char *s = realloc(sb->s, size);
+		if (s == NULL) {
+			fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+			exit(EXIT_FAILURE);
+		}
+		sb->s = s;
+		sb->size = size;
+	}
+	va_start(ap, fmt);
+	vsnprintf(&sb->s[sb->len], n + 1, fmt, ap);
+	va_end(ap);
+	sb->len += n;
+}
+
+static void sb_field(struct strbuf *sb, const char *name)
+{
+	if (scan_format == SCAN_JSON)
+		sb_printf(sb, "%s\"%s\":", sb->fields ? "," : "{", name);
+	else if (sb->fields)
+		sb_printf(sb, "\t");
+	sb->fields++;
+}
+
+static void sb_end(struct strbuf *sb)
+{
+	sb_printf(sb, scan_format == SCAN_JSON ? "}\n" : "\n");
+	sb->fields = 0;
+}
+
+/*
+ * Length of the valid UTF-8 sequence at s, 0 if it is not one.
+ * Overlong forms, surrogates and code points above U+10FFFF are
+ * invalid.
+ */
+static long utf8_len(const unsigned char *s)
+{
+	uint32_t cp;
+	long len, i;
+
+	if (s[0] < 0x80)
+		return 1;
+	if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+		len = 2;
+		cp = s[0] & 0x1f;
+	} else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+		len = 3;
+		cp = s[0] & 0x0f;
+	} else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+		len = 4;
+		cp = s[0] & 0x07;
+	} else {
+		return 0;
+	}
+	for (i=1; i<len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+	if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+	    (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	return len;
+}
+
+/*
+ * Add a string field, quoted for JSON, or null if str is NULL.
+ * JSON output has to be UTF-8, bytes that are not part of a valid
+ * UTF-8 sequence are taken as Latin-1 and escaped as \u00XX.
+ */
+static void sb_string(struct strbuf *sb, const char *name, const char *str)
+{
+	sb_field(sb, name);
+	if (str == NULL) {
+		if (scan_format == SCAN_JSON)
+			sb_printf(sb, "null");
+		return;
+	}
+	if (scan_format == SCAN_JSON)
+		sb_printf(sb, "\"");
+	for (; *str; str++) {
+		unsigned char c = *str;
+		if (c == '\\' || (c == '"' && scan_format == SCAN_JSON))
+			sb_printf(sb, "\\%c", c);
+		else if (c == '\t')
+			sb_printf(sb, "\\t");
+		else if (c == '\n')
+			sb_printf(sb, "\\n");
+		else if (c < 0x20 && scan_format == SCAN_JSON)
+			sb_printf(sb, "\\u%04x", c);
+		else if (c < 0x20)
+			sb_printf(sb, " ");
+		else if (c < 0x80 || scan_format != SCAN_JSON)
+			sb_printf(sb, "%c", c);
+		else {
+			long len = utf8_len((const unsigned char *)str);
+			if (len == 0)
+				sb_printf(sb, "\\u%04x", c);
+			else {
+				sb_printf(sb, "%.*s", (int)len, str);
+				str += len - 1;
+			}
+		}
+	}
+	if (scan_format == SCAN_JSON)
+		sb_printf(sb, "\"");
+}
+
+/* Add a printf formatted number field, or null if known is false. */
+static void sb_number(struct strbuf *sb, const char *name, long known, const char *fmt, ...)
+{
+	char num[32];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(num, sizeof(num), fmt, ap);
+	va_end(ap);
+	sb_field(sb, name);
+	if (known)
+		sb_printf(sb, "%s", num);
+	else if (scan_format == SCAN_JSON)
+		sb_printf(sb, "null");
+}
+
+static void scan_push(struct scan *scan, const char *name)
+{
+	if (scan->count == scan->alloc) {
+		scan->alloc = scan->alloc ? scan->alloc * 2 : 256;
+		scan->files = realloc(scan->files, scan->alloc * sizeof(*scan->files));
+		if (scan->files == NULL) {
+			fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+			exit(EXIT_FAILURE);
+		}
+	}
+	scan->files[scan->count++] = strdup(name);
+}
+
+static int scan_compare(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static long has_suffix(const char *name, const char *suffix)
+{
+	long len = strlen(name);
+	long slen = strlen(suffix);
+
+	return len > slen && strcasecmp(&name[len - slen], suffix) == 0;
+}
+
+/* Add a ZIP member with a known suffix as archive.zip#member. */
+static regparm void scan_member(const char *member, void *priv)
+{
+	struct scan_zip *zip = priv;
+	struct strbuf path = { NULL, 0, 0, 0 };
+	long i;
+
+	for (i=0; scan_suffixes[i]; i++) {
+		if (has_suffix(member, scan_suffixes[i]))
+			break;
+	}
+	/* nested archives can not be opened */
+	if (scan_suffixes[i] == NULL || has_suffix(member, ".zip"))
+		return;
+	sb_printf(&path, "%s#%s", zip->name, member);
+	scan_push(zip->scan, path.s);
+	free(path.s);
+}
+
+/*
+ * Add a file, or all files with a known suffix below a directory.
+ * ZIP archives are replaced by the song files they contain.
+ */
+static void scan_add(struct scan *scan, const char *name, long explicit)
+{
+	struct scan entries;
+	struct dirent *de;
+	struct stat st;
+	DIR *dir;
+	long i;
+
+	if (stat(name, &st) == -1) {
+		/* archive.zip#member, gbs_probe() splits it */
+		if (explicit && errno == ENOENT && strchr(name, '#')) {
+			scan_push(scan, name);
+			return;
+		}
+		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
+		return;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		for (i=0; !explicit && scan_suffixes[i]; i++) {
+			if (has_suffix(name, scan_suffixes[i]))
+				break;
+		}
+		if (has_suffix(name, ".zip")) {
+			struct scan_zip zip = { scan, name };
+			if (gbs_zip_members(name, scan_member, &zip) || !explicit)
+				return;
+		}
+		if (explicit || scan_suffixes[i])
+			scan_push(scan, name);
+		return;
+	}
+
+	if ((dir = opendir(name)) == NULL) {
+		fprintf(stderr, _("Could not open %s: %s\n"), name, strerror(errno));
+		return;
+	}
+	/* sorted for output that does not depend on the file system */
+	memset(&entries, 0, sizeof(entries));
+	while ((de = readdir(dir)) != NULL) {
+		struct strbuf path = { NULL, 0, 0, 0 };
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		sb_printf(&path, "%s/%s", name, de->d_name);
+		scan_push(&entries, path.s);
+		free(path.s);
+	}
+	closedir(dir);
+	qsort(entries.files, entries.count, sizeof(*entries.files), scan_compare);
+	for (i=0; i<entries.count; i++) {
+		scan_add(scan, entries.files[i], 0);
+		free(entries.files[i]);
+	}
+	free(entries.files);
+}
+
+/* Probe one file and return its records, NULL if it is not a song file. */
+static char *scan_file(struct scan *scan, const char *name)
+{
+	struct strbuf sb = { NULL, 0, 0, 0 };
+	struct gbs_probe probe;
+	struct songcache_entry e;
+	uint32_t intro[256], loop[256];
+	const char *check;
+	char crc[9];
+	long missing = 0;
+	long i;
+
+	if (!gbs_probe(name, &probe))
+		return NULL;
+
+	memset(intro, 0, sizeof(intro));
+	memset(loop, 0, sizeof(loop));
+	if (detect_lengths) {
+		scan_lock(scan);
+		for (i=0; i<probe.songs; i++) {
+			if (probe.len[i])
+				continue;
+			if (scan->cache && probe.crc &&
+			    songcache_lookup(scan->cache, probe.crc, i, &e) && e.len) {
+				probe.len[i] = e.len;
+				intro[i] = e.intro;
+				loop[i] = e.loop;
+			} else missing++;
+		}
+		scan_unlock(scan);
+	}
+	if (missing) {
+		struct gbs *gbs = gbs_open(name);
+		for (i=0; gbs && i<probe.songs; i++) {
+			if (probe.len[i] || !gbs_detect_length(gbs, i, DETECT_SECS))
+				continue;
+			probe.len[i] = gbs->subsong_info[i].len;
+			intro[i] = gbs->subsong_info[i].intro;
+			loop[i] = gbs->subsong_info[i].loop;
+			if (scan->cache && probe.crc) {
+				scan_lock(scan);
+				if (!songcache_lookup(scan->cache, probe.crc, i, &e)) {
+					memset(&e, 0, sizeof(e));
+					e.crc = probe.crc;
+					e.subsong = i;
+				}
+				e.len = probe.len[i];
+				e.intro = intro[i];
+				e.loop = loop[i];
+				songcache_store(scan->cache, &e);
+				scan_unlock(scan);
+			}
+		}
+		if (gbs)
+			gbs_close(gbs);
+	}
+
+	if (!probe.filecrc)
+		check = "none";
+	else if (probe.filecrc == probe.crc)
+		check = "ok";
+	else check = "bad";
+	snprintf(crc, sizeof(crc), "%08lx", (unsigned long)probe.crc);
+
+	for (i=0; i<probe.songs; i++) {
+		sb_string(&sb, "file", name);
+		sb_number(&sb, "subsong", 1, "%ld", i + 1);
+		sb_number(&sb, "subsongs", 1, "%ld", probe.songs);
+		sb_number(&sb, "default", 1, "%ld", probe.defaultsong);
+		sb_number(&sb, "size", 1, "%ld", (long)probe.filesize);
+		sb_string(&sb, "crc", probe.crc ? crc : NULL);
+		sb_string(&sb, "crc_check", check);
+		sb_string(&sb, "title", probe.title);
+		sb_string(&sb, "author", probe.author);
+		sb_string(&sb, "copyright", probe.copyright);
+		sb_number(&sb, "length", probe.len[i], "%.3f", probe.len[i] / (double)GBS_LEN_DIV);
+		sb_number(&sb, "intro", loop[i], "%.3f", intro[i] / (double)GBS_LEN_DIV);
+		sb_number(&sb, "loop", loop[i], "%.3f", loop[i] / (double)GBS_LEN_DIV);
+		sb_end(&sb);
+	}
+
+	return sb.s;
+}
+
+/* Store the records of file i and print all that are due. */
+static void scan_finish(struct scan *scan, long i, char *records)
+{
+	scan_lock(scan);
+	scan->records[i] = records;
+	scan->done[i] = 1;
+	while (scan->printed < scan->count && scan->done[scan->printed]) {
+		if (scan->records[scan->printed]) {
+			fputs(scan->records[scan->printed], stdout);
+			free(scan->records[scan->printed]);
+		}
+		scan->printed++;
+	}
+	scan_unlock(scan);
+}
+
+static void *scan_worker(void *priv)
+{
+	struct scan *scan = priv;
+	long i;
+
+	for (;;) {
+		scan_lock(scan);
+		i = scan->next < scan->count ? scan->next++ : -1;
+		scan_unlock(scan);
+		if (i < 0)
+			break;
+		scan_finish(scan, i, scan_file(scan, scan->files[i]));
+	}
+	return NULL;
+}
+
+long scan(int argc, char **argv)
+{
+	struct scan scan;
+	char *cachefile;
+	long i;
+
+	memset(&scan, 0, sizeof(scan));
+	for (i=0; i<argc; i++)
+		scan_add(&scan, argv[i], 1);
+	scan.records = calloc(scan.count + 1, sizeof(*scan.records));
+	scan.done = calloc(scan.count + 1, 1);
+	if (scan.records == NULL || scan.done == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return false;
+	}
+
+	if (detect_lengths && (cachefile = get_userconfig(SONGCACHE_FILE))) {
+		scan.cache = songcache_open(cachefile);
+		free(cachefile);
+	}
+	if (scan_format == SCAN_TSV)
+		puts("file\tsubsong\tsubsongs\tdefault\tsize\tcrc\tcrc_check\t"
+		     "title\tauthor\tcopyright\tlength\tintro\tloop");
+
+#ifdef HAVE_PTHREAD
+	{
+		pthread_t *threads;
+		long n = scan_threads;
+
+		if (n < 1)
+			n = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n > scan.count)
+			n = scan.count;
+		if (n < 1)
+			n = 1;
+		pthread_mutex_init(&scan.mutex, NULL);
+		threads = malloc(n * sizeof(*threads));
+		for (i=0; threads && i<n-1; i++) {
+			if (pthread_create(&threads[i], NULL, scan_worker, &scan) != 0)
+				break;
+		}
+		/* the main thread works along, also if no thread started */
+		scan_worker(&scan);
+		while (threads && i-- > 0)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		pthread_mutex_destroy(&scan.mutex);
+	}
+#else
+	scan_worker(&scan);
+#endif
+
+	if (scan.cache) {
+		songcache_write(scan.cache);
+		songcache_close(scan.cache);
+	}
+	for (i=0; i<scan.count; i++)
+		free(scan.files[i]);
+	free(scan.files);
+	free(scan.records);
+	free(scan.done);
+
+	return true;
+}
+
 int main(int argc, char **argv)
 {
 	struct gbs *gbs;
@@ -70,8 +693,13 @@ int main(int argc, char **argv)
                 usage(1);
         }
 
+	if (scan_mode)
+		return scan(argc, argv) ? 0 : EXIT_FAILURE;
+
 	if ((gbs = gbs_open(argv[0])) == NULL) exit(EXIT_FAILURE);
 	gbs_printinfo(gbs, 1);
+	if (detect_lengths)
+		printlengths(gbs);
 	gbs_close(gbs);
 
 	return 0;
@@ -26,6 +26,7 @@
 #include "cfgparser.h"
 #include "util.h"
 #include "plugout.h"
+#include "songcache.h"
 
 #define LN2 .69314718055994530941
 #define MAGIC 5.78135971352465960412
@@ -72,6 +73,7 @@ static long subsong_start = -1;
 static long subsong_stop = -1;
 static long subsong_timeout = 2*60;
 static long redraw = false;
+static long mute_channel[4];
 
 static const char cfgfile[] = ".gbsplayrc";
 
@@ -403,7 +405,7 @@ static regparm void parseopts(int *argc, char ***argv)
 		case '2':
 		case '3':
 		case '4':
-			gbhw_ch[res-'1'].mute ^= 1;
+			mute_channel[res-'1'] ^= 1;
 			break;
 		case 'c':
 			cfg_parse(optarg, options);
@@ -499,21 +501,22 @@ static regparm void handleuserinput(struct gbs *gbs)
 			break;
 		case ' ':
 			pause_mode = !pause_mode;
-			gbhw_pause(pause_mode);
+			gbhw_pause(&gbs->gbhw, pause_mode);
 			if (sound_pause) sound_pause(pause_mode);
 			break;
 		case '1':
 		case '2':
 		case '3':
 		case '4':
-			gbhw_ch[c-'1'].mute ^= 1;
+			gbs->gbhw.ch[c-'1'].mute ^= 1;
 			break;
 		}
 	}
 }
 
-static regparm char *notestring(long ch)
+static regparm char *notestring(struct gbs *gbs, long ch)
 {
+	const struct gbhw_channel *gbhw_ch = gbs->gbhw.ch;
 	long n;
 
 	if (gbhw_ch[ch].mute) return "-M-";
@@ -528,8 +531,9 @@ static regparm char *notestring(long ch)
 	else return "nse";
 }
 
-static regparm long chvol(long ch)
+static regparm long chvol(struct gbs *gbs, long ch)
 {
+	const struct gbhw_channel *gbhw_ch = gbs->gbhw.ch;
 	long v;
 
 	if (gbhw_ch[ch].mute ||
@@ -552,24 +556,25 @@ static regparm char *volstring(long v)
 	return &vollookup[5*v];
 }
 
-static regparm void printregs(void)
+static regparm void printregs(struct gbs *gbs)
 {
 	long i;
 	for (i=0; i<5*4; i++) {
 		if (i % 5 == 0)
 			printf("CH%ld:", i/5 + 1);
-		printf(" %02x", gbhw_io_peek(0xff10+i));
+		printf(" %02x", gbhw_io_peek(&gbs->gbhw, 0xff10+i));
 		if (i % 5 == 4)
 			printf("\n");
 	}
 	printf("MISC:");
 	for (i+=0x10; i<0x27; i++) {
-		printf(" %02x", gbhw_io_peek(0xff00+i));
+		printf(" %02x", gbhw_io_peek(&gbs->gbhw, 0xff00+i));
 	}
 	printf("\nWAVE: ");
 	for (i=0; i<16; i++) {
-		printf("%02x", gbhw_io_peek(0xff30+i));
+		printf("%02x", gbhw_io_peek(&gbs->gbhw, 0xff30+i));
 	}
+	printf("  IDLE: %ld", gbs->gbhw.idle_cycles);
 	printf("\n\033[A\033[A\033[A\033[A\033[A\033[A");
 }
 
@@ -599,17 +604,17 @@ static regparm void printstatus(struct gbs *gbs)
 	       timem, times, lenm, lens);
 	if (verbosity>2) {
 		printf("  %s %s  %s %s  %s %s  %s %s  [%s|%s]\n",
-		       notestring(0), volstring(chvol(0)),
-		       notestring(1), volstring(chvol(1)),
-		       notestring(2), volstring(chvol(2)),
-		       notestring(3), volstring(chvol(3)),
+		       notestring(gbs, 0), volstring(chvol(gbs, 0)),
+		       notestring(gbs, 1), volstring(chvol(gbs, 1)),
+		       notestring(gbs, 2), volstring(chvol(gbs, 2)),
+		       notestring(gbs, 3), volstring(chvol(gbs, 3)),
 		       reverse_vol(volstring(gbs->lvol/1024)),
 		       volstring(gbs->rvol/1024));
 	} else {
 		puts("");
 	}
 	if (verbosity>3) {
-		printregs();
+		printregs(gbs);
 	}
 	fflush(stdout);
 }
@@ -692,6 +697,7 @@ int main(int argc, char **argv)
 	char *usercfg;
 	struct termios ts;
 	struct sigaction sa;
+	long i;
 
 	i18n_init();
 
@@ -719,18 +725,6 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	if (sound_io)
-		gbhw_setiocallback(iocallback, NULL);
-	if (sound_step)
-		gbhw_setstepcallback(stepcallback, NULL);
-	if (sound_write)
-		gbhw_setcallback(callback, NULL);
-	gbhw_setrate(rate);
-	if (!gbhw_setfilter(filter_type)) {
-		fprintf(stderr, _("Invalid filter type \"%s\"\n"), filter_type);
-		exit(1);
-	}
-
 	if (argc >= 2) {
 		sscanf(argv[1], "%ld", &subsong_start);
 		subsong_start--;
@@ -746,6 +740,33 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	/* subsong lengths found by gbsinfo -l */
+	usercfg = get_userconfig(SONGCACHE_FILE);
+	if (usercfg) {
+		struct songcache *cache = songcache_open(usercfg);
+		if (cache) {
+			gbs_songcache_apply(gbs, cache);
+			songcache_close(cache);
+		}
+		free(usercfg);
+	}
+
+	if (sound_io)
+		gbhw_setiocallback(&gbs->gbhw, iocallback, NULL);
+	if (sound_step)
+		gbhw_setstepcallback(&gbs->gbhw, stepcallback, NULL);
+	if (sound_write)
+		gbhw_setcallback(&gbs->gbhw, callback, NULL);
+	else gbhw_setaudio(&gbs->gbhw, 0);
+	gbhw_setrate(&gbs->gbhw, rate);
+	if (!gbhw_setfilter(&gbs->gbhw, filter_type)) {
+		fprintf(stderr, _("Invalid filter type \"%s\"\n"), filter_type);
+		exit(1);
+	}
+	for (i=0; i<4; i++) {
+		gbs->gbhw.ch[i].mute = mute_channel[i];
+	}
+
 	/* sanitize commandline values */
 	if (subsong_start < -1) {
 		subsong_start = 0;
@@ -764,7 +785,7 @@ int main(int argc, char **argv)
 	gbs->gap = subsong_gap;
 	gbs->fadeout = fadeout;
 	setup_playmode(gbs);
-	gbhw_setbuffer(&buf);
+	gbhw_setbuffer(&gbs->gbhw, &buf);
 	gbs_set_nextsubsong_cb(gbs, nextsubsong_cb, NULL);
 	gbs_init(gbs, gbs->subsong);
 	if (sound_skip)
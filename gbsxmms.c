@@ -27,6 +27,7 @@
 #include "gbcpu.h"
 #include "gbs.h"
 #include "cfgparser.h"
+#include "songcache.h"
 
 #define GBS_DEBUG 0
 
@@ -58,6 +59,7 @@ static InputPlugin gbs_ip;
 static char *cfgfile = ".xmms/gbsxmmsrc";
 
 static struct gbs *gbs;
+static struct songcache *songcache;
 static pthread_mutex_t gbs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static long subsong_gap = 2;
@@ -234,6 +236,8 @@ static regparm void gbs_play(char *filename)
 		DPRINTF("unlocked gbs_mutex\n");
 		return;
 	}
+	if (songcache)
+		gbs_songcache_apply(gbs, songcache);
 
 	len = 13 +
 	      strlen(gbs->title) +
@@ -247,13 +251,14 @@ static regparm void gbs_play(char *filename)
 	gbs_ip.set_info(title, length, 0, rate, 2);
 
 	gbs_init(gbs, -1);
-	gbhw_setbuffer(&buffer);
-	gbhw_setrate(rate);
-	gbhw_setcallback(callback, NULL);
+	gbhw_setrate(&gbs->gbhw, rate);
+	gbhw_setbuffer(&gbs->gbhw, &buffer);
+	gbhw_setcallback(&gbs->gbhw, callback, NULL);
 	gbs->subsong_timeout = subsong_timeout;
 	gbs->gap = subsong_gap;
 	gbs->silence_timeout = silence_timeout;
 	gbs->fadeout = fadeout;
+	gbs->keyframe_interval = 5;
 	DPRINTF("buffer.samples=%ld, rate=%ld\n", buffer.samples, rate);
 	workunit = 1000*buffer.samples/rate;
 	pthread_mutex_unlock(&gbs_mutex);
@@ -658,6 +663,12 @@ static void init(void)
 	cfg_parse(usercfg, options);
 	free(usercfg);
 
+	usercfg = get_userconfig(SONGCACHE_FILE);
+	if (usercfg) {
+		songcache = songcache_open(usercfg);
+		free(usercfg);
+	}
+
 	create_dialogs();
 }
 
@@ -706,22 +717,55 @@ static void cleanup(void)
 {
 	DPRINTF("called by xmms\n");
 	gtk_widget_unref(dialog_fileinfo);
+	if (songcache) {
+		songcache_close(songcache);
+		songcache = NULL;
+	}
 }
 
 static void get_song_info(char *filename, char **title, int *length)
 {
-	struct gbs *gbs = gbs_open(filename);
+	struct gbs_probe probe;
+	struct songcache_entry e;
+	long len, i;
 	DPRINTF("called by xmms\n");
 
-	set_song_info(gbs, title, length);
-	gbs_close(gbs);
+	/* playlists can be long, only read the headers */
+	if (!gbs_probe(filename, &probe))
+		return;
+
+	len = 13 + strlen(probe.title) + strlen(probe.author) + strlen(probe.copyright);
+	*title = malloc(len);
+	snprintf(*title, len, "%s - %s (%s)",
+	         probe.title, probe.author, probe.copyright);
+
+	*length = 0;
+	for (i=0; i<probe.songs; i++) {
+		if (!probe.len[i] && songcache && probe.crc &&
+		    songcache_lookup(songcache, probe.crc, i, &e))
+			probe.len[i] = e.len;
+		if (probe.len[i])
+			*length += ((long)probe.len[i] * 1000) >> GBS_LEN_SHIFT;
+		else *length += subsong_timeout * 1000;
+	}
 }
 
 static void seek(int time)
 {
+	long msec = time * 1000L;
+	long subsong;
+
 	DPRINTF("called by xmms\n");
-	if (time > get_time()/1000) next_subsong(1);
-	else prev_subsong();
+	if (!(gbs_ip.output && gbs)) return;
+	DPRINTF("locking gbs_mutex\n");
+	pthread_mutex_lock(&gbs_mutex);
+	for (subsong=0; subsong < gbs->songs-1; subsong++)
+		if (gbs_time(gbs, subsong+1) > msec) break;
+	if (subsong != gbs->subsong) gbs_init(gbs, subsong);
+	if (!gbs_seek(gbs, msec - gbs_time(gbs, subsong))) stopthread = true;
+	pthread_mutex_unlock(&gbs_mutex);
+	DPRINTF("unlocked gbs_mutex\n");
+	gbs_ip.output->flush(msec);
 }
 
 static void pause_file(short paused)
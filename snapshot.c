@@ -0,0 +1,170 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Serialization helpers for emulator snapshots.
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "test.h"
+
+/* Store or fetch n bytes of little endian integer data. */
+static regparm void snap_uint(struct snap *s, uint64_t *v, long n)
+{
+	long i;
+
+	if (s->error || s->pos + n > s->size || (s->load && s->dry)) {
+		s->pos += n;
+		return;
+	}
+	if (s->load) {
+		*v = 0;
+		for (i=0; i<n; i++)
+			*v |= (uint64_t)s->in[s->pos + i] << (i*8);
+	} else if (s->out != NULL) {
+		for (i=0; i<n; i++)
+			s->out[s->pos + i] = *v >> (i*8);
+	}
+	s->pos += n;
+}
+
+regparm void snap_bytes(struct snap *s, void *p, long n)
+{
+	if (!s->error && s->pos + n <= s->size) {
+		if (s->load && !s->dry)
+			memcpy(p, &s->in[s->pos], n);
+		else if (s->out != NULL)
+			memcpy(&s->out[s->pos], p, n);
+	}
+	s->pos += n;
+}
+
+regparm void snap_u16s(struct snap *s, uint16_t *p, long n)
+{
+	long i;
+
+	for (i=0; i<n; i++) {
+		uint64_t v = p[i];
+		snap_uint(s, &v, 2);
+		if (s->load)
+			p[i] = v;
+	}
+}
+
+regparm void snap_u32(struct snap *s, uint32_t *v)
+{
+	uint64_t t = *v;
+
+	snap_uint(s, &t, 4);
+	if (s->load)
+		*v = t;
+}
+
+/* longs are always stored with 64 bits, so snapshots move between ABIs */
+regparm void snap_long(struct snap *s, long *v)
+{
+	uint64_t t = (int64_t)*v;
+
+	snap_uint(s, &t, 8);
+	if (s->load)
+		*v = (int64_t)t;
+}
+
+regparm void snap_llong(struct snap *s, long long *v)
+{
+	uint64_t t = (int64_t)*v;
+
+	snap_uint(s, &t, 8);
+	if (s->load)
+		*v = (int64_t)t;
+}
+
+/* A long that is checked before it is used, fetched also by a dry load. */
+regparm void snap_value(struct snap *s, long *v)
+{
+	long dry = s->dry;
+
+	s->dry = 0;
+	snap_long(s, v);
+	s->dry = dry;
+}
+
+test void test_snap_roundtrip()
+{
+	uint8_t buf[2*2 + 4 + 8 + 8];
+	uint16_t u16[2] = { 0x1234, 0xfedc };
+	uint32_t u32 = 0xdeadbeef;
+	long l = -42;
+	long long ll = -0x123456789aLL;
+	struct snap s;
+
+	memset(&s, 0, sizeof(s));
+	s.out = buf;
+	s.size = sizeof(buf);
+	snap_u16s(&s, u16, 2);
+	snap_u32(&s, &u32);
+	snap_long(&s, &l);
+	snap_llong(&s, &ll);
+	ASSERT_EQUAL("%ld", s.pos, (long)sizeof(buf));
+	ASSERT_EQUAL("%02x", buf[0], 0x34);
+	ASSERT_EQUAL("%02x", buf[7], 0xde);
+	ASSERT_EQUAL("%02x", buf[15], 0xff);
+
+	u16[0] = u16[1] = 0;
+	u32 = 0;
+	l = 0;
+	ll = 0;
+	memset(&s, 0, sizeof(s));
+	s.in = buf;
+	s.size = sizeof(buf);
+	s.load = 1;
+	snap_u16s(&s, u16, 2);
+	snap_u32(&s, &u32);
+	snap_long(&s, &l);
+	snap_llong(&s, &ll);
+	ASSERT_EQUAL("%04x", u16[0], 0x1234);
+	ASSERT_EQUAL("%04x", u16[1], 0xfedc);
+	ASSERT_EQUAL("%08x", u32, 0xdeadbeef);
+	ASSERT_EQUAL("%ld", l, -42L);
+	ASSERT_EQUAL("%lld", ll, -0x123456789aLL);
+}
+TEST(test_snap_roundtrip);
+
+test void test_snap_short_buffer()
+{
+	uint8_t buf[4] = { 0x55, 0x55, 0x55, 0x55 };
+	long l = 1;
+	struct snap s;
+
+	memset(&s, 0, sizeof(s));
+	s.out = buf;
+	s.size = sizeof(buf);
+	snap_long(&s, &l);
+	ASSERT_EQUAL("%ld", s.pos, 8L);
+	ASSERT_EQUAL("%02x", buf[0], 0x55);
+}
+TEST(test_snap_short_buffer);
+
+test void test_snap_dry()
+{
+	uint8_t buf[16] = { 1, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0 };
+	long l = 5, v = 5;
+	struct snap s;
+
+	memset(&s, 0, sizeof(s));
+	s.in = buf;
+	s.size = sizeof(buf);
+	s.load = 1;
+	s.dry = 1;
+	snap_long(&s, &l);
+	snap_value(&s, &v);
+	ASSERT_EQUAL("%ld", s.pos, 16L);
+	ASSERT_EQUAL("%ld", l, 5L);
+	ASSERT_EQUAL("%ld", v, 2L);
+}
+TEST(test_snap_dry);
+TEST_EOF;
@@ -0,0 +1,40 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <inttypes.h>
+#include "common.h"
+
+/*
+ * Cursor for walking the emulator state in either direction.  When
+ * loading, values are read from in.  Otherwise they are written to
+ * out, or only counted if out is NULL.  Nothing outside of size is
+ * touched, but pos keeps counting so the caller can tell how much
+ * space was needed.  Integers are stored little endian.
+ *
+ * A dry load only reads: nothing is stored except by snap_value(),
+ * so values can be checked before any state is overwritten.
+ */
+struct snap {
+	/*@null@*/ /*@dependent@*/ uint8_t *out;
+	/*@null@*/ /*@dependent@*/ const uint8_t *in;
+	long size;
+	long pos;
+	long load;
+	long dry;
+	long error;
+};
+
+regparm void snap_bytes(struct snap *s, void *p, long n);
+regparm void snap_u16s(struct snap *s, uint16_t *p, long n);
+regparm void snap_u32(struct snap *s, uint32_t *v);
+regparm void snap_long(struct snap *s, long *v);
+regparm void snap_llong(struct snap *s, long long *v);
+regparm void snap_value(struct snap *s, long *v);
+
+#endif
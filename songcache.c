@@ -0,0 +1,454 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Persistent cache of per subsong metadata, keyed by file crc.
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "songcache.h"
+#include "test.h"
+
+#if HAVE_MMAP == 1
+#include <sys/mman.h>
+#endif
+
+/*
+ * File layout, all integers little endian: a header of magic,
+ * version, record count and string table size, the records sorted by
+ * crc and subsong, then the string table.  A record holds crc,
+ * subsong, len, intro, loop, peak, loudness and the offset of the
+ * title in the string table, SONGCACHE_NO_TITLE if there is none.
+ * The file is used in place, so nothing has to be parsed on opening.
+ */
+#define SONGCACHE_MAGIC		"GBSc"
+#define SONGCACHE_VERSION	1
+#define SONGCACHE_HDR_LEN	16
+#define SONGCACHE_REC_LEN	32
+#define SONGCACHE_NO_TITLE	0xffffffff
+
+struct songcache {
+	char *name;
+	/*@null@*/ uint8_t *data;	/* file contents */
+	size_t size;
+	long mapped;
+	long count;
+	const uint8_t *recs;
+	const char *strings;
+	uint32_t strsize;
+	/* entries stored since the last write */
+	struct songcache_entry *pending;
+	long pending_count;
+	long pending_max;
+};
+
+static regparm uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static regparm void put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static regparm int songcache_cmp(uint32_t crc1, uint32_t subsong1, uint32_t crc2, uint32_t subsong2)
+{
+	if (crc1 != crc2)
+		return crc1 < crc2 ? -1 : 1;
+	if (subsong1 != subsong2)
+		return subsong1 < subsong2 ? -1 : 1;
+	return 0;
+}
+
+static int songcache_qsort_cmp(const void *a, const void *b)
+{
+	const struct songcache_entry *e1 = a, *e2 = b;
+
+	return songcache_cmp(e1->crc, e1->subsong, e2->crc, e2->subsong);
+}
+
+static regparm void songcache_unmap(struct songcache *cache)
+{
+	if (cache->data == NULL)
+		return;
+#if HAVE_MMAP == 1
+	if (cache->mapped)
+		munmap(cache->data, cache->size);
+	else
+#endif
+		free(cache->data);
+	cache->data = NULL;
+	cache->count = 0;
+	cache->strsize = 0;
+}
+
+/* Map the cache file, a missing or unusable file gives an empty cache. */
+static regparm void songcache_map(struct songcache *cache)
+{
+	struct stat st;
+	uint8_t *data;
+	long count;
+	uint32_t strsize;
+	int fd;
+
+	if ((fd = open(cache->name, O_RDONLY)) == -1)
+		return;
+	if (fstat(fd, &st) == -1 || st.st_size < SONGCACHE_HDR_LEN) {
+		close(fd);
+		return;
+	}
+	cache->size = st.st_size;
+#if HAVE_MMAP == 1
+	data = mmap(NULL, cache->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data != MAP_FAILED) {
+		cache->mapped = 1;
+	} else
+#endif
+	{
+		cache->mapped = 0;
+		data = malloc(cache->size);
+		if (data == NULL ||
+		    read(fd, data, cache->size) != (ssize_t)cache->size) {
+			free(data);
+			close(fd);
+			return;
+		}
+	}
+	close(fd);
+	cache->data = data;
+
+	count = get_u32(&data[8]);
+	strsize = get_u32(&data[12]);
+	if (memcmp(data, SONGCACHE_MAGIC, 4) != 0 ||
+	    get_u32(&data[4]) != SONGCACHE_VERSION ||
+	    count > (cache->size - SONGCACHE_HDR_LEN) / SONGCACHE_REC_LEN ||
+	    SONGCACHE_HDR_LEN + count * SONGCACHE_REC_LEN + strsize != cache->size ||
+	    (strsize > 0 && data[cache->size - 1] != 0)) {
+		fprintf(stderr, _("Ignoring invalid song cache %s.\n"), cache->name);
+		songcache_unmap(cache);
+		return;
+	}
+	cache->count = count;
+	cache->strsize = strsize;
+	cache->recs = &data[SONGCACHE_HDR_LEN];
+	cache->strings = (const char *)&cache->recs[count * SONGCACHE_REC_LEN];
+}
+
+regparm struct songcache *songcache_open(const char *name)
+{
+	struct songcache *cache = calloc(1, sizeof(*cache));
+
+	if (cache == NULL || (cache->name = strdup(name)) == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		free(cache);
+		return NULL;
+	}
+	songcache_map(cache);
+	return cache;
+}
+
+static regparm void songcache_get_rec(const struct songcache *cache, long i, struct songcache_entry *entry)
+{
+	const uint8_t *rec = &cache->recs[i * SONGCACHE_REC_LEN];
+	uint32_t title = get_u32(&rec[28]);
+
+	entry->crc = get_u32(&rec[0]);
+	entry->subsong = get_u32(&rec[4]);
+	entry->len = get_u32(&rec[8]);
+	entry->intro = get_u32(&rec[12]);
+	entry->loop = get_u32(&rec[16]);
+	entry->peak = get_u32(&rec[20]);
+	entry->loudness = (int32_t)get_u32(&rec[24]);
+	entry->title = title < cache->strsize ? &cache->strings[title] : NULL;
+}
+
+/*
+ * Look up a subsong, entries stored since the last write come first.
+ * Returns false if the cache does not know it.  The title stays valid
+ * until the next songcache_write() or songcache_close().
+ */
+regparm long songcache_lookup(struct songcache *cache, uint32_t crc, long subsong, struct songcache_entry *entry)
+{
+	long lo = 0, hi = cache->count;
+	long i;
+
+	for (i=0; i<cache->pending_count; i++) {
+		if (cache->pending[i].crc == crc && cache->pending[i].subsong == subsong) {
+			*entry = cache->pending[i];
+			return true;
+		}
+	}
+
+	while (lo < hi) {
+		long mid = (lo + hi) / 2;
+		const uint8_t *rec = &cache->recs[mid * SONGCACHE_REC_LEN];
+		int cmp = songcache_cmp(get_u32(&rec[0]), get_u32(&rec[4]), crc, subsong);
+
+		if (cmp == 0) {
+			songcache_get_rec(cache, mid, entry);
+			return true;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else hi = mid;
+	}
+	return false;
+}
+
+/* Add or replace an entry, it is written out by songcache_write(). */
+regparm long songcache_store(struct songcache *cache, const struct songcache_entry *entry)
+{
+	struct songcache_entry *e = NULL;
+	char *title = NULL;
+	long i;
+
+	if (entry->title && (title = strdup(entry->title)) == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return false;
+	}
+	for (i=0; i<cache->pending_count; i++) {
+		if (cache->pending[i].crc == entry->crc &&
+		    cache->pending[i].subsong == entry->subsong) {
+			e = &cache->pending[i];
+			free((char *)e->title);
+			break;
+		}
+	}
+	if (e == NULL) {
+		if (cache->pending_count == cache->pending_max) {
+			long max = cache->pending_max ? cache->pending_max * 2 : 16;
+			e = realloc(cache->pending, max * sizeof(*e));
+			if (e == NULL) {
+				fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+				free(title);
+				return false;
+			}
+			cache->pending = e;
+			cache->pending_max = max;
+		}
+		e = &cache->pending[cache->pending_count++];
+	}
+	*e = *entry;
+	e->title = title;
+	return true;
+}
+
+static regparm void songcache_free_pending(struct songcache *cache)
+{
+	long i;
+
+	for (i=0; i<cache->pending_count; i++)
+		free((char *)cache->pending[i].title);
+	free(cache->pending);
+	cache->pending = NULL;
+	cache->pending_count = 0;
+	cache->pending_max = 0;
+}
+
+/*
+ * Merge the stored entries into the cache file.  The new file is
+ * written next to the old one and renamed over it, so readers never
+ * see a partial file.
+ */
+regparm long songcache_write(struct songcache *cache)
+{
+	struct songcache_entry *all;
+	long count = 0, total, i, j;
+	size_t strsize = 0, size, pos;
+	uint8_t *buf;
+	char *tmpname;
+	FILE *f;
+	long ok;
+
+	if (cache->pending_count == 0)
+		return true;
+
+	all = malloc((cache->count + cache->pending_count) * sizeof(*all));
+	if (all == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		return false;
+	}
+	memcpy(all, cache->pending, cache->pending_count * sizeof(*all));
+	qsort(all, cache->pending_count, sizeof(*all), songcache_qsort_cmp);
+	/* merge with the sorted records, the stored entries win */
+	total = cache->pending_count;
+	for (i=0, j=0; i<cache->count; i++) {
+		struct songcache_entry e;
+		songcache_get_rec(cache, i, &e);
+		while (j < cache->pending_count &&
+		       songcache_cmp(all[j].crc, all[j].subsong, e.crc, e.subsong) < 0)
+			j++;
+		if (j < cache->pending_count &&
+		    songcache_cmp(all[j].crc, all[j].subsong, e.crc, e.subsong) == 0)
+			continue;
+		all[total++] = e;
+	}
+	qsort(all, total, sizeof(*all), songcache_qsort_cmp);
+
+	for (i=0; i<total; i++)
+		if (all[i].title)
+			strsize += strlen(all[i].title) + 1;
+	size = SONGCACHE_HDR_LEN + total * SONGCACHE_REC_LEN + strsize;
+	buf = malloc(size);
+	tmpname = malloc(strlen(cache->name) + 5);
+	if (buf == NULL || tmpname == NULL) {
+		fprintf(stderr, "%s", _("Memory allocation failed!\n"));
+		free(all);
+		free(buf);
+		free(tmpname);
+		return false;
+	}
+
+	memcpy(buf, SONGCACHE_MAGIC, 4);
+	put_u32(&buf[4], SONGCACHE_VERSION);
+	put_u32(&buf[8], total);
+	put_u32(&buf[12], strsize);
+	pos = SONGCACHE_HDR_LEN + total * SONGCACHE_REC_LEN;
+	for (i=0; i<total; i++) {
+		uint8_t *rec = &buf[SONGCACHE_HDR_LEN + i * SONGCACHE_REC_LEN];
+		put_u32(&rec[0], all[i].crc);
+		put_u32(&rec[4], all[i].subsong);
+		put_u32(&rec[8], all[i].len);
+		put_u32(&rec[12], all[i].intro);
+		put_u32(&rec[16], all[i].loop);
+		put_u32(&rec[20], all[i].peak);
+		put_u32(&rec[24], (uint32_t)all[i].loudness);
+		if (all[i].title) {
+			size_t len = strlen(all[i].title) + 1;
+			put_u32(&rec[28], pos - (size - strsize));
+			memcpy(&buf[pos], all[i].title, len);
+			pos += len;
+		} else {
+			put_u32(&rec[28], SONGCACHE_NO_TITLE);
+		}
+	}
+	free(all);
+	count = total;
+
+	sprintf(tmpname, "%s.tmp", cache->name);
+	ok = (f = fopen(tmpname, "wb")) != NULL;
+	if (ok) {
+		ok = fwrite(buf, 1, size, f) == size;
+		ok = fclose(f) == 0 && ok;
+	}
+	if (ok && rename(tmpname, cache->name) == -1) {
+		/* rename() does not replace files everywhere */
+		unlink(cache->name);
+		ok = rename(tmpname, cache->name) == 0;
+	}
+	if (!ok) {
+		fprintf(stderr, _("Could not write song cache %s: %s\n"), cache->name, strerror(errno));
+		unlink(tmpname);
+	}
+	free(tmpname);
+	free(buf);
+	if (!ok)
+		return false;
+
+	songcache_unmap(cache);
+	songcache_free_pending(cache);
+	songcache_map(cache);
+	return cache->count == count;
+}
+
+regparm void songcache_close(struct songcache *cache)
+{
+	songcache_unmap(cache);
+	songcache_free_pending(cache);
+	free(cache->name);
+	free(cache);
+}
+
+test void test_songcache_roundtrip()
+{
+	char name[] = "/tmp/songcache.XXXXXX";
+	struct songcache_entry e;
+	struct songcache *cache;
+	long i;
+	int fd;
+
+	fd = mkstemp(name);
+	ASSERT_EQUAL("%d", fd != -1, 1);
+	close(fd);
+
+	/* an empty file is an empty cache */
+	cache = songcache_open(name);
+	ASSERT_EQUAL("%ld", songcache_lookup(cache, 1, 0, &e), 0L);
+	for (i=0; i<100; i++) {
+		memset(&e, 0, sizeof(e));
+		e.crc = 0xdead0000 - i * 0x10001;
+		e.subsong = i % 3;
+		e.len = i * 1024;
+		e.loudness = -i;
+		e.title = i % 2 ? "odd" : NULL;
+		ASSERT_EQUAL("%ld", songcache_store(cache, &e), 1L);
+	}
+	ASSERT_EQUAL("%ld", songcache_write(cache), 1L);
+	songcache_close(cache);
+
+	cache = songcache_open(name);
+	/* replace one entry, add another */
+	memset(&e, 0, sizeof(e));
+	e.crc = 0xdead0000 - 7 * 0x10001;
+	e.subsong = 1;
+	e.len = 42;
+	e.title = "seven";
+	songcache_store(cache, &e);
+	e.crc = 5;
+	e.subsong = 0;
+	e.title = NULL;
+	songcache_store(cache, &e);
+	ASSERT_EQUAL("%ld", songcache_write(cache), 1L);
+	songcache_close(cache);
+
+	cache = songcache_open(name);
+	for (i=0; i<100; i++) {
+		ASSERT_EQUAL("%ld", songcache_lookup(cache, 0xdead0000 - i * 0x10001, i % 3, &e), 1L);
+		if (i == 7) {
+			ASSERT_EQUAL("%u", e.len, 42);
+			ASSERT_EQUAL("%d", strcmp(e.title, "seven"), 0);
+			continue;
+		}
+		ASSERT_EQUAL("%u", e.len, (uint32_t)i * 1024);
+		ASSERT_EQUAL("%d", e.loudness, (int32_t)-i);
+		ASSERT_EQUAL("%d", e.title != NULL, (int)(i % 2));
+	}
+	ASSERT_EQUAL("%ld", songcache_lookup(cache, 5, 0, &e), 1L);
+	ASSERT_EQUAL("%ld", songcache_lookup(cache, 5, 1, &e), 0L);
+	songcache_close(cache);
+	unlink(name);
+}
+TEST(test_songcache_roundtrip);
+
+test void test_songcache_invalid()
+{
+	char name[] = "/tmp/songcache.XXXXXX";
+	struct songcache_entry e;
+	struct songcache *cache;
+	int fd;
+
+	fd = mkstemp(name);
+	ASSERT_EQUAL("%d", fd != -1, 1);
+	ASSERT_EQUAL("%d", (int)write(fd, "GBSc\1\0\0\0\5\0\0\0\0\0\0\0", 16), 16);
+	close(fd);
+	cache = songcache_open(name);
+	ASSERT_EQUAL("%ld", songcache_lookup(cache, 0, 0, &e), 0L);
+	songcache_close(cache);
+	unlink(name);
+}
+TEST(test_songcache_invalid);
+TEST_EOF;
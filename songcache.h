@@ -0,0 +1,39 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#ifndef _SONGCACHE_H_
+#define _SONGCACHE_H_
+
+#include <inttypes.h>
+#include "common.h"
+
+/* default cache file, relative to the home directory */
+#define SONGCACHE_FILE ".gbsplaycache"
+
+/*
+ * What is known about one subsong of a file, identified by the crc of
+ * the file.  Zero means unknown for all values.
+ */
+struct songcache_entry {
+	uint32_t crc;
+	uint32_t subsong;
+	uint32_t len;		/* in 1/GBS_LEN_DIV seconds, like gbs_subsong_info */
+	uint32_t intro;
+	uint32_t loop;
+	uint32_t peak;		/* highest absolute sample value */
+	int32_t loudness;	/* mean power in 1/100 dB relative to full scale */
+	/*@null@*/ /*@dependent@*/ const char *title;
+};
+
+struct songcache;
+
+regparm /*@only@*/ /*@null@*/ struct songcache *songcache_open(const char *name);
+regparm long songcache_lookup(struct songcache *cache, uint32_t crc, long subsong, struct songcache_entry *entry);
+regparm long songcache_store(struct songcache *cache, const struct songcache_entry *entry);
+regparm long songcache_write(struct songcache *cache);
+regparm void songcache_close(/*@only@*/ struct songcache *cache);
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Band-limited step synthesis and output scaling kernels, selected
+ * at runtime.
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+#include "test.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#if defined(HAVE_SSE2)
+#  include <emmintrin.h>
+#endif
+#if defined(HAVE_AVX2)
+#  include <immintrin.h>
+#endif
+#if defined(HAVE_NEON)
+#  include <arm_neon.h>
+#endif
+
+static regparm void synth_step_c(int16_t *dst, const short *imp, long n, long l_ofs, long r_ofs)
+{
+	long i;
+
+	for (i=0; i<n; i++) {
+		dst[i*2  ] += imp[i] * l_ofs;
+		dst[i*2+1] += imp[i] * r_ofs;
+	}
+}
+
+/*
+ * The vector kernels duplicate each tap into a left/right pair and
+ * multiply with a l_ofs/r_ofs pattern.  The low 16 bits of the
+ * products and sums are the same as in the scalar version.
+ */
+
+#if defined(HAVE_SSE2)
+__attribute__((target("sse2")))
+static regparm void synth_step_sse2(int16_t *dst, const short *imp, long n, long l_ofs, long r_ofs)
+{
+	__m128i lr = _mm_set_epi16(r_ofs, l_ofs, r_ofs, l_ofs,
+	                           r_ofs, l_ofs, r_ofs, l_ofs);
+	long i;
+
+	for (i=0; i<n; i+=8) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&imp[i]);
+		__m128i *d = (__m128i *)&dst[i*2];
+		__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi16(t, t), lr);
+		__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi16(t, t), lr);
+
+		_mm_storeu_si128(d, _mm_add_epi16(_mm_loadu_si128(d), lo));
+		_mm_storeu_si128(d + 1, _mm_add_epi16(_mm_loadu_si128(d + 1), hi));
+	}
+}
+#endif
+
+#if defined(HAVE_AVX2)
+__attribute__((target("avx2")))
+static regparm void synth_step_avx2(int16_t *dst, const short *imp, long n, long l_ofs, long r_ofs)
+{
+	__m256i lr = _mm256_set_epi16(r_ofs, l_ofs, r_ofs, l_ofs,
+	                              r_ofs, l_ofs, r_ofs, l_ofs,
+	                              r_ofs, l_ofs, r_ofs, l_ofs,
+	                              r_ofs, l_ofs, r_ofs, l_ofs);
+	__m256i mask = _mm256_set1_epi32(0xffff);
+	long i;
+
+	for (i=0; i<n; i+=8) {
+		/* 8 taps widened to 32 bits, then copied into the upper half */
+		__m256i t = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&imp[i]));
+		__m256i pair = _mm256_or_si256(_mm256_and_si256(t, mask), _mm256_slli_epi32(t, 16));
+		__m256i *d = (__m256i *)&dst[i*2];
+
+		_mm256_storeu_si256(d, _mm256_add_epi16(_mm256_loadu_si256(d), _mm256_mullo_epi16(pair, lr)));
+	}
+}
+#endif
+
+#if defined(HAVE_NEON)
+static regparm void synth_step_neon(int16_t *dst, const short *imp, long n, long l_ofs, long r_ofs)
+{
+	const int16_t lrv[8] = { l_ofs, r_ofs, l_ofs, r_ofs, l_ofs, r_ofs, l_ofs, r_ofs };
+	int16x8_t lr = vld1q_s16(lrv);
+	long i;
+
+	for (i=0; i<n; i+=8) {
+		int16x8x2_t t = vzipq_s16(vld1q_s16(&imp[i]), vld1q_s16(&imp[i]));
+		int16_t *d = &dst[i*2];
+
+		vst1q_s16(d, vaddq_s16(vld1q_s16(d), vmulq_s16(t.val[0], lr)));
+		vst1q_s16(d + 8, vaddq_s16(vld1q_s16(d + 8), vmulq_s16(t.val[1], lr)));
+	}
+}
+#endif
+
+static regparm void synth_scale_c(int16_t *dst, const int32_t *src, long n, long vol, int32_t *minmax)
+{
+	long i;
+
+	for (i=0; i<n; i+=2) {
+		long l = src[i];
+		long r = src[i+1];
+
+		dst[i  ] = l * vol / 65536;
+		dst[i+1] = r * vol / 65536;
+		if (l < minmax[0]) minmax[0] = l;
+		if (l > minmax[1]) minmax[1] = l;
+		if (r < minmax[2]) minmax[2] = r;
+		if (r > minmax[3]) minmax[3] = r;
+	}
+}
+
+/*
+ * The x86 scaling kernels multiply in double precision: sample times
+ * volume fits the 53 bit mantissa, scaling by 2^-16 is exact and the
+ * truncating conversion rounds towards zero just like the integer
+ * division.  Sign-extending the low 16 bits before packing keeps the
+ * int16 wraparound instead of saturating.  Left and right are in the
+ * even and odd lanes, so the min/max reductions fold the lanes
+ * pairwise at the end.  Leftover samples go through the scalar code.
+ */
+
+#if defined(HAVE_SSE2)
+__attribute__((target("sse2")))
+static inline __m128i scale4_sse2(__m128i x, __m128d scale)
+{
+	__m128i lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(x), scale));
+	__m128i hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(x, 0x4e)), scale));
+	__m128i q = _mm_unpacklo_epi64(lo, hi);
+
+	return _mm_srai_epi32(_mm_slli_epi32(q, 16), 16);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i min_sse2(__m128i a, __m128i b)
+{
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+
+	return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i max_sse2(__m128i a, __m128i b)
+{
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+__attribute__((target("sse2")))
+static regparm void synth_scale_sse2(int16_t *dst, const int32_t *src, long n, long vol, int32_t *minmax)
+{
+	__m128d scale = _mm_set1_pd(vol / 65536.0);
+	__m128i vmin = _mm_set_epi32(minmax[2], minmax[0], minmax[2], minmax[0]);
+	__m128i vmax = _mm_set_epi32(minmax[3], minmax[1], minmax[3], minmax[1]);
+	long i;
+
+	for (i=0; i+8<=n; i+=8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i+4]);
+
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_packs_epi32(scale4_sse2(a, scale), scale4_sse2(b, scale)));
+		vmin = min_sse2(vmin, min_sse2(a, b));
+		vmax = max_sse2(vmax, max_sse2(a, b));
+	}
+	vmin = min_sse2(vmin, _mm_shuffle_epi32(vmin, 0x4e));
+	vmax = max_sse2(vmax, _mm_shuffle_epi32(vmax, 0x4e));
+	minmax[0] = _mm_cvtsi128_si32(vmin);
+	minmax[1] = _mm_cvtsi128_si32(vmax);
+	minmax[2] = _mm_cvtsi128_si32(_mm_shuffle_epi32(vmin, 0x55));
+	minmax[3] = _mm_cvtsi128_si32(_mm_shuffle_epi32(vmax, 0x55));
+	synth_scale_c(&dst[i], &src[i], n - i, vol, minmax);
+}
+#endif
+
+#if defined(HAVE_AVX2)
+__attribute__((target("avx2")))
+static inline __m128i scale4_avx2(__m128i x, __m256d scale)
+{
+	__m128i q = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(x), scale));
+
+	return _mm_srai_epi32(_mm_slli_epi32(q, 16), 16);
+}
+
+__attribute__((target("avx2")))
+static regparm void synth_scale_avx2(int16_t *dst, const int32_t *src, long n, long vol, int32_t *minmax)
+{
+	__m256d scale = _mm256_set1_pd(vol / 65536.0);
+	__m256i vmin = _mm256_set_epi32(minmax[2], minmax[0], minmax[2], minmax[0],
+	                                minmax[2], minmax[0], minmax[2], minmax[0]);
+	__m256i vmax = _mm256_set_epi32(minmax[3], minmax[1], minmax[3], minmax[1],
+	                                minmax[3], minmax[1], minmax[3], minmax[1]);
+	__m128i mn, mx;
+	long i;
+
+	for (i=0; i+8<=n; i+=8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m128i lo = scale4_avx2(_mm256_castsi256_si128(x), scale);
+		__m128i hi = scale4_avx2(_mm256_extracti128_si256(x, 1), scale);
+
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_packs_epi32(lo, hi));
+		vmin = _mm256_min_epi32(vmin, x);
+		vmax = _mm256_max_epi32(vmax, x);
+	}
+	mn = _mm_min_epi32(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+	mx = _mm_max_epi32(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+	mn = _mm_min_epi32(mn, _mm_shuffle_epi32(mn, 0x4e));
+	mx = _mm_max_epi32(mx, _mm_shuffle_epi32(mx, 0x4e));
+	minmax[0] = _mm_cvtsi128_si32(mn);
+	minmax[1] = _mm_cvtsi128_si32(mx);
+	minmax[2] = _mm_cvtsi128_si32(_mm_shuffle_epi32(mn, 0x55));
+	minmax[3] = _mm_cvtsi128_si32(_mm_shuffle_epi32(mx, 0x55));
+	synth_scale_c(&dst[i], &src[i], n - i, vol, minmax);
+}
+#endif
+
+#if defined(HAVE_NEON)
+/* 64 bit products; negative ones get 0xffff added to round towards zero */
+static inline int32x2_t scale2_neon(int32x2_t x, int32x2_t vol)
+{
+	int64x2_t p = vmull_s32(x, vol);
+
+	p = vaddq_s64(p, vandq_s64(vshrq_n_s64(p, 63), vdupq_n_s64(0xffff)));
+	return vmovn_s64(vshrq_n_s64(p, 16));
+}
+
+static regparm void synth_scale_neon(int16_t *dst, const int32_t *src, long n, long vol, int32_t *minmax)
+{
+	const int32_t minv[4] = { minmax[0], minmax[2], minmax[0], minmax[2] };
+	const int32_t maxv[4] = { minmax[1], minmax[3], minmax[1], minmax[3] };
+	int32x4_t vmin = vld1q_s32(minv);
+	int32x4_t vmax = vld1q_s32(maxv);
+	int32x2_t v = vdup_n_s32(vol);
+	int32x2_t mn, mx;
+	long i;
+
+	for (i=0; i+4<=n; i+=4) {
+		int32x4_t x = vld1q_s32(&src[i]);
+		int32x4_t q = vcombine_s32(scale2_neon(vget_low_s32(x), v),
+		                           scale2_neon(vget_high_s32(x), v));
+
+		vst1_s16(&dst[i], vmovn_s32(q));
+		vmin = vminq_s32(vmin, x);
+		vmax = vmaxq_s32(vmax, x);
+	}
+	mn = vmin_s32(vget_low_s32(vmin), vget_high_s32(vmin));
+	mx = vmax_s32(vget_low_s32(vmax), vget_high_s32(vmax));
+	minmax[0] = vget_lane_s32(mn, 0);
+	minmax[1] = vget_lane_s32(mx, 0);
+	minmax[2] = vget_lane_s32(mn, 1);
+	minmax[3] = vget_lane_s32(mx, 1);
+	synth_scale_c(&dst[i], &src[i], n - i, vol, minmax);
+}
+#endif
+
+static const struct kernel {
+	const char *name;
+	synth_step_fn step;
+	synth_scale_fn scale;
+} kernels[] = {
+#if defined(HAVE_AVX2)
+	{ "avx2", synth_step_avx2, synth_scale_avx2 },
+#endif
+#if defined(HAVE_SSE2)
+	{ "sse2", synth_step_sse2, synth_scale_sse2 },
+#endif
+#if defined(HAVE_NEON)
+	{ "neon", synth_step_neon, synth_scale_neon },
+#endif
+	{ "c", synth_step_c, synth_scale_c },
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+synth_step_fn synth_step = synth_step_c;
+synth_scale_fn synth_scale = synth_scale_c;
+
+static regparm long kernel_supported(const struct kernel *k)
+{
+#if defined(HAVE_AVX2)
+	if (k->step == synth_step_avx2)
+		return __builtin_cpu_supports("avx2");
+#endif
+#if defined(HAVE_SSE2)
+	if (k->step == synth_step_sse2)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return 1;
+}
+
+static void synth_select(void)
+{
+	long i;
+
+	for (i=0; i<NUM_KERNELS; i++) {
+		if (kernel_supported(&kernels[i])) {
+			synth_step = kernels[i].step;
+			synth_scale = kernels[i].scale;
+			return;
+		}
+	}
+}
+
+/*
+ * Every instance calls this, the kernels are only selected by the
+ * first call.  Instances may be set up from several threads at once
+ * while others already render through the pointers.
+ */
+regparm void synth_init(void)
+{
+#ifdef HAVE_PTHREAD
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, synth_select);
+#else
+	static long selected;
+
+	if (!selected) {
+		synth_select();
+		selected = 1;
+	}
+#endif
+}
+
+test void test_synth_step()
+{
+	short imp[32];
+	int16_t expect[64+2];
+	int16_t got[64+2];
+	long k, n, i;
+
+	srand(0);
+	for (k=0; k<NUM_KERNELS; k++) {
+		if (!kernel_supported(&kernels[k]))
+			continue;
+		for (n=0; n<1000; n++) {
+			long l_ofs = rand() % 2048 - 1024;
+			long r_ofs = rand() % 2048 - 1024;
+
+			for (i=0; i<32; i++)
+				imp[i] = rand() % 512 - 256;
+			for (i=0; i<64+2; i++)
+				expect[i] = got[i] = rand();
+			/* unaligned destination */
+			synth_step_c(&expect[1], imp, 32, l_ofs, r_ofs);
+			kernels[k].step(&got[1], imp, 32, l_ofs, r_ofs);
+			for (i=0; i<64+2; i++)
+				ASSERT_EQUAL("%d", got[i], expect[i]);
+		}
+	}
+}
+TEST(test_synth_step);
+
+test void test_synth_scale()
+{
+	int32_t src[2*37];
+	int16_t expect[2*37+2];
+	int16_t got[2*37+2];
+	int32_t expect_minmax[4];
+	int32_t got_minmax[4];
+	long k, n, i;
+
+	srand(0);
+	for (k=0; k<NUM_KERNELS; k++) {
+		if (!kernel_supported(&kernels[k]))
+			continue;
+		for (n=0; n<1000; n++) {
+			long vol = rand() % 65537;
+
+			for (i=0; i<2*37; i++)
+				src[i] = rand() % (1 << 21) - (1 << 20);
+			for (i=0; i<2*37+2; i++)
+				expect[i] = got[i] = rand();
+			expect_minmax[0] = got_minmax[0] = INT_MAX;
+			expect_minmax[1] = got_minmax[1] = INT_MIN;
+			expect_minmax[2] = got_minmax[2] = rand() % 1024;
+			expect_minmax[3] = got_minmax[3] = -(rand() % 1024);
+			/* unaligned destination, odd sample count */
+			synth_scale_c(&expect[1], src, 2*37, vol, expect_minmax);
+			kernels[k].scale(&got[1], src, 2*37, vol, got_minmax);
+			for (i=0; i<2*37+2; i++)
+				ASSERT_EQUAL("%d", got[i], expect[i]);
+			for (i=0; i<4; i++)
+				ASSERT_EQUAL("%d", got_minmax[i], expect_minmax[i]);
+		}
+	}
+}
+TEST(test_synth_scale);
+TEST_EOF;
@@ -0,0 +1,34 @@
+/*
+ * gbsplay is a Gameboy sound player
+ *
+ * Licensed under GNU GPL v1 or, at your option, any later version.
+ */
+
+#ifndef _SYNTH_H_
+#define _SYNTH_H_
+
+#include <inttypes.h>
+#include "common.h"
+
+/*
+ * Add a band-limited step to interleaved stereo samples: dst[2*i] gets
+ * imp[i] * l_ofs and dst[2*i+1] gets imp[i] * r_ofs added, with the
+ * usual int16 wraparound.  n must be a multiple of 8.
+ */
+typedef regparm void (*synth_step_fn)(int16_t *dst, const short *imp, long n, long l_ofs, long r_ofs);
+
+/*
+ * Scale n interleaved left/right values (n even) by vol / 65536, rounding
+ * towards zero like a C division, and store the low 16 bits to dst.
+ * minmax holds left min, left max, right min and right max of the
+ * unscaled input and is updated in place.
+ */
+typedef regparm void (*synth_scale_fn)(int16_t *dst, const int32_t *src, long n, long vol, int32_t *minmax);
+
+extern synth_step_fn synth_step;
+extern synth_scale_fn synth_scale;
+
+/* Pick the fastest kernels the cpu supports. */
+regparm void synth_init(void);
+
+#endif
@@ -19,6 +19,943 @@
 #include "gbs.h"
 #include "util.h"
 
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+#define RENDER_RATE	44100
+#define RENDER_FRAMES	(RENDER_RATE * 20)
+
+static int16_t pushed[RENDER_FRAMES * 2];
+static int16_t pulled[RENDER_FRAMES * 2];
+static long pushed_frames;
+
+static regparm void push_cb(struct gbhw_buffer *buf, void *priv)
+{
+	long n = buf->samples;
+
+	if (n > RENDER_FRAMES - pushed_frames)
+		n = RENDER_FRAMES - pushed_frames;
+	memcpy(&pushed[pushed_frames * 2], buf->data, n * 4);
+	pushed_frames += n;
+}
+
+/*
+ * gbs_render() in odd chunk sizes must match the callback output with
+ * the buffer size gbhw_render() uses when no buffer was set.
+ */
+static regparm long test_render(void)
+{
+	static const long chunks[] = { 1, 333, 4096, 47, 1024, 1023, 9000 };
+	int16_t data[1024 * 2];
+	struct gbhw_buffer buf;
+	struct gbs *gbs;
+	long frames, i;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.data = data;
+	buf.bytes = sizeof(data);
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setcallback(&gbs->gbhw, push_cb, NULL);
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbhw_setbuffer(&gbs->gbhw, &buf);
+	gbs_init(gbs, 0);
+	while (pushed_frames < RENDER_FRAMES)
+		if (!gbs_step(gbs, 10))
+			return false;
+	gbs_close(gbs);
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbs_init(gbs, 0);
+	for (frames=0, i=0; frames < RENDER_FRAMES; i++) {
+		long n = chunks[i % (sizeof(chunks) / sizeof(chunks[0]))];
+		if (n > RENDER_FRAMES - frames)
+			n = RENDER_FRAMES - frames;
+		if (!gbs_render(gbs, &pulled[frames * 2], n))
+			return false;
+		frames += n;
+	}
+	gbs_close(gbs);
+
+	return memcmp(pushed, pulled, sizeof(pushed)) == 0;
+}
+
+/* gbs_step_samples() in small steps must not drift from the exact time */
+static regparm long test_step_samples(void)
+{
+	int16_t data[1024 * 2];
+	struct gbhw_buffer buf;
+	struct gbs *gbs;
+	long long expect;
+	long samples;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.data = data;
+	buf.bytes = sizeof(data);
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbhw_setbuffer(&gbs->gbhw, &buf);
+	gbs_init(gbs, 0);
+	for (samples=0; samples < RENDER_RATE * 10; samples += 7)
+		if (!gbs_step_samples(gbs, 7))
+			return false;
+	expect = (long long)samples * GBHW_CLOCK / RENDER_RATE;
+	if (gbs->ticks < expect || gbs->ticks > expect + 64)
+		return false;
+	gbs_close(gbs);
+
+	return true;
+}
+
+/* rendering after a restore, also into a fresh instance, must match */
+static regparm long test_snapshot(void)
+{
+	static int16_t lead[RENDER_RATE * 4 * 2];
+	static int16_t first[RENDER_RATE * 2 * 2];
+	static int16_t again[RENDER_RATE * 2 * 2];
+	struct gbs *gbs, *fork;
+	char *snap, *bad;
+	long size;
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	fork = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL || fork == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbhw_setrate(&fork->gbhw, RENDER_RATE);
+	gbs_init(gbs, 0);
+	gbs_init(fork, 0);
+	/* leave a partial buffer pending */
+	if (!gbs_render(gbs, lead, RENDER_RATE * 3 + 123))
+		return false;
+
+	size = gbs_snapshot_save(gbs, NULL, 0);
+	snap = malloc(size);
+	bad = malloc(size * 2);
+	if (snap == NULL || bad == NULL || gbs_snapshot_save(gbs, snap, size) != size)
+		return false;
+	if (!gbs_render(gbs, first, RENDER_RATE * 2))
+		return false;
+
+	if (!gbs_snapshot_load(gbs, snap, size) ||
+	    !gbs_render(gbs, again, RENDER_RATE * 2) ||
+	    memcmp(first, again, sizeof(first)) != 0)
+		return false;
+
+	memset(again, 0, sizeof(again));
+	if (!gbs_snapshot_load(fork, snap, size) ||
+	    !gbs_render(fork, again, RENDER_RATE * 2) ||
+	    memcmp(first, again, sizeof(first)) != 0)
+		return false;
+
+	/* truncated snapshots are refused */
+	if (gbs_snapshot_load(fork, snap, size - 1))
+		return false;
+	/* so are corrupted ones */
+	snap[size / 2] ^= 1;
+	if (gbs_snapshot_load(fork, snap, size))
+		return false;
+	snap[size / 2] ^= 1;
+
+	/* and ones with state out of range, before anything is restored */
+	if (!gbs_snapshot_load(gbs, snap, size))
+		return false;
+	gbs->gbhw.rombank = 1000;
+	if (gbs_snapshot_save(gbs, bad, size) != size)
+		return false;
+	gbs->gbhw.rombank = 1;
+	gbs->gbhw.render_pending = -1;
+	if (gbs_snapshot_save(gbs, &bad[size], size) != size)
+		return false;
+	gbs->gbhw.render_pending = 0;
+	if (!gbs_snapshot_load(gbs, snap, size) ||
+	    gbs_snapshot_load(gbs, bad, size) ||
+	    gbs_snapshot_load(gbs, &bad[size], size) ||
+	    !gbs_render(gbs, again, RENDER_RATE * 2) ||
+	    memcmp(first, again, sizeof(first)) != 0)
+		return false;
+
+	free(bad);
+	free(snap);
+	gbs_close(fork);
+	gbs_close(gbs);
+	return true;
+}
+
+/*
+ * The output after a seek must be found in straight-through playback
+ * within one output buffer before the target, both when seeking back
+ * to a keyframe and when seeking forward from the subsong start.
+ */
+static regparm long test_seek_found(const int16_t *out, long frames, long msec)
+{
+	long at = msec * RENDER_RATE / 1000;
+	long i;
+
+	for (i=at-1024; i<=at; i++)
+		if (i >= 0 && memcmp(&pushed[i * 2], out, frames * 4) == 0)
+			return true;
+	return false;
+}
+
+static regparm long test_seek(void)
+{
+	static int16_t out[RENDER_RATE * 2 * 2];
+	struct gbs *gbs;
+	long i;
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbs_init(gbs, 0);
+	if (!gbs_render(gbs, pushed, RENDER_FRAMES))
+		return false;
+	gbs_close(gbs);
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbs->keyframe_interval = 1;
+	gbs_init(gbs, 0);
+	/* keyframes are only taken between steps */
+	for (i=0; i<120; i++)
+		if (!gbs_render(gbs, pulled, RENDER_RATE / 10))
+			return false;
+	if (gbs->keyframes < 12)
+		return false;
+	if (!gbs_seek(gbs, 7300) ||
+	    !gbs_render(gbs, out, RENDER_RATE * 2) ||
+	    !test_seek_found(out, RENDER_RATE * 2, 7300))
+		return false;
+	if (!gbs_seek(gbs, 15500) ||
+	    !gbs_render(gbs, out, RENDER_RATE * 2) ||
+	    !test_seek_found(out, RENDER_RATE * 2, 15500))
+		return false;
+	gbs_close(gbs);
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbs_init(gbs, 0);
+	if (!gbs_seek(gbs, 9100) ||
+	    !gbs_render(gbs, out, RENDER_RATE * 2) ||
+	    !test_seek_found(out, RENDER_RATE * 2, 9100))
+		return false;
+	gbs_close(gbs);
+
+	return true;
+}
+
+/*
+ * Without audio, the channel and register state must advance exactly
+ * as with it, and no output buffer is needed.
+ */
+static regparm long test_noaudio(void)
+{
+	int16_t data[1024 * 2];
+	struct gbhw_buffer buf;
+	struct gbs *gbs, *quiet;
+	long i;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.data = data;
+	buf.bytes = sizeof(data);
+	gbs = gbs_open("examples/nightmode.gbs");
+	quiet = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL || quiet == NULL)
+		return false;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbhw_setbuffer(&gbs->gbhw, &buf);
+	gbs_init(gbs, 0);
+	gbhw_setrate(&quiet->gbhw, RENDER_RATE);
+	gbhw_setaudio(&quiet->gbhw, 0);
+	gbs_init(quiet, 0);
+	if (gbs_render(quiet, pulled, 16))
+		return false;
+	for (i=0; i<100; i++) {
+		if (!gbs_step_samples(gbs, RENDER_RATE / 10 + i) ||
+		    !gbs_step_samples(quiet, RENDER_RATE / 10 + i))
+			return false;
+		if (gbs->ticks != quiet->ticks ||
+		    memcmp(gbs->gbhw.ch, quiet->gbhw.ch, sizeof(gbs->gbhw.ch)) != 0 ||
+		    memcmp(gbs->gbhw.ioregs, quiet->gbhw.ioregs, sizeof(gbs->gbhw.ioregs)) != 0 ||
+		    gbs->gbhw.lfsr != quiet->gbhw.lfsr ||
+		    gbs->gbhw.ch3pos != quiet->gbhw.ch3pos ||
+		    gbs->gbhw.main_div != quiet->gbhw.main_div)
+			return false;
+	}
+	gbs_close(quiet);
+	gbs_close(gbs);
+
+	return true;
+}
+
+/* the loop found must not depend on how long the subsong was played */
+static regparm long test_detect_length(void)
+{
+	struct gbs *gbs;
+	struct gbs_subsong_info info;
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	if (!gbs_detect_length(gbs, 0, 300))
+		return false;
+	info = gbs->subsong_info[0];
+	if (info.loop == 0 || info.intro + info.loop < info.len - 1 ||
+	    info.intro + info.loop > info.len + 1)
+		return false;
+	if (!gbs_detect_length(gbs, 0, 450) ||
+	    gbs->subsong_info[0].intro != info.intro ||
+	    gbs->subsong_info[0].loop != info.loop)
+		return false;
+	/* too short to see the loop twice */
+	if (gbs_detect_length(gbs, 0, info.len * 3 / 2 / GBS_LEN_DIV))
+		return false;
+	if (gbs->subsong != 0 || gbs->ticks != 0)
+		return false;
+	gbs_close(gbs);
+
+	return true;
+}
+
+static regparm long test_probe(void)
+{
+	struct gbs_probe probe;
+	struct gbs *gbs;
+	long ok;
+
+	gbs = gbs_open("examples/nightmode.gbs");
+	if (gbs == NULL)
+		return false;
+	ok = gbs_probe("examples/nightmode.gbs", &probe) &&
+	     strcmp(probe.title, gbs->title) == 0 &&
+	     strcmp(probe.author, gbs->author) == 0 &&
+	     strcmp(probe.copyright, gbs->copyright) == 0 &&
+	     probe.songs == gbs->songs &&
+	     probe.defaultsong == gbs->defaultsong &&
+	     probe.crc == gbs->crcnow &&
+	     probe.len[0] == gbs->subsong_info[0].len;
+	gbs_close(gbs);
+
+	return ok;
+}
+
+static regparm struct gbs *open_copy(const char *name)
+{
+	char buf[0x10000];
+	char *copy;
+	long fd, size;
+	struct gbs *gbs;
+
+	if ((fd = open(name, O_RDONLY)) == -1)
+		return NULL;
+	size = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (size <= 0 || (copy = malloc(size)) == NULL)
+		return NULL;
+	memcpy(copy, buf, size);
+	if ((gbs = gbs_open_mem(name, copy, size)) == NULL)
+		free(copy);
+	return gbs;
+}
+
+/*
+ * gbs_open() builds the rom around the mapped file, it has to match
+ * the one gbs_open_mem() copies together.
+ */
+static regparm long test_open_mapped(void)
+{
+	struct gbs *mapped = gbs_open("examples/nightmode.gbs");
+	struct gbs *copied = open_copy("examples/nightmode.gbs");
+	long ok;
+
+	if (mapped == NULL || copied == NULL)
+		return false;
+	ok = mapped->romsize == copied->romsize &&
+	     memcmp(mapped->rom, copied->rom, mapped->romsize) == 0 &&
+	     strcmp(mapped->title, copied->title) == 0 &&
+	     mapped->crcnow == copied->crcnow;
+	gbs_close(mapped);
+	gbs_close(copied);
+
+	return ok;
+}
+
+/* Instances of one file share their rom, it outlives the first one. */
+static regparm long test_shared_rom(void)
+{
+	struct gbs *a = open_copy("examples/nightmode.gbs");
+	struct gbs *b = open_copy("examples/nightmode.gbs");
+	int16_t out[2*256];
+	long ok;
+
+	if (a == NULL || b == NULL)
+		return false;
+	ok = a->rom == b->rom;
+	gbs_close(a);
+	gbhw_setrate(&b->gbhw, RENDER_RATE);
+	ok = ok && gbs_init(b, 0) && gbs_render(b, out, 256);
+	gbs_close(b);
+
+	return ok;
+}
+
+#ifdef USE_ZLIB
+/*
+ * gzip data opens like the plain file, a truncated stream fails
+ * cleanly instead of playing what was inflated so far.
+ */
+static regparm long test_gzip(void)
+{
+	struct gbs *plain = open_copy("examples/nightmode.gbs");
+	struct gbs *gbs;
+	char *gz;
+	z_stream strm;
+	long ok;
+
+	if (plain == NULL || (gz = malloc(0x10000)) == NULL)
+		return false;
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, 9, Z_DEFLATED, 15|16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	strm.next_in = (Bytef *)plain->buf;
+	strm.avail_in = plain->filesize;
+	strm.next_out = (Bytef *)gz;
+	strm.avail_out = 0x10000;
+	ok = deflate(&strm, Z_FINISH) == Z_STREAM_END;
+	deflateEnd(&strm);
+
+	if (ok && (gbs = gbs_open_mem("nightmode.gbs.gz", gz, strm.total_out - 100)) != NULL) {
+		gbs_close(gbs);
+		ok = false;
+	}
+	if (ok && (gbs = gbs_open_mem("nightmode.gbs.gz", gz, strm.total_out)) != NULL) {
+		ok = gbs->filesize == plain->filesize && gbs->crcnow == plain->crcnow;
+		gbs_close(gbs);
+	} else ok = false;
+	free(gz);
+	gbs_close(plain);
+
+	return ok;
+}
+#endif
+
+static regparm char *put_le(char *p, uint32_t val, long bytes)
+{
+	long i;
+
+	for (i=0; i<bytes; i++)
+		*p++ = val >> (8*i);
+	return p;
+}
+
+/* A stored ZIP member, its central directory entry goes to *cd. */
+static regparm char *put_zip_member(char *p, char **cd, const char *base, const char *name, const char *data, uint32_t len, uint32_t crc)
+{
+	long namelen = strlen(name);
+	uint32_t ofs = p - base;
+
+	p = put_le(p, 0x04034b50, 4);
+	p = put_le(p, 10, 2);		/* version */
+	p = put_le(p, 0, 4);		/* flags, method */
+	p = put_le(p, 0, 4);		/* time, date */
+	p = put_le(p, crc, 4);
+	p = put_le(p, len, 4);
+	p = put_le(p, len, 4);
+	p = put_le(p, namelen, 2);
+	p = put_le(p, 0, 2);
+	memcpy(p, name, namelen);
+	memcpy(p + namelen, data, len);
+
+	*cd = put_le(*cd, 0x02014b50, 4);
+	*cd = put_le(*cd, 10, 2);
+	*cd = put_le(*cd, 10, 2);
+	*cd = put_le(*cd, 0, 4);
+	*cd = put_le(*cd, 0, 4);
+	*cd = put_le(*cd, crc, 4);
+	*cd = put_le(*cd, len, 4);
+	*cd = put_le(*cd, len, 4);
+	*cd = put_le(*cd, namelen, 2);
+	*cd = put_le(*cd, 0, 4);	/* extra, comment */
+	*cd = put_le(*cd, 0, 4);	/* disk, internal attributes */
+	*cd = put_le(*cd, 0, 4);	/* external attributes */
+	*cd = put_le(*cd, ofs, 4);
+	memcpy(*cd, name, namelen);
+	*cd += namelen;
+
+	return p + namelen + len;
+}
+
+/*
+ * A ZIP archive in memory opens its .gbs member, a damaged member
+ * is refused.
+ */
+static long zip_members;
+
+static regparm void zip_member_cb(const char *member, void *priv)
+{
+	if (strcmp(member, zip_members ? "dir/nightmode.gbs" : "readme.txt") == 0)
+		zip_members++;
+	else zip_members = -100;
+}
+
+/* Members of an archive file are listed and probed as tmp#member. */
+static regparm long test_zip_file(const char *tmp, const char *zip, size_t size, uint32_t crc)
+{
+	struct gbs_probe probe;
+	char name[256];
+	long fd, ok;
+
+	if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
+		return false;
+	ok = write(fd, zip, size) == (ssize_t)size;
+	close(fd);
+	zip_members = 0;
+	ok = ok && gbs_zip_members(tmp, zip_member_cb, NULL) && zip_members == 2;
+	snprintf(name, sizeof(name), "%s#dir/nightmode.gbs", tmp);
+	ok = ok && gbs_probe(name, &probe) && probe.crc == crc;
+	unlink(tmp);
+
+	return ok;
+}
+
+static regparm long test_zip(const char *tmp)
+{
+	struct gbs *plain = open_copy("examples/nightmode.gbs");
+	struct gbs *gbs;
+	char cdbuf[256];
+	char *zip, *p, *cd = cdbuf;
+	uint32_t cdofs;
+	long ok = false;
+
+	if (plain == NULL || (zip = malloc(plain->filesize + 512)) == NULL)
+		return false;
+	p = put_zip_member(zip, &cd, zip, "readme.txt", "hi", 2, 0);
+	p = put_zip_member(p, &cd, zip, "dir/nightmode.gbs", plain->buf, plain->filesize, plain->crcnow);
+	cdofs = p - zip;
+	memcpy(p, cdbuf, cd - cdbuf);
+	p += cd - cdbuf;
+	p = put_le(p, 0x06054b50, 4);
+	p = put_le(p, 0, 4);		/* disks */
+	p = put_le(p, 2, 2);
+	p = put_le(p, 2, 2);
+	p = put_le(p, cd - cdbuf, 4);
+	p = put_le(p, cdofs, 4);
+	p = put_le(p, 0, 2);
+
+	if ((gbs = gbs_open_mem("test.zip", zip, p - zip)) != NULL) {
+		ok = gbs->crcnow == plain->crcnow && strcmp(gbs->title, plain->title) == 0;
+		gbs_close(gbs);
+	}
+	ok = ok && test_zip_file(tmp, zip, p - zip, plain->crcnow);
+	/* flip a byte of the member data */
+	zip[30 + 10 + 2 + 30 + 17 + 0x100] ^= 0xff;
+	if ((gbs = gbs_open_mem("test.zip", zip, p - zip)) != NULL) {
+		gbs_close(gbs);
+		ok = false;
+	}
+	free(zip);
+	gbs_close(plain);
+
+	return ok;
+}
+
+/*
+ * A play routine repeating every 4 frames, run by the timer.  The
+ * init routine may set TMA itself, the play rate is the one after it.
+ */
+static regparm long test_detect_length_init(void)
+{
+	static const uint8_t code[] = {
+		0x3e, 0x80, 0xe0, 0x26,	/* init: NR52 = 0x80 */
+		0x3e, 0xc0, 0xe0, 0x06,	/* TMA = 0xc0 */
+		0xc9,			/* ret */
+		0xf0, 0x90,		/* play: ldh a, (0x90) */
+		0x3c,			/* inc a */
+		0xe6, 0x03,		/* and 3 */
+		0xe0, 0x90,		/* ldh (0x90), a */
+		0xe0, 0x13,		/* NR13 = a */
+		0x3e, 0x87, 0xe0, 0x14,	/* NR14 = 0x87 */
+		0xc9,			/* ret */
+	};
+	/* TAC 0x04 counts every 1024 cycles, TMA 0xc0 overflows after 64 */
+	long loop = (4LL * 64 * 1024 * GBS_LEN_DIV + GBHW_CLOCK - 1) / GBHW_CLOCK;
+	long size = 0x70 + sizeof(code);
+	long tma;
+
+	for (tma=0; tma<=0xc0; tma+=0xc0) {
+		char *buf = calloc(1, size);
+		struct gbs *gbs;
+		long ok;
+
+		if (buf == NULL)
+			return false;
+		memcpy(buf, "GBS", 3);
+		buf[0x03] = 1;
+		buf[0x04] = 1;
+		buf[0x05] = 1;
+		put_le(&buf[0x06], 0x400, 2);	/* load */
+		put_le(&buf[0x08], 0x400, 2);	/* init */
+		put_le(&buf[0x0a], 0x409, 2);	/* play */
+		put_le(&buf[0x0c], 0xfffe, 2);	/* stack */
+		buf[0x0e] = tma;
+		buf[0x0f] = 0x04;
+		memcpy(&buf[0x70], code, sizeof(code));
+		if ((gbs = gbs_open_mem("timer.gbs", buf, size)) == NULL) {
+			free(buf);
+			return false;
+		}
+		ok = gbs_detect_length(gbs, 0, 30) &&
+		     gbs->subsong_info[0].loop == loop &&
+		     gbs->subsong_info[0].intro < loop;
+		gbs_close(gbs);
+		if (!ok)
+			return false;
+	}
+
+	return true;
+}
+
+static long vgm_writes;
+static long vgm_write_cycles[4];
+
+static regparm void vgm_io_cb(long cycles, uint32_t addr, uint8_t val, void *priv)
+{
+	if (addr == 0xff23 && vgm_writes < 4)
+		vgm_write_cycles[vgm_writes++] = cycles;
+}
+
+/*
+ * VGM writes happen at the exact cycle of their sample position and
+ * the stream continues at its loop offset.
+ */
+static regparm long test_vgm(void)
+{
+	static const char cmds[] = {
+		'\xb3', 0x12, '\xf0',		/* ff22 */
+		0x61, (char)(1000 & 0xff), 1000 >> 8,
+		'\xb3', 0x13, 0x55,		/* ff23, loop start */
+		0x61, (char)(500 & 0xff), 500 >> 8,
+		0x66,
+	};
+	static const long wait[4] = { 1000, 1500, 2000, 2500 };
+	char *vgm = calloc(1, 0x100 + sizeof(cmds));
+	struct gbs *gbs;
+	int16_t out[2*1024];
+	long ok, i;
+
+	if (vgm == NULL)
+		return false;
+	memcpy(vgm, "Vgm ", 4);
+	put_le(&vgm[0x04], 0x100 + sizeof(cmds) - 0x04, 4);
+	put_le(&vgm[0x08], 0x161, 4);
+	put_le(&vgm[0x1c], 0x100 + 6 - 0x1c, 4);
+	put_le(&vgm[0x34], 0x100 - 0x34, 4);
+	put_le(&vgm[0x80], GBHW_CLOCK, 4);
+	memcpy(&vgm[0x100], cmds, sizeof(cmds));
+
+	if ((gbs = gbs_open_mem("test.vgm", vgm, 0x100 + sizeof(cmds))) == NULL) {
+		free(vgm);
+		return false;
+	}
+	ok = gbs->subsong_info[0].len == 1500 * GBS_LEN_DIV / 44100 &&
+	     gbs->subsong_info[0].intro == 1000 * GBS_LEN_DIV / 44100;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbs_init(gbs, 0);
+	vgm_writes = 0;
+	gbhw_setiocallback(&gbs->gbhw, vgm_io_cb, NULL);
+	for (i=0; i<10 && vgm_writes < 4; i++)
+		gbs_render(gbs, out, 1024);
+	for (i=0; i<4; i++)
+		ok = ok && vgm_write_cycles[i] == wait[i] * (long long)GBHW_CLOCK / 44100;
+	gbs_close(gbs);
+
+	return ok && vgm_writes == 4;
+}
+
+#define IDLE_FRAMES	(RENDER_RATE * 2)
+#define IDLE_WRITES	4096
+
+struct idle_run {
+	long writes;
+	long io[IDLE_WRITES][3];
+	int16_t out[IDLE_FRAMES * 2];
+	gbcpu_regs_u regs;
+	long sum_cycles;
+	long idle_cycles;
+};
+
+static struct idle_run idle_runs[2];
+
+static regparm void idle_io_cb(long cycles, uint32_t addr, uint8_t val, void *priv)
+{
+	struct idle_run *run = priv;
+
+	if (run->writes == IDLE_WRITES)
+		return;
+	run->io[run->writes][0] = cycles;
+	run->io[run->writes][1] = addr;
+	run->io[run->writes][2] = val;
+	run->writes++;
+}
+
+static regparm void idle_step_cb(const long cycles, const struct gbhw_channel ch[], void *priv)
+{
+}
+
+/* play code loaded at 0x400, the step callback turns off skipping */
+static regparm long idle_run(const uint8_t *code, long len, long skip, struct idle_run *run)
+{
+	static const uint8_t setup[] = {
+		0x3e, 0x80, 0xe0, 0x26,	/* NR52 = 0x80 */
+		0x3e, 0x77, 0xe0, 0x24,	/* NR50 = 0x77 */
+		0x3e, 0xff, 0xe0, 0x25,	/* NR51 = 0xff */
+		0x3e, 0x80, 0xe0, 0x11,	/* NR11 = 0x80 */
+		0x3e, 0xf0, 0xe0, 0x12,	/* NR12 = 0xf0 */
+		0x3e, 0x87, 0xe0, 0x14,	/* NR14 = 0x87 */
+	};
+	long size = 0x70 + sizeof(setup) + len;
+	char *buf = calloc(1, size);
+	struct gbs *gbs;
+	long frames;
+
+	if (buf == NULL)
+		return false;
+	memcpy(buf, "GBS", 3);
+	buf[0x03] = 1;
+	buf[0x04] = 1;
+	buf[0x05] = 1;
+	put_le(&buf[0x06], 0x400, 2);	/* load */
+	put_le(&buf[0x08], 0x400, 2);	/* init */
+	put_le(&buf[0x0a], 0x400, 2);	/* play */
+	put_le(&buf[0x0c], 0xfffe, 2);	/* stack */
+	memcpy(&buf[0x70], setup, sizeof(setup));
+	memcpy(&buf[0x70 + sizeof(setup)], code, len);
+	if ((gbs = gbs_open_mem("idle.gbs", buf, size)) == NULL) {
+		free(buf);
+		return false;
+	}
+
+	memset(run, 0, sizeof(*run));
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	gbhw_setiocallback(&gbs->gbhw, idle_io_cb, run);
+	if (!skip)
+		gbhw_setstepcallback(&gbs->gbhw, idle_step_cb, NULL);
+	gbs_init(gbs, 0);
+	for (frames=0; frames < IDLE_FRAMES; frames += 1000) {
+		if (!gbs_render(gbs, &run->out[frames * 2], 1000))
+			return false;
+	}
+	run->regs = gbs->gbhw.gbcpu.regs;
+	run->sum_cycles = gbs->gbhw.sum_cycles;
+	run->idle_cycles = gbs->gbhw.idle_cycles;
+	gbs_close(gbs);
+
+	return true;
+}
+
+/*
+ * Skipping busy-wait loops on LY and STAT must not change the output,
+ * the io writes or the cpu state.
+ */
+static regparm long test_idle_skip(void)
+{
+	static const uint8_t ly_loop[] = {
+		0xf0, 0x44,		/* wait: ldh a, (0x44) */
+		0xfe, 0x90,		/* cp 0x90 */
+		0x20, 0xfa,		/* jr nz, wait */
+		0x04, 0x78, 0xe0, 0x13,	/* NR13 = ++b */
+		0xf0, 0x44,		/* ldh a, (0x44) */
+		0xfe, 0x91,		/* cp 0x91 */
+		0x20, 0xfa,		/* jr nz, $-6 */
+		0x18, 0xee,		/* jr wait */
+	};
+	static const uint8_t stat_loop[] = {
+		0xf0, 0x41,		/* wait: ldh a, (0x41) */
+		0xcb, 0x47,		/* bit 0, a */
+		0x20, 0xfa,		/* jr nz, wait */
+		0x04, 0x78, 0xe0, 0x13,	/* NR13 = ++b */
+		0xf0, 0x41,		/* ldh a, (0x41) */
+		0xcb, 0x47,		/* bit 0, a */
+		0x28, 0xfa,		/* jr z, $-6 */
+		0x18, 0xee,		/* jr wait */
+	};
+	const uint8_t *code[2] = { ly_loop, stat_loop };
+	const long len[2] = { sizeof(ly_loop), sizeof(stat_loop) };
+	struct idle_run *on = &idle_runs[0];
+	struct idle_run *off = &idle_runs[1];
+	long i;
+
+	for (i=0; i<2; i++) {
+		if (!idle_run(code[i], len[i], 1, on) ||
+		    !idle_run(code[i], len[i], 0, off))
+			return false;
+		if (on->idle_cycles == 0 || off->idle_cycles != 0 ||
+		    on->writes < 100 || on->writes != off->writes ||
+		    memcmp(on->io, off->io, sizeof(on->io)) != 0 ||
+		    memcmp(on->out, off->out, sizeof(on->out)) != 0 ||
+		    memcmp(&on->regs, &off->regs, sizeof(on->regs)) != 0 ||
+		    on->sum_cycles != off->sum_cycles)
+			return false;
+	}
+
+	return true;
+}
+
+static long cache_writes;
+static uint8_t cache_vals[32];
+
+static regparm void cache_io_cb(long cycles, uint32_t addr, uint8_t val, void *priv)
+{
+	if (addr == 0xff13 && cache_writes < 32)
+		cache_vals[cache_writes++] = val;
+}
+
+/* ld hl, addr; then ld (hl), n; inc hl for every byte of code */
+static regparm uint8_t *asm_copy(uint8_t *p, uint16_t addr, const uint8_t *code, long len)
+{
+	long i;
+
+	*p++ = 0x21;
+	*p++ = addr & 0xff;
+	*p++ = addr >> 8;
+	for (i=0; i<len; i++) {
+		*p++ = 0x36;
+		*p++ = code[i];
+		*p++ = 0x23;
+	}
+	return p;
+}
+
+/* ld a, val; ld (addr), a */
+static regparm uint8_t *asm_store(uint8_t *p, uint16_t addr, uint8_t val)
+{
+	*p++ = 0x3e;
+	*p++ = val;
+	*p++ = 0xea;
+	*p++ = addr & 0xff;
+	*p++ = addr >> 8;
+	return p;
+}
+
+static regparm uint8_t *asm_call(uint8_t *p, uint16_t addr)
+{
+	*p++ = 0xcd;
+	*p++ = addr & 0xff;
+	*p++ = addr >> 8;
+	return p;
+}
+
+/*
+ * Code written to RAM has to be decoded again after it was
+ * overwritten, also by itself within the running block, and code in
+ * the banked rom area has to follow the bank switches.
+ */
+static regparm long test_block_cache(void)
+{
+	static const uint8_t ram_addr[] = { 0xc1, 0xff, 0xa1 };
+	static const uint8_t selfmod[] = {
+		0x3e, 0x33,		/* ld a, 0x33 */
+		0xea, 0x06, 0xa2,	/* ld (0xa206), a */
+		0x3e, 0x00,		/* ld a, 0x00 */
+		0xe0, 0x13,		/* ldh (0x13), a */
+		0xc9,			/* ret */
+	};
+	static const uint8_t expect[] = {
+		0x10, 0x10, 0x80, 0x11, 0x11, 0x81, 0x12, 0x12, 0x82,
+		0x33, 0x33,
+		0x41, 0x42, 0x41, 0x42,
+	};
+	long size = 0x70 + 0xc000 - 0x400;
+	char *buf = calloc(1, size);
+	uint8_t *code = (uint8_t *)&buf[0x70];
+	uint8_t *p = code;
+	uint8_t routine[5] = { 0x3e, 0x00, 0xe0, 0x13, 0xc9 };
+	int16_t out[2*1024];
+	struct gbs *gbs;
+	long ok, step, i;
+
+	if (buf == NULL)
+		return false;
+	memcpy(buf, "GBS", 3);
+	buf[0x03] = 1;
+	buf[0x04] = 1;
+	buf[0x05] = 1;
+	put_le(&buf[0x06], 0x400, 2);	/* load */
+	put_le(&buf[0x08], 0x400, 2);	/* init */
+	put_le(&buf[0x0c], 0xfffe, 2);	/* stack */
+
+	/* NR52 = 0x80 */
+	*p++ = 0x3e;
+	*p++ = 0x80;
+	*p++ = 0xe0;
+	*p++ = 0x26;
+	/* WRAM, HRAM and external RAM: run, run cached, patch, run */
+	for (i=0; i<3; i++) {
+		uint16_t addr = ram_addr[i] << 8 | 0x90;
+
+		routine[1] = 0x10 + i;
+		p = asm_copy(p, addr, routine, sizeof(routine));
+		p = asm_call(p, addr);
+		p = asm_call(p, addr);
+		p = asm_store(p, addr + 1, 0x80 + i);
+		p = asm_call(p, addr);
+	}
+	/* code patching the operand of its next instruction */
+	p = asm_copy(p, 0xa200, selfmod, sizeof(selfmod));
+	p = asm_call(p, 0xa200);
+	p = asm_store(p, 0xa206, 0x00);
+	p = asm_call(p, 0xa200);
+	/* the same address in rom banks 1 and 2 */
+	for (i=0; i<2; i++) {
+		p = asm_store(p, 0x2000, 2);
+		p = asm_call(p, 0x4000);
+		p = asm_store(p, 0x2000, 1);
+		p = asm_call(p, 0x4000);
+	}
+	/* play is just the ret */
+	put_le(&buf[0x0a], 0x400 + (p - code), 2);
+	*p++ = 0xc9;
+	routine[1] = 0x42;
+	memcpy(&code[0x4000 - 0x400], routine, sizeof(routine));
+	routine[1] = 0x41;
+	memcpy(&code[0x8000 - 0x400], routine, sizeof(routine));
+
+	if ((gbs = gbs_open_mem("cache.gbs", buf, size)) == NULL) {
+		free(buf);
+		return false;
+	}
+
+	/* the block cache is used both by gbcpu_run() and gbcpu_step() */
+	ok = true;
+	gbhw_setrate(&gbs->gbhw, RENDER_RATE);
+	for (step=0; step<2; step++) {
+		gbhw_setiocallback(&gbs->gbhw, cache_io_cb, NULL);
+		if (step)
+			gbhw_setstepcallback(&gbs->gbhw, idle_step_cb, NULL);
+		gbs_init(gbs, 0);
+		cache_writes = 0;
+		for (i=0; i<10 && cache_writes < (long)sizeof(expect); i++)
+			gbs_render(gbs, out, 1024);
+		ok = ok && cache_writes == sizeof(expect) &&
+		     memcmp(cache_vals, expect, sizeof(expect)) == 0;
+	}
+	gbs_close(gbs);
+
+	return ok;
+}
+
 int main(int argc, char **argv)
 {
 	struct gbs *gbs;
@@ -29,6 +966,69 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (!test_render()) {
+		fprintf(stderr, "%s: gbs_render output differs from callback output\n", argv[0]);
+		exit(5);
+	}
+	if (!test_step_samples()) {
+		fprintf(stderr, "%s: gbs_step_samples drifted\n", argv[0]);
+		exit(6);
+	}
+	if (!test_snapshot()) {
+		fprintf(stderr, "%s: snapshot restore changed the output\n", argv[0]);
+		exit(7);
+	}
+	if (!test_seek()) {
+		fprintf(stderr, "%s: output after seeking differs\n", argv[0]);
+		exit(8);
+	}
+	if (!test_noaudio()) {
+		fprintf(stderr, "%s: emulation without audio diverged\n", argv[0]);
+		exit(9);
+	}
+	if (!test_detect_length()) {
+		fprintf(stderr, "%s: loop detection failed\n", argv[0]);
+		exit(10);
+	}
+	if (!test_probe()) {
+		fprintf(stderr, "%s: gbs_probe differs from gbs_open\n", argv[0]);
+		exit(11);
+	}
+	if (!test_open_mapped()) {
+		fprintf(stderr, "%s: rom of the mapped file differs\n", argv[0]);
+		exit(12);
+	}
+	if (!test_shared_rom()) {
+		fprintf(stderr, "%s: rom images are not shared\n", argv[0]);
+		exit(13);
+	}
+#ifdef USE_ZLIB
+	if (!test_gzip()) {
+		fprintf(stderr, "%s: gzip loading failed\n", argv[0]);
+		exit(14);
+	}
+#endif
+	if (!test_zip(argv[1])) {
+		fprintf(stderr, "%s: ZIP loading failed\n", argv[0]);
+		exit(15);
+	}
+	if (!test_vgm()) {
+		fprintf(stderr, "%s: VGM playback is off\n", argv[0]);
+		exit(16);
+	}
+	if (!test_idle_skip()) {
+		fprintf(stderr, "%s: skipping busy-wait loops changed the output\n", argv[0]);
+		exit(17);
+	}
+	if (!test_block_cache()) {
+		fprintf(stderr, "%s: stale code ran from the block cache\n", argv[0]);
+		exit(18);
+	}
+	if (!test_detect_length_init()) {
+		fprintf(stderr, "%s: loop detection failed with a timer set up by init\n", argv[0]);
+		exit(19);
+	}
+
 	gbs = gbs_open("examples/nightmode.gbs");
 	if (gbs == NULL) {
 		fprintf(stderr, "%s: gbs_open failed\n", argv[0]);